@@ -21,6 +21,8 @@ using namespace Eigen;
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 
+#include "myslam/bilinear.h"
+
 using namespace cv;
 
 /**********************************************
@@ -122,17 +124,6 @@ bool updateDepthFilter(
  */
 double NCC(const Mat &ref, const Mat &curr, const Vector2d &pt_ref, const Vector2d &pt_curr);
 
-// 双线性灰度插值
-inline double getBilinearInterpolatedValue(const Mat &img, const Vector2d &pt) {
-    uchar *d = &img.data[int(pt(1, 0)) * img.step + int(pt(0, 0))];
-    double xx = pt(0, 0) - floor(pt(0, 0));
-    double yy = pt(1, 0) - floor(pt(1, 0));
-    return ((1 - xx) * (1 - yy) * double(d[0]) +
-            xx * (1 - yy) * double(d[1]) +
-            (1 - xx) * yy * double(d[img.step]) +
-            xx * yy * double(d[img.step + 1])) / 255.0;
-}
-
 // ------------------------------------------------------------------
 // 一些小工具
 // 显示估计的深度图
@@ -338,15 +329,19 @@ double NCC(
     const Mat &ref, const Mat &curr,
     const Vector2d &pt_ref, const Vector2d &pt_curr) {
     // 零均值-归一化互相关
+    // 当前帧的窗口为双线性插值，窗口内共享亚像素权重，超出图像时取边界像素
+    float window_curr[ncc_area];
+    myslam::SampleBilinearPatch(curr, float(pt_curr(0, 0)), float(pt_curr(1, 0)), ncc_window_size, window_curr);
+
     // 先算均值
     double mean_ref = 0, mean_curr = 0;
     vector<double> values_ref, values_curr; // 参考帧和当前帧的均值
-    for (int x = -ncc_window_size; x <= ncc_window_size; x++)
-        for (int y = -ncc_window_size; y <= ncc_window_size; y++) {
+    for (int y = -ncc_window_size; y <= ncc_window_size; y++)
+        for (int x = -ncc_window_size; x <= ncc_window_size; x++) {
             double value_ref = double(ref.ptr<uchar>(int(y + pt_ref(1, 0)))[int(x + pt_ref(0, 0))]) / 255.0;
             mean_ref += value_ref;
 
-            double value_curr = getBilinearInterpolatedValue(curr, pt_curr + Vector2d(x, y));
+            double value_curr = window_curr[values_curr.size()] / 255.0;
             mean_curr += value_curr;
 
             values_ref.push_back(value_ref);
@@ -0,0 +1,158 @@
+//
+// Run myslam over several KITTI sequences concurrently in one process.
+// Each sequence owns its own VisualOdometry instance (config, map, id
+// counters), so sequences are distributed over a fixed set of worker threads.
+//
+
+#include <gflags/gflags.h>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include "myslam/thread_runtime.h"
+#include "myslam/visual_odometry.h"
+
+DEFINE_string(config_file, "./config/default.yaml", "config file path");
+DEFINE_string(kitti_root, "./dataset",
+              "KITTI odometry root containing sequences/ and poses/");
+DEFINE_string(sequences, "00,01,02,03,04,05,06,07,08,09,10",
+              "comma separated sequence names");
+DEFINE_int32(num_threads, 0,
+             "number of sequences run concurrently, 0 for hardware threads");
+
+using namespace myslam;
+
+struct SequenceResult {
+    std::string name;
+    bool success = false;
+    size_t num_frames = 0;
+    double tracking_time = 0;  // seconds spent in the frontend
+    double wall_time = 0;      // seconds from Init to the end of Run
+    size_t num_evaluated = 0;  // frames compared against ground truth
+    double ate_rmse = -1;      // absolute trajectory error, meters
+    double final_error = -1;   // translation error of the last frame, meters
+};
+
+/// load KITTI ground truth poses (Twc, one 3x4 row-major matrix per line)
+bool LoadGroundTruth(const std::string &path,
+                     VisualOdometry::TrajectoryType &poses) {
+    std::ifstream fin(path);
+    if (!fin) return false;
+    std::string line;
+    while (std::getline(fin, line)) {
+        if (line.empty()) continue;
+        std::istringstream iss(line);
+        Mat34 T;
+        for (int r = 0; r < 3; ++r)
+            for (int c = 0; c < 4; ++c) iss >> T(r, c);
+        Eigen::Quaterniond q(T.block<3, 3>(0, 0));
+        poses.push_back(SE3(q.normalized(), T.col(3)));
+    }
+    return true;
+}
+
+void RunSequence(const std::string &name, SequenceResult &result) {
+    result.name = name;
+    auto t1 = std::chrono::steady_clock::now();
+
+    VisualOdometry vo(FLAGS_config_file);
+    vo.SetDatasetDir(FLAGS_kitti_root + "/sequences/" + name);
+    vo.SetUseViewer(false);
+    // the pool worker is shared by the sequences, keep its own options
+    vo.SetApplyFrontendThreadOptions(false);
+    if (vo.Init() == false) {
+        LOG(ERROR) << "sequence " << name << " failed to init";
+        return;
+    }
+    vo.Run();
+
+    auto t2 = std::chrono::steady_clock::now();
+    result.wall_time =
+        std::chrono::duration_cast<std::chrono::duration<double>>(t2 - t1)
+            .count();
+    result.success = true;
+    result.tracking_time = vo.GetTrackingTime();
+
+    const auto &estimated = vo.GetTrajectory();
+    result.num_frames = estimated.size();
+
+    VisualOdometry::TrajectoryType ground_truth;
+    if (!LoadGroundTruth(FLAGS_kitti_root + "/poses/" + name + ".txt",
+                         ground_truth)) {
+        LOG(WARNING) << "no ground truth for sequence " << name;
+        return;
+    }
+
+    // both trajectories start at identity, compare camera centers directly
+    size_t n = std::min(estimated.size(), ground_truth.size());
+    double sum_sq = 0;
+    for (size_t i = 0; i < n; ++i) {
+        Vec3 error = estimated[i].inverse().translation() -
+                     ground_truth[i].translation();
+        sum_sq += error.squaredNorm();
+        if (i + 1 == n) result.final_error = error.norm();
+    }
+    if (n > 0) {
+        result.num_evaluated = n;
+        result.ate_rmse = std::sqrt(sum_sq / n);
+    }
+}
+
+int main(int argc, char **argv) {
+    google::ParseCommandLineFlags(&argc, &argv, true);
+
+    std::vector<std::string> sequences;
+    std::stringstream ss(FLAGS_sequences);
+    for (std::string name; std::getline(ss, name, ',');) {
+        if (!name.empty()) sequences.push_back(name);
+    }
+
+    int num_threads = FLAGS_num_threads;
+    if (num_threads <= 0) num_threads = std::thread::hardware_concurrency();
+    num_threads = std::max(1, std::min<int>(num_threads, sequences.size()));
+    LOG(INFO) << "running " << sequences.size() << " sequences on "
+              << num_threads << " threads";
+
+    // every sequence is one task, idle workers take the next one
+    std::vector<SequenceResult> results(sequences.size());
+    auto t1 = std::chrono::steady_clock::now();
+    {
+        ThreadPool pool(num_threads, ThreadOptions("sequence"));
+        std::vector<std::future<void>> tasks;
+        for (size_t k = 0; k < sequences.size(); ++k) {
+            tasks.push_back(pool.Submit([&sequences, &results, k]() {
+                RunSequence(sequences[k], results[k]);
+            }));
+        }
+        for (auto &task : tasks) task.get();
+    }
+    auto t2 = std::chrono::steady_clock::now();
+    double total_time =
+        std::chrono::duration_cast<std::chrono::duration<double>>(t2 - t1)
+            .count();
+
+    size_t total_frames = 0;
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << "seq\tframes\tfps(track)\tfps(wall)\tATE(m)\tfinal(m)"
+              << std::endl;
+    for (auto &r : results) {
+        if (!r.success) {
+            std::cout << r.name << "\tfailed" << std::endl;
+            continue;
+        }
+        total_frames += r.num_frames;
+        std::cout << r.name << "\t" << r.num_frames << "\t"
+                  << r.num_frames / std::max(r.tracking_time, 1e-9) << "\t"
+                  << r.num_frames / std::max(r.wall_time, 1e-9) << "\t";
+        if (r.num_evaluated > 0) {
+            std::cout << r.ate_rmse << "\t" << r.final_error << std::endl;
+        } else {
+            std::cout << "-\t-" << std::endl;
+        }
+    }
+    std::cout << "total " << total_frames << " frames in " << total_time
+              << " seconds, " << total_frames / std::max(total_time, 1e-9)
+              << " frames/s" << std::endl;
+    return 0;
+}
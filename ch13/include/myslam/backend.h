@@ -8,6 +8,7 @@
 #include "myslam/common_include.h"
 #include "myslam/frame.h"
 #include "myslam/map.h"
+#include "myslam/thread_runtime.h"
 
 namespace myslam {
 class Map;
@@ -22,8 +23,8 @@ class Backend {
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
     typedef std::shared_ptr<Backend> Ptr;
 
-    /// 构造函数中启动优化线程并挂起
-    Backend();
+    /// 构造函数中启动优化线程并挂起，options指定线程名称、亲和性和优先级
+    Backend(const ThreadOptions &options = ThreadOptions("backend"));
 
     // 设置左右目的相机，用于获得内外参
     void SetCameras(Camera::Ptr left, Camera::Ptr right) {
@@ -0,0 +1,316 @@
+#pragma once
+#ifndef MYSLAM_BILINEAR_H
+#define MYSLAM_BILINEAR_H
+
+#include <opencv2/core/core.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace myslam {
+
+/**
+ * 双线性插值采样，ch8、ch12和ch13的光度误差、图块和NCC共用
+ * - 单点：uchar或float图像，可在同一次读取中得到梯度
+ * - 批量：N个任意坐标的uchar图像采样，AVX2下8个一组gather读取4x4邻域
+ * - 图块：整数间隔的图块共享亚像素权重，权重定点化后只计算一次
+ * 梯度为插值结果的中心差分 0.5 * (I(x+1, y) - I(x-1, y))，
+ * 各接口的结果一致，定点权重的误差小于0.05灰度
+ */
+
+/// pixels outside the image: CLAMP repeats the border pixels, ZERO reads 0
+enum class BorderPolicy { CLAMP, ZERO };
+
+/// fixed point bits of BilinearWeights
+const int kBilinearWeightBits = 14;
+
+/// bilinear weights of a sub-pixel offset in fixed point, they sum to
+/// 1 << kBilinearWeightBits
+struct BilinearWeights {
+    int16_t w00, w01, w10, w11;
+
+    BilinearWeights(float ax, float ay) {
+        const float one = 1 << kBilinearWeightBits;
+        w00 = int16_t(std::lrint((1 - ax) * (1 - ay) * one));
+        w01 = int16_t(std::lrint(ax * (1 - ay) * one));
+        w10 = int16_t(std::lrint((1 - ax) * ay * one));
+        w11 = int16_t((1 << kBilinearWeightBits) - w00 - w01 - w10);
+    }
+};
+
+namespace internal {
+
+/// pixel (x, y), or the border policy outside the image
+template <typename T>
+inline float BorderPixel(const cv::Mat &img, int x, int y,
+                         BorderPolicy border) {
+    if (x < 0 || y < 0 || x >= img.cols || y >= img.rows) {
+        if (border == BorderPolicy::ZERO) return 0;
+        x = std::min(std::max(x, 0), img.cols - 1);
+        y = std::min(std::max(y, 0), img.rows - 1);
+    }
+    return float(img.ptr<T>(y)[x]);
+}
+
+/// keeps far away coordinates in the int range, the samples are unchanged
+inline float ClampCoordinate(float v, int size) {
+    return std::min(std::max(v, -2.f), float(size + 1));
+}
+
+}  // namespace internal
+
+/**
+ * bilinear sample of a single channel image
+ * @tparam T  pixel type, uchar for CV_8UC1 or float for CV_32FC1
+ */
+template <typename T = uchar>
+inline float SampleBilinear(const cv::Mat &img, float x, float y,
+                            BorderPolicy border = BorderPolicy::CLAMP) {
+    x = internal::ClampCoordinate(x, img.cols);
+    y = internal::ClampCoordinate(y, img.rows);
+    const float x0 = std::floor(x), y0 = std::floor(y);
+    const int ix = int(x0), iy = int(y0);
+    const float ax = x - x0, ay = y - y0;
+    float p00, p01, p10, p11;
+    if (ix >= 0 && iy >= 0 && ix + 1 < img.cols && iy + 1 < img.rows) {
+        const T *row0 = img.ptr<T>(iy) + ix, *row1 = img.ptr<T>(iy + 1) + ix;
+        p00 = row0[0];
+        p01 = row0[1];
+        p10 = row1[0];
+        p11 = row1[1];
+    } else {
+        p00 = internal::BorderPixel<T>(img, ix, iy, border);
+        p01 = internal::BorderPixel<T>(img, ix + 1, iy, border);
+        p10 = internal::BorderPixel<T>(img, ix, iy + 1, border);
+        p11 = internal::BorderPixel<T>(img, ix + 1, iy + 1, border);
+    }
+    return (1 - ay) * (p00 + ax * (p01 - p00)) +
+           ay * (p10 + ax * (p11 - p10));
+}
+
+/**
+ * bilinear sample and its gradient, read from one 4x4 neighbourhood
+ * @param gx, gy  [out] central differences of the bilinear samples
+ */
+template <typename T = uchar>
+inline float SampleBilinear(const cv::Mat &img, float x, float y, float &gx,
+                            float &gy,
+                            BorderPolicy border = BorderPolicy::CLAMP) {
+    x = internal::ClampCoordinate(x, img.cols);
+    y = internal::ClampCoordinate(y, img.rows);
+    const float x0 = std::floor(x), y0 = std::floor(y);
+    const int ix = int(x0), iy = int(y0);
+    const float ax = x - x0, ay = y - y0;
+    float p[4][4];  // rows iy - 1 .. iy + 2, columns ix - 1 .. ix + 2
+    if (ix >= 1 && iy >= 1 && ix + 2 < img.cols && iy + 2 < img.rows) {
+        for (int r = 0; r < 4; ++r) {
+            const T *row = img.ptr<T>(iy - 1 + r) + ix - 1;
+            for (int c = 0; c < 4; ++c) p[r][c] = row[c];
+        }
+    } else {
+        for (int r = 0; r < 4; ++r) {
+            for (int c = 0; c < 4; ++c) {
+                p[r][c] = internal::BorderPixel<T>(img, ix - 1 + c, iy - 1 + r,
+                                                   border);
+            }
+        }
+    }
+    auto lerp_x = [&](int r, int c) {
+        return p[r][c] + ax * (p[r][c + 1] - p[r][c]);
+    };
+    const float up = lerp_x(0, 1), center0 = lerp_x(1, 1),
+                center1 = lerp_x(2, 1), down = lerp_x(3, 1);
+    const float left = (1 - ay) * lerp_x(1, 0) + ay * lerp_x(2, 0);
+    const float right = (1 - ay) * lerp_x(1, 2) + ay * lerp_x(2, 2);
+    gx = 0.5f * (right - left);
+    gy = 0.5f * ((1 - ay) * center1 + ay * down -
+                 ((1 - ay) * up + ay * center0));
+    return (1 - ay) * center0 + ay * center1;
+}
+
+/**
+ * bilinear samples of n points of a CV_8UC1 image
+ * with AVX2 8 points at a time, the 4x4 neighbourhoods are gathered as rows
+ * of 4 bytes; groups with a point at the border fall back to single samples
+ * @param values  [out] n samples
+ * @param gx, gy  [out] n gradients each, nullptr to skip the gradients
+ */
+inline void SampleBilinearBatch(const cv::Mat &img, const float *x,
+                                const float *y, int n, float *values,
+                                float *gx = nullptr, float *gy = nullptr,
+                                BorderPolicy border = BorderPolicy::CLAMP) {
+    const bool gradients = gx != nullptr || gy != nullptr;
+    auto sample_one = [&](int i) {
+        if (gradients) {
+            float dx, dy;
+            values[i] = SampleBilinear<uchar>(img, x[i], y[i], dx, dy, border);
+            if (gx) gx[i] = dx;
+            if (gy) gy[i] = dy;
+        } else {
+            values[i] = SampleBilinear<uchar>(img, x[i], y[i], border);
+        }
+    };
+
+    int i = 0;
+#if defined(__AVX2__)
+    const int *data = reinterpret_cast<const int *>(img.data);
+    const int step = int(img.step);
+    const __m256i one_i = _mm256_set1_epi32(1);
+    const __m256i max_x = _mm256_set1_epi32(img.cols - 3);
+    const __m256i max_y = _mm256_set1_epi32(img.rows - 3);
+    const __m256i step_v = _mm256_set1_epi32(step);
+    const __m256i byte = _mm256_set1_epi32(0xff);
+    const __m256 one = _mm256_set1_ps(1), half = _mm256_set1_ps(0.5f);
+    // bytes c of 4 gathered pixels as floats
+    auto channel = [&](__m256i v, int c) {
+        return _mm256_cvtepi32_ps(
+            _mm256_and_si256(_mm256_srli_epi32(v, 8 * c), byte));
+    };
+    auto lerp = [](__m256 a, __m256 b, __m256 t) {
+        return _mm256_add_ps(a, _mm256_mul_ps(t, _mm256_sub_ps(b, a)));
+    };
+    for (; i + 8 <= n; i += 8) {
+        const __m256 xf = _mm256_loadu_ps(x + i), yf = _mm256_loadu_ps(y + i);
+        const __m256 x0 = _mm256_floor_ps(xf), y0 = _mm256_floor_ps(yf);
+        const __m256i ix = _mm256_cvttps_epi32(x0);
+        const __m256i iy = _mm256_cvttps_epi32(y0);
+        // every neighbourhood inside the image, NaN converts to INT_MIN
+        const __m256i outside = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpgt_epi32(one_i, ix),
+                            _mm256_cmpgt_epi32(ix, max_x)),
+            _mm256_or_si256(_mm256_cmpgt_epi32(one_i, iy),
+                            _mm256_cmpgt_epi32(iy, max_y)));
+        if (!_mm256_testz_si256(outside, outside)) {
+            for (int k = i; k < i + 8; ++k) sample_one(k);
+            continue;
+        }
+        const __m256 ax = _mm256_sub_ps(xf, x0), ay = _mm256_sub_ps(yf, y0);
+        const __m256 ay1 = _mm256_sub_ps(one, ay);
+        // byte offsets of the pixels (ix - 1, iy)
+        const __m256i offset = _mm256_sub_epi32(
+            _mm256_add_epi32(_mm256_mullo_epi32(iy, step_v), ix), one_i);
+        const __m256i row0 = _mm256_i32gather_epi32(data, offset, 1);
+        const __m256i row1 =
+            _mm256_i32gather_epi32(data, _mm256_add_epi32(offset, step_v), 1);
+        const __m256 center0 = lerp(channel(row0, 1), channel(row0, 2), ax);
+        const __m256 center1 = lerp(channel(row1, 1), channel(row1, 2), ax);
+        _mm256_storeu_ps(values + i, lerp(center0, center1, ay));
+        if (!gradients) continue;
+
+        const __m256i row_up =
+            _mm256_i32gather_epi32(data, _mm256_sub_epi32(offset, step_v), 1);
+        const __m256i row_down = _mm256_i32gather_epi32(
+            data, _mm256_add_epi32(offset, _mm256_add_epi32(step_v, step_v)),
+            1);
+        if (gx) {
+            const __m256 left =
+                lerp(lerp(channel(row0, 0), channel(row0, 1), ax),
+                     lerp(channel(row1, 0), channel(row1, 1), ax), ay);
+            const __m256 right =
+                lerp(lerp(channel(row0, 2), channel(row0, 3), ax),
+                     lerp(channel(row1, 2), channel(row1, 3), ax), ay);
+            _mm256_storeu_ps(gx + i,
+                             _mm256_mul_ps(half, _mm256_sub_ps(right, left)));
+        }
+        if (gy) {
+            const __m256 up = lerp(channel(row_up, 1), channel(row_up, 2), ax);
+            const __m256 down =
+                lerp(channel(row_down, 1), channel(row_down, 2), ax);
+            const __m256 diff = _mm256_sub_ps(
+                _mm256_add_ps(_mm256_mul_ps(ay1, center1),
+                              _mm256_mul_ps(ay, down)),
+                _mm256_add_ps(_mm256_mul_ps(ay1, up),
+                              _mm256_mul_ps(ay, center0)));
+            _mm256_storeu_ps(gy + i, _mm256_mul_ps(half, diff));
+        }
+    }
+#endif
+    for (; i < n; ++i) sample_one(i);
+}
+
+/**
+ * bilinear samples of the (2*half+1)^2 patch around (x, y) of a CV_8UC1
+ * image, row major; the samples share the sub-pixel offset, so inside the
+ * image the weights are fixed point and computed once per patch
+ * @param values  [out] patch samples
+ * @param gx, gy  [out] patch gradients, nullptr to skip the gradients
+ */
+inline void SampleBilinearPatch(const cv::Mat &img, float x, float y,
+                                int half, float *values, float *gx = nullptr,
+                                float *gy = nullptr,
+                                BorderPolicy border = BorderPolicy::CLAMP) {
+    const int size = 2 * half + 1;
+    const bool gradients = gx != nullptr || gy != nullptr;
+    const int margin = gradients ? 1 : 0;
+    const float x0 = std::floor(internal::ClampCoordinate(x, img.cols));
+    const float y0 = std::floor(internal::ClampCoordinate(y, img.rows));
+    const int ix = int(x0) - half, iy = int(y0) - half;  // top left pixel
+    if (ix - margin < 0 || iy - margin < 0 ||
+        ix + size + margin >= img.cols || iy + size + margin >= img.rows) {
+        // at the border, one sample at a time
+        for (int r = 0; r < size; ++r) {
+            for (int c = 0; c < size; ++c) {
+                const int i = r * size + c;
+                const float u = x - half + c, v = y - half + r;
+                if (!gradients) {
+                    values[i] = SampleBilinear<uchar>(img, u, v, border);
+                    continue;
+                }
+                float dx, dy;
+                values[i] = SampleBilinear<uchar>(img, u, v, dx, dy, border);
+                if (gx) gx[i] = dx;
+                if (gy) gy[i] = dy;
+            }
+        }
+        return;
+    }
+
+    const BilinearWeights w(x - x0, y - y0);
+    const float scale = 1.0f / (1 << kBilinearWeightBits);
+    const size_t step = img.step;
+    // samples of a block of rows x cols with its top left at pixel (u, v)
+    auto sample_block = [&](int u, int v, int rows, int cols, float *out) {
+        for (int r = 0; r < rows; ++r) {
+            const uchar *p0 = img.ptr<uchar>(v + r) + u, *p1 = p0 + step;
+            for (int c = 0; c < cols; ++c) {
+                const int sum = w.w00 * p0[c] + w.w01 * p0[c + 1] +
+                                w.w10 * p1[c] + w.w11 * p1[c + 1];
+                out[r * cols + c] = float(sum) * scale;
+            }
+        }
+    };
+    if (!gradients) {
+        sample_block(ix, iy, size, size, values);
+        return;
+    }
+
+    // the patch grown by one sample on each side, gradients are the central
+    // differences of its samples
+    const int grown = size + 2;
+    float stack_buffer[256];
+    std::vector<float> heap_buffer;
+    float *samples = stack_buffer;
+    if (grown * grown > 256) {
+        heap_buffer.resize(grown * grown);
+        samples = heap_buffer.data();
+    }
+    sample_block(ix - 1, iy - 1, grown, grown, samples);
+    for (int r = 0; r < size; ++r) {
+        const float *s = samples + (r + 1) * grown + 1;
+        for (int c = 0; c < size; ++c) {
+            const int i = r * size + c;
+            values[i] = s[c];
+            if (gx) gx[i] = 0.5f * (s[c + 1] - s[c - 1]);
+            if (gy) gy[i] = 0.5f * (s[c + grown] - s[c - grown]);
+        }
+    }
+}
+
+}  // namespace myslam
+
+#endif  // MYSLAM_BILINEAR_H
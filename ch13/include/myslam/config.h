@@ -9,25 +9,37 @@ namespace myslam {
 /**
  * 配置类，使用SetParameterFile确定配置文件
  * 然后用Get得到对应值
- * 单例模式
+ * 每个VisualOdometry实例持有自己的Config，多个实例可在同一进程中并行运行
  */
 class Config {
-   private:
-    static std::shared_ptr<Config> config_;
-    cv::FileStorage file_;
-
-    Config() {}  // private constructor makes a singleton
    public:
+    typedef std::shared_ptr<Config> Ptr;
+
+    Config() {}
     ~Config();  // close the file when deconstructing
 
     // set a new config file
-    static bool SetParameterFile(const std::string &filename);
+    bool SetParameterFile(const std::string &filename);
 
     // access the parameter values
     template <typename T>
-    static T Get(const std::string &key) {
-        return T(Config::config_->file_[key]);
+    T Get(const std::string &key) const {
+        return T(file_[key]);
     }
+
+    // access the parameter values, return default_value if key is missing
+    template <typename T>
+    T Get(const std::string &key, const T &default_value) const {
+        cv::FileNode node = file_[key];
+        if (node.empty()) return default_value;
+        return T(node);
+    }
+
+    // the raw node of a key, for values of more than one type
+    cv::FileNode Node(const std::string &key) const { return file_[key]; }
+
+   private:
+    cv::FileStorage file_;
 };
 }  // namespace myslam
 
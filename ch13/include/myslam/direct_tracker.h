@@ -0,0 +1,81 @@
+#pragma once
+#ifndef MYSLAM_DIRECT_TRACKER_H
+#define MYSLAM_DIRECT_TRACKER_H
+
+#include "myslam/camera.h"
+#include "myslam/common_include.h"
+#include "myslam/image_pyramid.h"
+#include "myslam/normal_equations.h"
+#include "myslam/tracker.h"
+
+namespace myslam {
+
+/**
+ * 稀疏直接法跟踪器
+ * 参考点为上一关键帧中关联了地图点的左图特征，深度来自地图点；
+ * 当前帧相对关键帧的位姿和仿射亮度 I_cur = exp(a) * I_kf + b 一起估计：
+ * - 由粗到细的图像金字塔，每层 (2*half_patch+1)^2 的图块
+ * - Huber加权的光度误差，Levenberg-Marquardt，拒绝的步长不重新线性化
+ * - 法方程由NormalEquationsReducer并行累加，结果与线程数无关
+ * 光度误差（图块RMS）小于max_error的点为内点
+ * 关键帧通常是刚跟踪过的帧，此时直接复用其金字塔
+ */
+class DirectTracker : public Tracker {
+   public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
+    typedef std::shared_ptr<DirectTracker> Ptr;
+
+    struct Options {
+        int levels = 4;            // 金字塔层数，每层缩小一半
+        int iterations = 10;       // 每层LM迭代次数
+        int half_patch = 1;        // 图块半径，不超过4时图块在栈上
+        double huber_delta = 9;    // Huber阈值（灰度）
+        double max_error = 20;     // 内点的图块RMS光度误差上限（灰度）
+    };
+
+    explicit DirectTracker(Camera::Ptr camera)
+        : DirectTracker(camera, Options()) {}
+
+    DirectTracker(Camera::Ptr camera, const Options &options);
+
+    void SetKeyframe(Frame::Ptr keyframe) override;
+
+    int Track(Frame::Ptr current) override;
+
+    /// affine brightness of the last tracked frame relative to the keyframe
+    double BrightnessA() const { return a_; }
+
+    double BrightnessB() const { return b_; }
+
+   private:
+    typedef NormalEquations<8> Equations;
+
+    /**
+     * accumulate the normal equations of points [begin, end) on a level
+     * @param T21  pose of the current camera relative to the keyframe camera
+     */
+    void Accumulate(int level, const SE3 &T21, double a, double b, int begin,
+                    int end, Equations &equations) const;
+
+    /**
+     * LM on one level, updates T21, a and b
+     * @return num of inliers of the estimate
+     */
+    int AlignLevel(int level, SE3 &T21, double &a, double &b);
+
+    Camera::Ptr camera_;
+    Options options_;
+
+    Frame::Ptr keyframe_ = nullptr;
+    std::weak_ptr<Frame> tracked_frame_;  // frame of current_pyramid_
+    ImagePyramid keyframe_pyramid_, current_pyramid_;
+    std::vector<Vec2, Eigen::aligned_allocator<Vec2>> pixels_;  // level 0
+    std::vector<Vec3, Eigen::aligned_allocator<Vec3>> points_;  // 关键帧相机系
+    double a_ = 0, b_ = 0;
+
+    NormalEquationsReducer<8> reducer_{32};
+};
+
+}  // namespace myslam
+
+#endif  // MYSLAM_DIRECT_TRACKER_H
@@ -0,0 +1,87 @@
+#pragma once
+#ifndef MYSLAM_FLOW_CHECK_H
+#define MYSLAM_FLOW_CHECK_H
+
+#include <opencv2/core/core.hpp>
+#include <cmath>
+#include <vector>
+#include "myslam/bilinear.h"
+
+namespace myslam {
+
+/**
+ * 光流跟踪结果的检查，在优化之前剔除错误的跟踪
+ * - 前后向一致性：从跟踪结果反向跟踪回第一幅图像，回到的位置与起点的距离
+ *   不能超过max_fb_error
+ * - NCC：起点和跟踪结果处图块的零均值归一化互相关不能低于min_ncc，
+ *   对亮度的仿射变化不敏感，同时作为每个跟踪的质量分数
+ * 两项检查都只读图像，可在跟踪的并行循环中对每个点调用Check
+ */
+struct FlowCheck {
+    bool forward_backward = false;  // 反向跟踪并检查一致性
+    double max_fb_error = 1.0;      // 前后向误差上限（像素）
+    double min_ncc = -1;            // NCC下限，-1不检查
+    int half_patch = 3;             // NCC图块为 (2*half_patch+1)^2
+
+    bool Enabled() const { return forward_backward || min_ncc > -1; }
+
+    /**
+     * check one track
+     * @param img1    first image, CV_8UC1
+     * @param img2    second image, CV_8UC1
+     * @param pt1     point in img1
+     * @param pt2     tracked point in img2
+     * @param pt_back pt2 tracked back into img1, unused without
+     *                forward_backward
+     * @param ncc     [out] NCC score of the track, 1 if it is not computed
+     * @return true if the track passes
+     */
+    bool Check(const cv::Mat &img1, const cv::Mat &img2,
+               const cv::Point2f &pt1, const cv::Point2f &pt2,
+               const cv::Point2f &pt_back, float &ncc) const {
+        ncc = 1;
+        if (forward_backward) {
+            const float dx = pt_back.x - pt1.x, dy = pt_back.y - pt1.y;
+            if (dx * dx + dy * dy > max_fb_error * max_fb_error) return false;
+        }
+        if (min_ncc > -1) {
+            ncc = PatchNCC(img1, pt1, img2, pt2, half_patch);
+            if (ncc < min_ncc) return false;
+        }
+        return true;
+    }
+
+    /// zero mean NCC of the patches around pt1 and pt2, bilinear sampled
+    static float PatchNCC(const cv::Mat &img1, const cv::Point2f &pt1,
+                          const cv::Mat &img2, const cv::Point2f &pt2,
+                          int half_patch) {
+        const int n = (2 * half_patch + 1) * (2 * half_patch + 1);
+        // both patches on the stack up to half_patch 7
+        float stack_buffer[2 * 15 * 15];
+        std::vector<float> heap_buffer;
+        float *patches = stack_buffer;
+        if (2 * n > 2 * 15 * 15) {
+            heap_buffer.resize(2 * n);
+            patches = heap_buffer.data();
+        }
+        SampleBilinearPatch(img1, pt1.x, pt1.y, half_patch, patches);
+        SampleBilinearPatch(img2, pt2.x, pt2.y, half_patch, patches + n);
+        double sum1 = 0, sum2 = 0, sum11 = 0, sum22 = 0, sum12 = 0;
+        for (int i = 0; i < n; ++i) {
+            const double v1 = patches[i], v2 = patches[n + i];
+            sum1 += v1;
+            sum2 += v2;
+            sum11 += v1 * v1;
+            sum22 += v2 * v2;
+            sum12 += v1 * v2;
+        }
+        const double var1 = sum11 - sum1 * sum1 / n;
+        const double var2 = sum22 - sum2 * sum2 / n;
+        if (var1 <= 1e-6 || var2 <= 1e-6) return 0;  // textureless patch
+        return float((sum12 - sum1 * sum2 / n) / std::sqrt(var1 * var2));
+    }
+};
+
+}  // namespace myslam
+
+#endif  // MYSLAM_FLOW_CHECK_H
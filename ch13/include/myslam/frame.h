@@ -15,6 +15,7 @@ struct Feature;
 /**
  * 帧
  * 每一帧分配独立id，关键帧分配关键帧ID
+ * id由调用方（数据集/地图）分配，不使用全局计数器
  */
 struct Frame {
    public:
@@ -51,11 +52,11 @@ struct Frame {
         pose_ = pose;
     }
 
-    /// 设置关键帧并分配并键帧id
-    void SetKeyFrame();
+    /// 设置关键帧并分配关键帧id
+    void SetKeyFrame(unsigned long keyframe_id);
 
-    /// 工厂构建模式，分配id 
-    static std::shared_ptr<Frame> CreateFrame();
+    /// 工厂构建模式，分配id
+    static std::shared_ptr<Frame> CreateFrame(unsigned long id);
 };
 
 }  // namespace myslam
@@ -5,8 +5,13 @@
 #include <opencv2/features2d.hpp>
 
 #include "myslam/common_include.h"
+#include "myslam/config.h"
+#include "myslam/flow_check.h"
 #include "myslam/frame.h"
 #include "myslam/map.h"
+#include "myslam/stereo_matcher.h"
+#include "myslam/thread_runtime.h"
+#include "myslam/tracker.h"
 
 namespace myslam {
 
@@ -24,7 +29,8 @@ class Frontend {
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
     typedef std::shared_ptr<Frontend> Ptr;
 
-    Frontend();
+    /// 构造时从配置中读取参数
+    Frontend(Config::Ptr config);
 
     /// 外部接口，添加一个帧并计算其定位结果
     bool AddFrame(Frame::Ptr frame);
@@ -36,6 +42,12 @@ class Frontend {
 
     void SetViewer(std::shared_ptr<Viewer> viewer) { viewer_ = viewer; }
 
+    /// 可并行阶段使用的线程池，为空时在前端线程中串行执行
+    void SetThreadPool(ThreadPool::Ptr pool) { thread_pool_ = pool; }
+
+    /// 普通帧的位姿跟踪器，为空时使用LK特征跟踪和pose-only BA
+    void SetTracker(Tracker::Ptr tracker) { tracker_ = tracker; }
+
     FrontendStatus GetStatus() const { return status_; }
 
     void SetCameras(Camera::Ptr left, Camera::Ptr right) {
@@ -57,10 +69,11 @@ class Frontend {
     bool Reset();
 
     /**
-     * Track with last frame
+     * Track the features of a reference frame into current_frame_ with LK,
+     * the last frame, or the last keyframe if a tracker_ is set
      * @return num of tracked points
      */
-    int TrackLastFrame();
+    int TrackFeatures(Frame::Ptr reference);
 
     /**
      * estimate current frame's pose
@@ -89,10 +102,35 @@ class Frontend {
 
     /**
      * Find the corresponding features in right image of current_frame_
+     * Left features that already have an entry in features_right_ are skipped
      * @return num of features found
      */
     int FindFeaturesInRight();
 
+    /**
+     * Find the corresponding features in right image by searching along the
+     * same row, valid for rectified stereo images only
+     * @return num of features found
+     */
+    int FindFeaturesInRightByRow();
+
+    /**
+     * Check LK tracks with flow_check_, failed tracks get a zero status
+     * The backward LK runs on the tracked points only, the checks run in one
+     * parallel pass over the tracks
+     * @param img1    first image of the tracks
+     * @param img2    second image
+     * @param pts1    points in img1
+     * @param pts2    tracked points in img2
+     * @param status  [in|out] status of calcOpticalFlowPyrLK
+     * @param scores  [out] NCC score of every track, 1 if not computed
+     * @return num of tracks culled
+     */
+    int CheckFlow(const cv::Mat &img1, const cv::Mat &img2,
+                  const std::vector<cv::Point2f> &pts1,
+                  const std::vector<cv::Point2f> &pts2,
+                  std::vector<uchar> &status, std::vector<float> &scores);
+
     /**
      * Build the initial map with single image
      * @return true if succeed
@@ -105,6 +143,16 @@ class Frontend {
      */
     int TriangulateNewPoints();
 
+    /**
+     * Re-initialize the pose with RANSAC P3P if the motion model prior has
+     * too few inliers
+     * @param features  features with map points, is_outlier_ is set if the
+     *                  pose was replaced
+     * @return true if the pose was replaced
+     */
+    bool PnPRansacFallback(
+        const std::vector<std::shared_ptr<Feature>> &features, double chi2_th);
+
     /**
      * Set the features in keyframe as new observation of the map points
      */
@@ -115,12 +163,15 @@ class Frontend {
 
     Frame::Ptr current_frame_ = nullptr;  // 当前帧
     Frame::Ptr last_frame_ = nullptr;     // 上一帧
+    Frame::Ptr last_keyframe_ = nullptr;  // 上一关键帧
     Camera::Ptr camera_left_ = nullptr;   // 左侧相机
     Camera::Ptr camera_right_ = nullptr;  // 右侧相机
 
     Map::Ptr map_ = nullptr;
     std::shared_ptr<Backend> backend_ = nullptr;
     std::shared_ptr<Viewer> viewer_ = nullptr;
+    ThreadPool::Ptr thread_pool_ = nullptr;
+    Tracker::Ptr tracker_ = nullptr;
 
     SE3 relative_motion_;  // 当前帧与上一帧的相对运动，用于估计当前帧pose初值
 
@@ -132,9 +183,15 @@ class Frontend {
     int num_features_tracking_ = 50;
     int num_features_tracking_bad_ = 20;
     int num_features_needed_for_keyframe_ = 80;
+    bool stereo_use_lk_ = false;  // use LK flow instead of row matching
+    bool stereo_tracking_ = false;  // right image observations in tracking
+    double pnp_ransac_min_inlier_ratio_ = 0.5;  // below it, run RANSAC PnP
+    int pnp_ransac_max_iterations_ = 200;
+    FlowCheck flow_check_;  // checks of the LK tracks, disabled by default
 
     // utilities
     cv::Ptr<cv::GFTTDetector> gftt_;  // feature detector in opencv
+    StereoMatcher::Ptr stereo_matcher_ = nullptr;  // rectified row matcher
 };
 
 }  // namespace myslam
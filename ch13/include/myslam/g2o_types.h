@@ -100,6 +100,57 @@ class EdgeProjectionPoseOnly : public g2o::BaseUnaryEdge<2, Vec2, VertexPose> {
     Mat33 _K;
 };
 
+/// 仅估计位姿的双目一元边，观测为 (u_l, v_l, u_r)
+class EdgeStereoProjectionPoseOnly
+    : public g2o::BaseUnaryEdge<3, Vec3, VertexPose> {
+   public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
+
+    /// 校正后的双目，右目与左目只差x方向的基线
+    EdgeStereoProjectionPoseOnly(const Vec3 &pos, const Mat33 &K,
+                                 double baseline)
+        : _pos3d(pos), _K(K), _baseline(baseline) {}
+
+    virtual void computeError() override {
+        const VertexPose *v = static_cast<VertexPose *>(_vertices[0]);
+        SE3 T = v->estimate();
+        Vec3 pos_cam = T * _pos3d;
+        double Zinv = 1.0 / pos_cam[2];
+        double u = _K(0, 0) * pos_cam[0] * Zinv + _K(0, 2);
+        double v_l = _K(1, 1) * pos_cam[1] * Zinv + _K(1, 2);
+        double u_r = u - _K(0, 0) * _baseline * Zinv;
+        _error = _measurement - Vec3(u, v_l, u_r);
+    }
+
+    virtual void linearizeOplus() override {
+        const VertexPose *v = static_cast<VertexPose *>(_vertices[0]);
+        SE3 T = v->estimate();
+        Vec3 pos_cam = T * _pos3d;
+        double fx = _K(0, 0);
+        double fy = _K(1, 1);
+        double X = pos_cam[0];
+        double Y = pos_cam[1];
+        double Z = pos_cam[2];
+        double Xr = X - _baseline;  // x in the right camera
+        double Zinv = 1.0 / (Z + 1e-18);
+        double Zinv2 = Zinv * Zinv;
+        _jacobianOplusXi << -fx * Zinv, 0, fx * X * Zinv2, fx * X * Y * Zinv2,
+            -fx - fx * X * X * Zinv2, fx * Y * Zinv, 0, -fy * Zinv,
+            fy * Y * Zinv2, fy + fy * Y * Y * Zinv2, -fy * X * Y * Zinv2,
+            -fy * X * Zinv, -fx * Zinv, 0, fx * Xr * Zinv2,
+            fx * Xr * Y * Zinv2, -fx - fx * Xr * X * Zinv2, fx * Y * Zinv;
+    }
+
+    virtual bool read(std::istream &in) override { return true; }
+
+    virtual bool write(std::ostream &out) const override { return true; }
+
+   private:
+    Vec3 _pos3d;
+    Mat33 _K;
+    double _baseline;
+};
+
 /// 带有地图和位姿的二元边
 class EdgeProjection
     : public g2o::BaseBinaryEdge<2, Vec2, VertexPose, VertexXYZ> {
@@ -0,0 +1,96 @@
+#pragma once
+#ifndef MYSLAM_IMAGE_PYRAMID_H
+#define MYSLAM_IMAGE_PYRAMID_H
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+namespace myslam {
+
+/**
+ * Image pyramid of an 8 bit gray image, with optional gradients per level
+ * - level i is scale^i the size of level 0, downsampled with cv::resize
+ * - optional Gaussian blur of each level before it is downsampled
+ * - optional Sobel gradients of every level (CV_32F, scaled by 1/8 to
+ *   intensity per pixel)
+ * Build reuses the buffers of the previous build, so a pyramid object can be
+ * rebuilt for every new frame without allocations; the pyramid of a reference
+ * frame is built once and shared by all the frames tracked against it.
+ */
+class ImagePyramid {
+   public:
+    struct Options {
+        int levels = 4;
+        double scale = 0.5;      // size of a level relative to the previous one
+        double sigma = 0;        // blur before downsampling, 0 to disable
+        bool gradients = false;  // compute the Sobel gradients of every level
+    };
+
+    typedef std::shared_ptr<ImagePyramid> Ptr;
+
+    ImagePyramid() : ImagePyramid(Options()) {}
+
+    explicit ImagePyramid(const Options &options) : options_(options) {}
+
+    /// build the pyramid of an image, level 0 is a copy of img
+    void Build(const cv::Mat &img) {
+        const int levels = std::max(1, options_.levels);
+        images_.resize(levels);
+        scales_.resize(levels);
+        img.copyTo(images_[0]);
+        scales_[0] = 1.0;
+        for (int i = 1; i < levels; i++) {
+            const cv::Mat &prev = images_[i - 1];
+            const cv::Mat *src = &prev;
+            if (options_.sigma > 0) {
+                cv::GaussianBlur(prev, blurred_, cv::Size(), options_.sigma);
+                src = &blurred_;
+            }
+            cv::resize(*src, images_[i],
+                       cv::Size(prev.cols * options_.scale,
+                                prev.rows * options_.scale));
+            scales_[i] = scales_[i - 1] * options_.scale;
+        }
+
+        if (options_.gradients) {
+            grad_x_.resize(levels);
+            grad_y_.resize(levels);
+            for (int i = 0; i < levels; i++) {
+                cv::Sobel(images_[i], grad_x_[i], CV_32F, 1, 0, 3, 1.0 / 8);
+                cv::Sobel(images_[i], grad_y_[i], CV_32F, 0, 1, 3, 1.0 / 8);
+            }
+        } else {
+            grad_x_.assign(levels, cv::Mat());
+            grad_y_.assign(levels, cv::Mat());
+        }
+    }
+
+    bool Empty() const { return images_.empty(); }
+
+    int Levels() const { return int(images_.size()); }
+
+    /// size of a level relative to level 0
+    double Scale(int level) const { return scales_[level]; }
+
+    const cv::Mat &Image(int level) const { return images_[level]; }
+
+    /// Sobel gradients, empty unless Options::gradients
+    const cv::Mat &GradX(int level) const { return grad_x_[level]; }
+
+    const cv::Mat &GradY(int level) const { return grad_y_[level]; }
+
+    const Options &GetOptions() const { return options_; }
+
+   private:
+    Options options_;
+    std::vector<cv::Mat> images_, grad_x_, grad_y_;
+    std::vector<double> scales_;
+    cv::Mat blurred_;  // scratch buffer of the Gaussian blur
+};
+
+}  // namespace myslam
+
+#endif  // MYSLAM_IMAGE_PYRAMID_H
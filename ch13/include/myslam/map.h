@@ -52,6 +52,12 @@ class Map {
     /// 清理map中观测数量为零的点
     void CleanMap();
 
+    /// 分配新的关键帧id，计数器属于地图实例
+    unsigned long NextKeyFrameId() { return keyframe_factory_id_++; }
+
+    /// 分配新的地图点id，计数器属于地图实例
+    unsigned long NextMapPointId() { return mappoint_factory_id_++; }
+
    private:
     // 将旧的关键帧置为不活跃状态
     void RemoveOldKeyframe();
@@ -64,6 +70,10 @@ class Map {
 
     Frame::Ptr current_frame_ = nullptr;
 
+    // id factories
+    std::atomic<unsigned long> keyframe_factory_id_{0};
+    std::atomic<unsigned long> mappoint_factory_id_{0};
+
     // settings
     int num_active_keyframes_ = 7;  // 激活的关键帧数量
 };
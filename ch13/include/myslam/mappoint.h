@@ -52,8 +52,8 @@ struct MapPoint {
         return observations_;
     }
 
-    // factory function
-    static MapPoint::Ptr CreateNewMappoint();
+    // factory function, id is allocated by the owning map
+    static MapPoint::Ptr CreateNewMappoint(unsigned long id);
 };
 }  // namespace myslam
 
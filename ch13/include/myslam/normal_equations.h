@@ -0,0 +1,108 @@
+#pragma once
+#ifndef MYSLAM_NORMAL_EQUATIONS_H
+#define MYSLAM_NORMAL_EQUATIONS_H
+
+#include <Eigen/Core>
+#include <Eigen/StdVector>
+#include <opencv2/core/core.hpp>
+#include <algorithm>
+#include <vector>
+
+namespace myslam {
+
+/**
+ * Gauss-Newton normal equations H dx = b of N parameters, with the exact
+ * cost and counters. Only the lower triangle of H is accumulated, call
+ * Symmetrize() (done by NormalEquationsReducer) before solving.
+ */
+template <int N>
+struct NormalEquations {
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
+    typedef Eigen::Matrix<double, N, N> MatrixN;
+    typedef Eigen::Matrix<double, N, 1> VectorN;
+
+    MatrixN H = MatrixN::Zero();
+    VectorN b = VectorN::Zero();
+    double cost = 0;        // sum of the weighted squared errors
+    int num_residuals = 0;  // residuals added
+    int num_inliers = 0;    // counted by the caller, e.g. points in view
+
+    /// add a residual with jacobian J and error e: H += w J J^T, b -= w e J
+    void Add(const VectorN &J, double error, double weight = 1) {
+        H.template selfadjointView<Eigen::Lower>().rankUpdate(J, weight);
+        b.noalias() -= (weight * error) * J;
+        cost += weight * error * error;
+        ++num_residuals;
+    }
+
+    NormalEquations &operator+=(const NormalEquations &other) {
+        H += other.H;
+        b += other.b;
+        cost += other.cost;
+        num_residuals += other.num_residuals;
+        num_inliers += other.num_inliers;
+        return *this;
+    }
+
+    /// copy the lower triangle of H to the upper one
+    void Symmetrize() {
+        H.template triangularView<Eigen::StrictlyUpper>() = H.transpose();
+    }
+};
+
+/**
+ * 确定性的并行归约：结果与线程数和cv::parallel_for_的分块方式无关
+ * - [begin, end) 按固定的block_size分块，分块与线程数无关
+ * - 每个分块写入自己的对齐累加器，不需要加锁
+ * - 累加器按固定顺序两两合并（树形归约），浮点加法的顺序总是相同的
+ * 累加器在多次Reduce之间复用，可直接用于每次迭代都要线性化的高斯牛顿循环
+ */
+template <int N>
+class NormalEquationsReducer {
+   public:
+    explicit NormalEquationsReducer(int block_size = 64)
+        : block_size_(std::max(1, block_size)), blocks_(1) {}
+
+    /**
+     * 并行累加[begin, end)
+     * @param accumulate  accumulate(block_begin, block_end, equations)，
+     *                    只能写入传入的equations
+     * @return 归约后的法方程，H已对称化，下次Reduce前有效
+     */
+    template <typename Func>
+    const NormalEquations<N> &Reduce(int begin, int end, Func accumulate) {
+        const int n = std::max(0, end - begin);
+        const int num_blocks = (n + block_size_ - 1) / block_size_;
+        blocks_.assign(std::max(1, num_blocks), NormalEquations<N>());
+        cv::parallel_for_(cv::Range(0, num_blocks), [&](const cv::Range &r) {
+            for (int i = r.start; i < r.end; ++i) {
+                const int first = begin + i * block_size_;
+                accumulate(first, std::min(end, first + block_size_),
+                           blocks_[i]);
+            }
+        });
+        // pairwise, fixed order
+        for (int stride = 1; stride < num_blocks; stride *= 2) {
+            for (int i = 0; i + stride < num_blocks; i += 2 * stride) {
+                blocks_[i] += blocks_[i + stride];
+            }
+        }
+        blocks_[0].Symmetrize();
+        return blocks_[0];
+    }
+
+    /// 最近一次Reduce的结果
+    const NormalEquations<N> &Result() const { return blocks_[0]; }
+
+    int BlockSize() const { return block_size_; }
+
+   private:
+    int block_size_;
+    std::vector<NormalEquations<N>,
+                Eigen::aligned_allocator<NormalEquations<N>>>
+        blocks_;
+};
+
+}  // namespace myslam
+
+#endif  // MYSLAM_NORMAL_EQUATIONS_H
@@ -0,0 +1,80 @@
+#pragma once
+#ifndef MYSLAM_PNP_RANSAC_H
+#define MYSLAM_PNP_RANSAC_H
+
+#include <random>
+
+#include "myslam/common_include.h"
+
+namespace myslam {
+
+typedef std::vector<Vec2, Eigen::aligned_allocator<Vec2>> VecVec2;
+
+/**
+ * P3P minimal solver (Grunert), points are given in world frame and as unit
+ * bearing vectors in camera frame
+ * @param points_world  3 world points
+ * @param bearings      3 unit bearing vectors
+ * @param poses         up to 4 solutions, as Tcw
+ * @return number of solutions
+ */
+int SolveP3P(const Vec3 points_world[3], const Vec3 bearings[3],
+             std::vector<SE3> &poses);
+
+/**
+ * RANSAC PnP with P3P hypotheses
+ * 对所有3D-2D对的假设打分使用SIMD（AVX/SSE）并行计算重投影误差
+ * 迭代次数根据当前最优内点率自适应减少
+ */
+class PnPRansac {
+   public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
+
+    /**
+     * @param K                  intrinsics
+     * @param inlier_threshold   squared reprojection error threshold (pixel^2)
+     * @param max_iterations     upper bound of RANSAC iterations
+     * @param confidence         probability of drawing one all-inlier sample
+     */
+    PnPRansac(const Mat33 &K, double inlier_threshold = 5.991,
+              int max_iterations = 200, double confidence = 0.99);
+
+    /// set the correspondences, points_world[i] is observed at pixels[i]
+    void SetCorrespondences(const std::vector<Vec3> &points_world,
+                            const VecVec2 &pixels);
+
+    /// count the inliers of a pose Tcw
+    int CountInliers(const SE3 &Tcw) const;
+
+    /**
+     * run RANSAC
+     * @param Tcw       best pose if succeed
+     * @param inliers   inlier flags of the best pose
+     * @return num of inliers of the best pose, 0 if failed
+     */
+    int Estimate(SE3 &Tcw, std::vector<bool> &inliers);
+
+    /// iterations used by the last Estimate
+    int LastIterations() const { return last_iterations_; }
+
+   private:
+    /// score a pose, optionally write inlier flags
+    int Score(const SE3 &Tcw, std::vector<bool> *inliers) const;
+
+    double fx_, fy_, cx_, cy_;
+    double inlier_threshold_;
+    int max_iterations_;
+    double confidence_;
+    int last_iterations_ = 0;
+    std::mt19937 rng_{0};  // fixed seed, results are repeatable
+
+    // SoA buffers, padded to a multiple of 8 for the SIMD scorer
+    size_t num_points_ = 0;
+    std::vector<float> x_, y_, z_, u_, v_;
+    std::vector<Vec3> points_world_;
+    std::vector<Vec3> bearings_;
+};
+
+}  // namespace myslam
+
+#endif  // MYSLAM_PNP_RANSAC_H
@@ -0,0 +1,61 @@
+#pragma once
+#ifndef MYSLAM_STEREO_MATCHER_H
+#define MYSLAM_STEREO_MATCHER_H
+
+#include "myslam/common_include.h"
+
+namespace myslam {
+
+/**
+ * 校正后双目图像的行匹配
+ * 匹配点位于同一行，在视差范围内做一维SAD搜索，再用抛物线拟合得到亚像素视差
+ * 匹配窗口宽16像素，高 2*half_patch_height+1 像素，SAD由SSE2计算，CPU支持时使用AVX2
+ */
+class StereoMatcher {
+   public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
+    typedef std::shared_ptr<StereoMatcher> Ptr;
+
+    static const int kPatchWidth = 16;
+
+    /**
+     * @param max_disparity     最大视差（像素），搜索范围为 [0, max_disparity]
+     * @param half_patch_height 匹配窗口半高
+     * @param max_mean_sad      窗口内每个像素的平均SAD上限，超过则认为匹配失败
+     * @param uniqueness_ratio  最优代价需小于次优代价乘以该系数
+     */
+    StereoMatcher(int max_disparity = 64, int half_patch_height = 4,
+                  float max_mean_sad = 16, float uniqueness_ratio = 0.9);
+
+    /**
+     * match one pixel of the left image along the same row of the right image
+     * @param left          left image, CV_8UC1
+     * @param right         right image, CV_8UC1
+     * @param pt_left       pixel in left image
+     * @param pt_right      matched pixel in right image (sub-pixel)
+     * @param min_disparity search range, clipped to [0, max_disparity]
+     * @param max_disparity search range, clipped to [0, max_disparity]
+     * @return true if a unique match is found
+     */
+    bool Match(const cv::Mat &left, const cv::Mat &right,
+               const cv::Point2f &pt_left, cv::Point2f &pt_right,
+               int min_disparity, int max_disparity) const;
+
+    /// match with the full disparity range
+    bool Match(const cv::Mat &left, const cv::Mat &right,
+               const cv::Point2f &pt_left, cv::Point2f &pt_right) const {
+        return Match(left, right, pt_left, pt_right, 0, max_disparity_);
+    }
+
+    int MaxDisparity() const { return max_disparity_; }
+
+   private:
+    int max_disparity_;
+    int half_patch_height_;
+    float max_mean_sad_;
+    float uniqueness_ratio_;
+};
+
+}  // namespace myslam
+
+#endif  // MYSLAM_STEREO_MATCHER_H
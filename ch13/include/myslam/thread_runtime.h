@@ -0,0 +1,83 @@
+#pragma once
+#ifndef MYSLAM_THREAD_RUNTIME_H
+#define MYSLAM_THREAD_RUNTIME_H
+
+#include <deque>
+#include <functional>
+#include <future>
+
+#include "myslam/common_include.h"
+#include "myslam/config.h"
+
+namespace myslam {
+
+/**
+ * 线程属性：名称、CPU亲和性和调度优先级
+ * 未设置的项保持系统默认
+ */
+struct ThreadOptions {
+    std::string name;           // 线程名，最多显示15个字符
+    std::vector<int> cpus;      // 允许运行的CPU，空表示不绑定
+    int nice = 0;               // nice值，负值需要CAP_SYS_NICE权限
+    int realtime_priority = 0;  // >0 时使用SCHED_FIFO实时调度
+
+    ThreadOptions() {}
+    explicit ThreadOptions(const std::string &thread_name)
+        : name(thread_name) {}
+
+    /**
+     * 从配置读取 thread.<name>.cpus（如"2,3"）、thread.<name>.nice
+     * 和 thread.<name>.realtime_priority，缺省项不修改
+     * 无法解析的CPU编号跳过并记录日志
+     */
+    static ThreadOptions FromConfig(const Config &config,
+                                    const std::string &name);
+};
+
+/// 对当前线程应用线程属性，失败项会记录日志但不影响线程运行
+bool ApplyThreadOptions(const ThreadOptions &options);
+
+/// 启动一个线程，在执行func之前应用线程属性
+std::thread StartThread(const ThreadOptions &options,
+                        std::function<void()> func);
+
+/**
+ * 固定大小的工作线程池
+ * 前端的可并行阶段和批量运行共享同一个线程池
+ */
+class ThreadPool {
+   public:
+    typedef std::shared_ptr<ThreadPool> Ptr;
+
+    /// 启动num_threads个工作线程，线程名为 <options.name>-<index>
+    ThreadPool(int num_threads,
+               const ThreadOptions &options = ThreadOptions("pool"));
+
+    /// 等待队列中的任务完成后退出
+    ~ThreadPool();
+
+    /// 提交一个任务
+    std::future<void> Submit(std::function<void()> task);
+
+    /**
+     * 将[begin, end)分块并行执行func(range_begin, range_end)，调用线程也参与计算
+     * 阻塞直到全部完成。不能在池内线程中调用
+     */
+    void ParallelFor(int begin, int end,
+                     const std::function<void(int, int)> &func);
+
+    int NumThreads() const { return int(workers_.size()); }
+
+   private:
+    void WorkerLoop();
+
+    std::vector<std::thread> workers_;
+    std::deque<std::packaged_task<void()>> tasks_;
+    std::mutex tasks_mutex_;
+    std::condition_variable tasks_update_;
+    bool stopping_ = false;
+};
+
+}  // namespace myslam
+
+#endif  // MYSLAM_THREAD_RUNTIME_H
@@ -0,0 +1,39 @@
+#pragma once
+#ifndef MYSLAM_TRACKER_H
+#define MYSLAM_TRACKER_H
+
+#include "myslam/common_include.h"
+#include "myslam/frame.h"
+
+namespace myslam {
+
+/**
+ * 前端可替换的位姿跟踪器
+ * 前端设置了跟踪器时，普通帧只调用Track估计位姿，不做特征跟踪；
+ * 只有插入关键帧时才用LK跟踪上一关键帧的特征，建立新关键帧的观测
+ */
+class Tracker {
+   public:
+    typedef std::shared_ptr<Tracker> Ptr;
+
+    virtual ~Tracker() {}
+
+    /**
+     * set the reference keyframe, called after its map points are created
+     * @param keyframe  keyframe whose left features are associated with
+     *                  map points
+     */
+    virtual void SetKeyframe(Frame::Ptr keyframe) = 0;
+
+    /**
+     * estimate the pose of a frame against the reference keyframe
+     * @param current  frame with the left image, its pose is the initial
+     *                 guess and is replaced by the estimate
+     * @return num of inliers, comparable to the num of tracked features
+     */
+    virtual int Track(Frame::Ptr current) = 0;
+};
+
+}  // namespace myslam
+
+#endif  // MYSLAM_TRACKER_H
@@ -11,6 +11,7 @@
 #include "myslam/common_include.h"
 #include "myslam/frame.h"
 #include "myslam/map.h"
+#include "myslam/thread_runtime.h"
 
 namespace myslam {
 
@@ -22,7 +23,7 @@ class Viewer {
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
     typedef std::shared_ptr<Viewer> Ptr;
 
-    Viewer();
+    Viewer(const ThreadOptions &options = ThreadOptions("viewer"));
 
     void SetMap(Map::Ptr map) { map_ = map; }
 
@@ -4,22 +4,40 @@
 
 #include "myslam/backend.h"
 #include "myslam/common_include.h"
+#include "myslam/config.h"
 #include "myslam/dataset.h"
 #include "myslam/frontend.h"
+#include "myslam/thread_runtime.h"
 #include "myslam/viewer.h"
 
 namespace myslam {
 
 /**
  * VO 对外接口
+ * 所有状态（配置、地图、id计数器）都属于实例本身，可在同一进程中运行多个VO
  */
 class VisualOdometry {
    public:
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
     typedef std::shared_ptr<VisualOdometry> Ptr;
+    typedef std::vector<SE3, Eigen::aligned_allocator<SE3>> TrajectoryType;
 
     /// constructor with config file
-    VisualOdometry(std::string &config_path);
+    VisualOdometry(const std::string &config_path);
+
+    /// 覆盖配置文件中的dataset_dir，需在Init之前调用
+    void SetDatasetDir(const std::string &dataset_dir) {
+        dataset_dir_ = dataset_dir;
+    }
+
+    /// 是否启动可视化线程，需在Init之前调用
+    void SetUseViewer(bool use_viewer) { use_viewer_ = use_viewer; }
+
+    /// Run是否对调用线程应用thread.frontend.*，调用线程不归VO所有时
+    /// （如批量运行的线程池）应关闭
+    void SetApplyFrontendThreadOptions(bool apply) {
+        apply_frontend_thread_options_ = apply;
+    }
 
     /**
      * do initialization things before run
@@ -29,6 +47,8 @@ class VisualOdometry {
 
     /**
      * start vo in the dataset
+     * the calling thread runs the frontend and takes thread.frontend.* options
+     * unless SetApplyFrontendThreadOptions(false)
      */
     void Run();
 
@@ -40,17 +60,34 @@ class VisualOdometry {
     /// 获取前端状态
     FrontendStatus GetFrontendStatus() const { return frontend_->GetStatus(); }
 
+    /// 每一帧跟踪后的位姿 Tcw，按帧顺序
+    const TrajectoryType &GetTrajectory() const { return trajectory_; }
+
+    /// 前端处理所有帧的累计耗时，单位秒
+    double GetTrackingTime() const { return tracking_time_; }
+
    private:
     bool inited_ = false;
     std::string config_file_path_;
+    std::string dataset_dir_;
+    bool use_viewer_ = true;
+    bool apply_frontend_thread_options_ = true;
+
+    Config::Ptr config_ = nullptr;
+    ThreadOptions frontend_thread_options_;
 
     Frontend::Ptr frontend_ = nullptr;
     Backend::Ptr backend_ = nullptr;
     Map::Ptr map_ = nullptr;
     Viewer::Ptr viewer_ = nullptr;
+    ThreadPool::Ptr thread_pool_ = nullptr;
 
     // dataset
     Dataset::Ptr dataset_ = nullptr;
+
+    // statistics
+    TrajectoryType trajectory_;
+    double tracking_time_ = 0;
 };
 }  // namespace myslam
 
@@ -11,9 +11,10 @@
 
 namespace myslam {
 
-Backend::Backend() {
+Backend::Backend(const ThreadOptions &options) {
     backend_running_.store(true);
-    backend_thread_ = std::thread(std::bind(&Backend::BackendLoop, this));
+    backend_thread_ =
+        StartThread(options, std::bind(&Backend::BackendLoop, this));
 }
 
 void Backend::UpdateMap() {
@@ -2,12 +2,10 @@
 
 namespace myslam {
 bool Config::SetParameterFile(const std::string &filename) {
-    if (config_ == nullptr)
-        config_ = std::shared_ptr<Config>(new Config);
-    config_->file_ = cv::FileStorage(filename.c_str(), cv::FileStorage::READ);
-    if (config_->file_.isOpened() == false) {
+    file_ = cv::FileStorage(filename.c_str(), cv::FileStorage::READ);
+    if (file_.isOpened() == false) {
         LOG(ERROR) << "parameter file " << filename << " does not exist.";
-        config_->file_.release();
+        file_.release();
         return false;
     }
     return true;
@@ -18,6 +16,4 @@ Config::~Config() {
         file_.release();
 }
 
-std::shared_ptr<Config> Config::config_ = nullptr;
-
 }
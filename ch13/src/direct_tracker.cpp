@@ -0,0 +1,195 @@
+#include "myslam/direct_tracker.h"
+
+#include "myslam/algorithm.h"
+#include "myslam/bilinear.h"
+#include "myslam/feature.h"
+#include "myslam/mappoint.h"
+
+namespace myslam {
+
+DirectTracker::DirectTracker(Camera::Ptr camera, const Options &options)
+    : camera_(camera), options_(options) {
+    ImagePyramid::Options pyramid_options;
+    pyramid_options.levels = options_.levels;
+    keyframe_pyramid_ = ImagePyramid(pyramid_options);
+    current_pyramid_ = ImagePyramid(pyramid_options);
+}
+
+void DirectTracker::SetKeyframe(Frame::Ptr keyframe) {
+    // the same keyframe with new map points keeps its pyramid, a frame just
+    // tracked hands its pyramid over
+    if (keyframe != keyframe_ || keyframe_pyramid_.Empty()) {
+        if (tracked_frame_.lock() == keyframe) {
+            std::swap(keyframe_pyramid_, current_pyramid_);
+            tracked_frame_.reset();
+        } else {
+            keyframe_pyramid_.Build(keyframe->left_img_);
+        }
+    }
+    keyframe_ = keyframe;
+
+    // reference points: pixels of the features, depth of their map points
+    pixels_.clear();
+    points_.clear();
+    SE3 T_kf_w = keyframe->Pose();
+    for (auto &feat : keyframe->features_left_) {
+        auto mp = feat->map_point_.lock();
+        if (!mp || mp->is_outlier_) continue;
+        double depth = camera_->world2camera(mp->Pos(), T_kf_w)[2];
+        if (depth <= 0) continue;
+        Vec2 px = toVec2(feat->position_.pt);
+        pixels_.push_back(px);
+        points_.push_back(camera_->pixel2camera(px, depth));
+    }
+    a_ = b_ = 0;
+    LOG(INFO) << "Direct tracker reference keyframe " << keyframe->keyframe_id_
+              << " with " << points_.size() << " points";
+}
+
+int DirectTracker::Track(Frame::Ptr current) {
+    if (!keyframe_ || points_.empty()) return 0;
+    current_pyramid_.Build(current->left_img_);
+    tracked_frame_ = current;
+
+    // relative pose of the left cameras, from the motion model guess
+    const SE3 T_kf_w = keyframe_->Pose();
+    SE3 T21 = camera_->pose() * current->Pose() * T_kf_w.inverse() *
+              camera_->pose_inv_;
+    double a = a_, b = b_;
+    int inliers = 0;
+    for (int level = current_pyramid_.Levels() - 1; level >= 0; --level) {
+        inliers = AlignLevel(level, T21, a, b);
+    }
+
+    a_ = a;
+    b_ = b;
+    current->SetPose(camera_->pose_inv_ * T21 * camera_->pose() * T_kf_w);
+    LOG(INFO) << "Direct tracking inliers: " << inliers << "/"
+              << points_.size() << ", brightness " << a << ", " << b;
+    return inliers;
+}
+
+int DirectTracker::AlignLevel(int level, SE3 &T21, double &a, double &b) {
+    typedef Equations::MatrixN Mat;
+    typedef Equations::VectorN Vec;
+    const int max_iterations = options_.iterations;
+    const double max_lambda = 1e4;
+    auto linearize = [&](const SE3 &T, double a_lin, double b_lin)
+        -> const Equations & {
+        return reducer_.Reduce(
+            0, int(points_.size()),
+            [&](int begin, int end, Equations &equations) {
+                Accumulate(level, T, a_lin, b_lin, begin, end, equations);
+            });
+    };
+    auto mean_cost = [](const Equations &equations) {
+        return equations.cost / std::max(1, equations.num_residuals);
+    };
+
+    // the result of Reduce is overwritten by the next one, keep a copy
+    const Equations &start = linearize(T21, a, b);
+    if (start.num_residuals == 0) return 0;
+    Mat H = start.H;
+    Vec g = start.b;
+    double cost = mean_cost(start);
+    int inliers = start.num_inliers;
+
+    double lambda = 1e-4;
+    for (int iter = 0; iter < max_iterations && lambda < max_lambda; ++iter) {
+        Mat H_lm = H;
+        H_lm.diagonal() *= 1 + lambda;
+        Vec update = H_lm.ldlt().solve(g);
+        if (!update.allFinite()) break;
+
+        SE3 T_new = SE3::exp(update.head<6>()) * T21;
+        double a_new = a + update[6], b_new = b + update[7];
+        const Equations &equations = linearize(T_new, a_new, b_new);
+        if (equations.num_residuals == 0 || mean_cost(equations) >= cost) {
+            // reject, a smaller step from the same linearization
+            lambda *= 10;
+            continue;
+        }
+        T21 = T_new;
+        a = a_new;
+        b = b_new;
+        H = equations.H;
+        g = equations.b;
+        cost = mean_cost(equations);
+        inliers = equations.num_inliers;
+        lambda = std::max(lambda / 10, 1e-7);
+        if (update.norm() < 1e-3) break;
+    }
+    return inliers;
+}
+
+void DirectTracker::Accumulate(int level, const SE3 &T21, double a, double b,
+                               int begin, int end,
+                               Equations &equations) const {
+    const cv::Mat &img1 = keyframe_pyramid_.Image(level);
+    const cv::Mat &img2 = current_pyramid_.Image(level);
+    // intrinsics of the level, pixel centers follow cv::resize
+    const double scale = current_pyramid_.Scale(level);
+    const double fx = camera_->fx_ * scale, fy = camera_->fy_ * scale;
+    const double cx = (camera_->cx_ + 0.5) * scale - 0.5;
+    const double cy = (camera_->cy_ + 0.5) * scale - 0.5;
+    const int half = options_.half_patch;
+    const int area = (2 * half + 1) * (2 * half + 1);
+    const double exp_a = std::exp(a);
+    const double max_error2 = options_.max_error * options_.max_error;
+    // reference patch, then current patch and its gradients, on the stack
+    // up to half_patch 4
+    const int max_stack_area = 9 * 9;
+    float stack_buffer[4 * max_stack_area];
+    std::vector<float> heap_buffer;
+    float *ref = stack_buffer;
+    if (area > max_stack_area) {
+        heap_buffer.resize(4 * area);
+        ref = heap_buffer.data();
+    }
+    float *cur = ref + area;
+    float *grad_x = cur + area, *grad_y = grad_x + area;
+
+    for (int i = begin; i < end; ++i) {
+        Vec3 pc = T21 * points_[i];
+        if (pc[2] <= 0) continue;
+        const double X = pc[0], Y = pc[1], Z_inv = 1.0 / pc[2];
+        const double Z2_inv = Z_inv * Z_inv;
+        const double u = fx * X * Z_inv + cx, v = fy * Y * Z_inv + cy;
+        // the central differences stay inside the image
+        if (u < half + 1 || v < half + 1 || u > img2.cols - half - 3 ||
+            v > img2.rows - half - 3)
+            continue;
+        const double u1 = (pixels_[i][0] + 0.5) * scale - 0.5;
+        const double v1 = (pixels_[i][1] + 0.5) * scale - 0.5;
+
+        Eigen::Matrix<double, 2, 6> J_pixel_xi;
+        J_pixel_xi << fx * Z_inv, 0, -fx * X * Z2_inv, -fx * X * Y * Z2_inv,
+            fx + fx * X * X * Z2_inv, -fx * Y * Z_inv, 0, fy * Z_inv,
+            -fy * Y * Z2_inv, -fy - fy * Y * Y * Z2_inv, fy * X * Y * Z2_inv,
+            fy * X * Z_inv;
+
+        SampleBilinearPatch(img1, u1, v1, half, ref);
+        SampleBilinearPatch(img2, u, v, half, cur, grad_x, grad_y);
+
+        double sum_error2 = 0;
+        for (int k = 0; k < area; ++k) {
+            const double error = exp_a * ref[k] + b - cur[k];
+            const Vec2 grad(grad_x[k], grad_y[k]);
+
+            // pose, then a and b
+            Vec8 J;
+            J.head<6>() = -(grad.transpose() * J_pixel_xi).transpose();
+            J[6] = exp_a * ref[k];
+            J[7] = 1;
+            const double abs_error = std::abs(error);
+            const double weight = abs_error <= options_.huber_delta
+                                      ? 1.0
+                                      : options_.huber_delta / abs_error;
+            equations.Add(J, error, weight);
+            sum_error2 += error * error;
+        }
+        if (sum_error2 < max_error2 * area) equations.num_inliers++;
+    }
+}
+
+}  // namespace myslam
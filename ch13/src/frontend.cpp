@@ -11,15 +11,28 @@
 #include "myslam/frontend.h"
 #include "myslam/g2o_types.h"
 #include "myslam/map.h"
+#include "myslam/pnp_ransac.h"
 #include "myslam/viewer.h"
 
 namespace myslam {
 
-Frontend::Frontend() {
+Frontend::Frontend(Config::Ptr config) {
     gftt_ =
-        cv::GFTTDetector::create(Config::Get<int>("num_features"), 0.01, 20);
-    num_features_init_ = Config::Get<int>("num_features_init");
-    num_features_ = Config::Get<int>("num_features");
+        cv::GFTTDetector::create(config->Get<int>("num_features"), 0.01, 20);
+    num_features_init_ = config->Get<int>("num_features_init");
+    num_features_ = config->Get<int>("num_features");
+    stereo_use_lk_ = config->Get<int>("stereo_use_lk", 0) != 0;
+    stereo_tracking_ = config->Get<int>("stereo_tracking", 0) != 0;
+    stereo_matcher_ = StereoMatcher::Ptr(
+        new StereoMatcher(config->Get<int>("stereo_max_disparity", 64)));
+    pnp_ransac_min_inlier_ratio_ =
+        config->Get<double>("pnp_ransac_min_inlier_ratio", 0.5);
+    pnp_ransac_max_iterations_ =
+        config->Get<int>("pnp_ransac_max_iterations", 200);
+    flow_check_.forward_backward =
+        config->Get<int>("lk_forward_backward", 0) != 0;
+    flow_check_.max_fb_error = config->Get<double>("lk_max_fb_error", 1.0);
+    flow_check_.min_ncc = config->Get<double>("lk_min_ncc", -1);
 }
 
 bool Frontend::AddFrame(myslam::Frame::Ptr frame) {
@@ -47,8 +60,17 @@ bool Frontend::Track() {
         current_frame_->SetPose(relative_motion_ * last_frame_->Pose());
     }
 
-    int num_track_last = TrackLastFrame();
-    tracking_inliers_ = EstimateCurrentPose();
+    if (tracker_) {
+        // no features in normal frames, they are tracked on keyframes only
+        tracking_inliers_ = tracker_->Track(current_frame_);
+    } else {
+        int num_track_last = TrackFeatures(last_frame_);
+        if (stereo_tracking_) {
+            // right image observations of the tracked features
+            FindFeaturesInRight();
+        }
+        tracking_inliers_ = EstimateCurrentPose();
+    }
 
     if (tracking_inliers_ > num_features_tracking_) {
         // tracking good
@@ -73,8 +95,16 @@ bool Frontend::InsertKeyframe() {
         // still have enough features, don't insert keyframe
         return false;
     }
+    if (tracker_) {
+        // observations of the new keyframe: LK from the last keyframe, then
+        // refine the tracker's pose and reject the outliers
+        TrackFeatures(last_keyframe_);
+        if (stereo_tracking_) FindFeaturesInRight();
+        EstimateCurrentPose();
+    }
+
     // current frame is a new keyframe
-    current_frame_->SetKeyFrame();
+    current_frame_->SetKeyFrame(map_->NextKeyFrameId());
     map_->InsertKeyFrame(current_frame_);
 
     LOG(INFO) << "Set frame " << current_frame_->id_ << " as keyframe "
@@ -90,6 +120,9 @@ bool Frontend::InsertKeyframe() {
     // update backend because we have a new keyframe
     backend_->UpdateMap();
 
+    last_keyframe_ = current_frame_;
+    if (tracker_) tracker_->SetKeyframe(current_frame_);
+
     if (viewer_) viewer_->UpdateMap();
 
     return true;
@@ -120,7 +153,8 @@ int Frontend::TriangulateNewPoints() {
             Vec3 pworld = Vec3::Zero();
 
             if (triangulation(poses, points, pworld) && pworld[2] > 0) {
-                auto new_map_point = MapPoint::CreateNewMappoint();
+                auto new_map_point =
+                    MapPoint::CreateNewMappoint(map_->NextMapPointId());
                 pworld = current_pose_Twc * pworld;
                 new_map_point->SetPos(pworld);
                 new_map_point->AddObservation(
@@ -158,31 +192,54 @@ int Frontend::EstimateCurrentPose() {
 
     // K
     Mat33 K = camera_left_->K();
+    double baseline = camera_right_->baseline_;
 
-    // edges
+    // edges, stereo ones if the feature is also observed in the right image
     int index = 1;
-    std::vector<EdgeProjectionPoseOnly *> edges;
+    std::vector<g2o::OptimizableGraph::Edge *> edges;
+    std::vector<double> chi2_ths;
     std::vector<Feature::Ptr> features;
+    const auto &features_right = current_frame_->features_right_;
     for (size_t i = 0; i < current_frame_->features_left_.size(); ++i) {
         auto mp = current_frame_->features_left_[i]->map_point_.lock();
         if (mp) {
             features.push_back(current_frame_->features_left_[i]);
-            EdgeProjectionPoseOnly *edge =
-                new EdgeProjectionPoseOnly(mp->pos_, K);
-            edge->setId(index);
-            edge->setVertex(0, vertex_pose);
-            edge->setMeasurement(
-                toVec2(current_frame_->features_left_[i]->position_.pt));
-            edge->setInformation(Eigen::Matrix2d::Identity());
-            edge->setRobustKernel(new g2o::RobustKernelHuber);
-            edges.push_back(edge);
-            optimizer.addEdge(edge);
+            Vec2 px_left =
+                toVec2(current_frame_->features_left_[i]->position_.pt);
+            if (stereo_tracking_ && i < features_right.size() &&
+                features_right[i]) {
+                auto edge =
+                    new EdgeStereoProjectionPoseOnly(mp->pos_, K, baseline);
+                edge->setId(index);
+                edge->setVertex(0, vertex_pose);
+                edge->setMeasurement(Vec3(px_left[0], px_left[1],
+                                          features_right[i]->position_.pt.x));
+                edge->setInformation(Mat33::Identity());
+                edge->setRobustKernel(new g2o::RobustKernelHuber);
+                edges.push_back(edge);
+                chi2_ths.push_back(7.815);  // chi2 with 3 dof
+                optimizer.addEdge(edge);
+            } else {
+                auto edge = new EdgeProjectionPoseOnly(mp->pos_, K);
+                edge->setId(index);
+                edge->setVertex(0, vertex_pose);
+                edge->setMeasurement(px_left);
+                edge->setInformation(Eigen::Matrix2d::Identity());
+                edge->setRobustKernel(new g2o::RobustKernelHuber);
+                edges.push_back(edge);
+                chi2_ths.push_back(5.991);  // chi2 with 2 dof
+                optimizer.addEdge(edge);
+            }
             index++;
         }
     }
 
     // estimate the Pose the determine the outliers
-    const double chi2_th = 5.991;
+    if (PnPRansacFallback(features, 5.991)) {
+        for (size_t i = 0; i < edges.size(); ++i) {
+            edges[i]->setLevel(features[i]->is_outlier_ ? 1 : 0);
+        }
+    }
     int cnt_outlier = 0;
     for (int iteration = 0; iteration < 4; ++iteration) {
         vertex_pose->setEstimate(current_frame_->Pose());
@@ -196,7 +253,7 @@ int Frontend::EstimateCurrentPose() {
             if (features[i]->is_outlier_) {
                 e->computeError();
             }
-            if (e->chi2() > chi2_th) {
+            if (e->chi2() > chi2_ths[i]) {
                 features[i]->is_outlier_ = true;
                 e->setLevel(1);
                 cnt_outlier++;
@@ -227,10 +284,53 @@ int Frontend::EstimateCurrentPose() {
     return features.size() - cnt_outlier;
 }
 
-int Frontend::TrackLastFrame() {
-    // use LK flow to estimate points in the right image
+bool Frontend::PnPRansacFallback(const std::vector<Feature::Ptr> &features,
+                                 double chi2_th) {
+    if (features.size() < 4) return false;
+
+    // the backend may have culled map points since the features were taken
+    std::vector<Vec3> points_world;
+    VecVec2 pixels;
+    std::vector<size_t> index;  // feature of every correspondence
+    for (size_t i = 0; i < features.size(); ++i) {
+        auto mp = features[i]->map_point_.lock();
+        if (mp == nullptr) continue;
+        points_world.push_back(mp->Pos());
+        pixels.push_back(toVec2(features[i]->position_.pt));
+        index.push_back(i);
+    }
+    if (index.size() < 4) return false;
+
+    PnPRansac ransac(camera_left_->K(), chi2_th, pnp_ransac_max_iterations_);
+    ransac.SetCorrespondences(points_world, pixels);
+    int prior_inliers = ransac.CountInliers(current_frame_->Pose());
+    if (prior_inliers >= num_features_tracking_ &&
+        prior_inliers >= pnp_ransac_min_inlier_ratio_ * index.size()) {
+        // motion model is good enough
+        return false;
+    }
+
+    SE3 pose;
+    std::vector<bool> inliers;
+    int ransac_inliers = ransac.Estimate(pose, inliers);
+    LOG(INFO) << "PnP RANSAC inliers: " << ransac_inliers << " in "
+              << ransac.LastIterations() << " iterations, motion model "
+              << prior_inliers;
+    if (ransac_inliers <= prior_inliers) return false;
+
+    // start the optimization from the RANSAC pose and its inliers
+    current_frame_->SetPose(pose);
+    for (auto &feat : features) feat->is_outlier_ = true;
+    for (size_t k = 0; k < index.size(); ++k) {
+        features[index[k]]->is_outlier_ = !inliers[k];
+    }
+    return true;
+}
+
+int Frontend::TrackFeatures(Frame::Ptr reference) {
+    // use LK flow to estimate points in the current image
     std::vector<cv::Point2f> kps_last, kps_current;
-    for (auto &kp : last_frame_->features_left_) {
+    for (auto &kp : reference->features_left_) {
         if (kp->map_point_.lock()) {
             // use project point
             auto mp = kp->map_point_.lock();
@@ -247,25 +347,29 @@ int Frontend::TrackLastFrame() {
     std::vector<uchar> status;
     Mat error;
     cv::calcOpticalFlowPyrLK(
-        last_frame_->left_img_, current_frame_->left_img_, kps_last,
+        reference->left_img_, current_frame_->left_img_, kps_last,
         kps_current, status, error, cv::Size(11, 11), 3,
         cv::TermCriteria(cv::TermCriteria::COUNT + cv::TermCriteria::EPS, 30,
                          0.01),
         cv::OPTFLOW_USE_INITIAL_FLOW);
+    std::vector<float> scores;
+    CheckFlow(reference->left_img_, current_frame_->left_img_, kps_last,
+              kps_current, status, scores);
 
     int num_good_pts = 0;
 
     for (size_t i = 0; i < status.size(); ++i) {
         if (status[i]) {
-            cv::KeyPoint kp(kps_current[i], 7);
+            // the NCC score of the track is kept as the keypoint response
+            cv::KeyPoint kp(kps_current[i], 7, -1, scores[i]);
             Feature::Ptr feature(new Feature(current_frame_, kp));
-            feature->map_point_ = last_frame_->features_left_[i]->map_point_;
+            feature->map_point_ = reference->features_left_[i]->map_point_;
             current_frame_->features_left_.push_back(feature);
             num_good_pts++;
         }
     }
 
-    LOG(INFO) << "Find " << num_good_pts << " in the last image.";
+    LOG(INFO) << "Find " << num_good_pts << " in the reference image.";
     return num_good_pts;
 }
 
@@ -309,9 +413,17 @@ int Frontend::DetectFeatures() {
 }
 
 int Frontend::FindFeaturesInRight() {
+    if (!stereo_use_lk_) {
+        return FindFeaturesInRightByRow();
+    }
+
     // use LK flow to estimate points in the right image
+    // features already matched in this frame are skipped
     std::vector<cv::Point2f> kps_left, kps_right;
-    for (auto &kp : current_frame_->features_left_) {
+    const auto &features_left = current_frame_->features_left_;
+    for (size_t i = current_frame_->features_right_.size();
+         i < features_left.size(); ++i) {
+        auto &kp = features_left[i];
         kps_left.push_back(kp->position_.pt);
         auto mp = kp->map_point_.lock();
         if (mp) {
@@ -333,11 +445,14 @@ int Frontend::FindFeaturesInRight() {
         cv::TermCriteria(cv::TermCriteria::COUNT + cv::TermCriteria::EPS, 30,
                          0.01),
         cv::OPTFLOW_USE_INITIAL_FLOW);
+    std::vector<float> scores;
+    CheckFlow(current_frame_->left_img_, current_frame_->right_img_, kps_left,
+              kps_right, status, scores);
 
     int num_good_pts = 0;
     for (size_t i = 0; i < status.size(); ++i) {
         if (status[i]) {
-            cv::KeyPoint kp(kps_right[i], 7);
+            cv::KeyPoint kp(kps_right[i], 7, -1, scores[i]);
             Feature::Ptr feat(new Feature(current_frame_, kp));
             feat->is_on_left_image_ = false;
             current_frame_->features_right_.push_back(feat);
@@ -350,6 +465,126 @@ int Frontend::FindFeaturesInRight() {
     return num_good_pts;
 }
 
+int Frontend::FindFeaturesInRightByRow() {
+    // the images are rectified, so the match lies on the same row
+    const int prior_range = 4;
+    // features already matched in this frame are skipped
+    const auto &features_left = current_frame_->features_left_;
+    const size_t first = current_frame_->features_right_.size();
+    SE3 pose = current_frame_->Pose();
+    std::vector<cv::Point2f> kps_right(features_left.size() - first);
+    std::vector<uchar> status(features_left.size() - first, 0);
+
+    auto match_range = [&](int begin, int end) {
+        for (int i = begin; i < end; ++i) {
+            auto &kp = features_left[first + i];
+            bool found = false;
+            auto mp = kp->map_point_.lock();
+            if (mp) {
+                // use the disparity of the projected point to narrow search
+                auto px = camera_right_->world2pixel(mp->pos_, pose);
+                int d = cvRound(kp->position_.pt.x - px[0]);
+                found = stereo_matcher_->Match(
+                    current_frame_->left_img_, current_frame_->right_img_,
+                    kp->position_.pt, kps_right[i], d - prior_range,
+                    d + prior_range);
+            }
+            if (!found) {
+                found = stereo_matcher_->Match(current_frame_->left_img_,
+                                               current_frame_->right_img_,
+                                               kp->position_.pt, kps_right[i]);
+            }
+            status[i] = found;
+        }
+    };
+    if (thread_pool_) {
+        thread_pool_->ParallelFor(0, status.size(), match_range);
+    } else {
+        match_range(0, status.size());
+    }
+
+    int num_good_pts = 0;
+    for (size_t i = 0; i < status.size(); ++i) {
+        if (status[i]) {
+            cv::KeyPoint kp_right(kps_right[i], 7);
+            Feature::Ptr feat(new Feature(current_frame_, kp_right));
+            feat->is_on_left_image_ = false;
+            current_frame_->features_right_.push_back(feat);
+            num_good_pts++;
+        } else {
+            current_frame_->features_right_.push_back(nullptr);
+        }
+    }
+    LOG(INFO) << "Find " << num_good_pts << " in the right image.";
+    return num_good_pts;
+}
+
+int Frontend::CheckFlow(const cv::Mat &img1, const cv::Mat &img2,
+                        const std::vector<cv::Point2f> &pts1,
+                        const std::vector<cv::Point2f> &pts2,
+                        std::vector<uchar> &status,
+                        std::vector<float> &scores) {
+    scores.assign(status.size(), 1.f);
+    if (!flow_check_.Enabled()) return 0;
+
+    // track the good points back into img1, starting from where they began
+    std::vector<cv::Point2f> pts_back(pts1);
+    int num_culled = 0;  // failed backward tracks count as culled
+    if (flow_check_.forward_backward) {
+        std::vector<int> index;
+        std::vector<cv::Point2f> from, back;
+        for (size_t i = 0; i < status.size(); ++i) {
+            if (!status[i]) continue;
+            index.push_back(i);
+            from.push_back(pts2[i]);
+            back.push_back(pts1[i]);
+        }
+        if (!index.empty()) {
+            std::vector<uchar> status_back;
+            Mat error;
+            cv::calcOpticalFlowPyrLK(
+                img2, img1, from, back, status_back, error, cv::Size(11, 11),
+                3,
+                cv::TermCriteria(
+                    cv::TermCriteria::COUNT + cv::TermCriteria::EPS, 30, 0.01),
+                cv::OPTFLOW_USE_INITIAL_FLOW);
+            for (size_t k = 0; k < index.size(); ++k) {
+                if (status_back[k]) {
+                    pts_back[index[k]] = back[k];
+                } else {
+                    status[index[k]] = 0;
+                    num_culled++;
+                }
+            }
+        }
+    }
+
+    // forward-backward error and NCC of every track
+    std::vector<uchar> passed(status.size(), 1);
+    auto check_range = [&](int begin, int end) {
+        for (int i = begin; i < end; ++i) {
+            if (status[i]) {
+                passed[i] = flow_check_.Check(img1, img2, pts1[i], pts2[i],
+                                              pts_back[i], scores[i]);
+            }
+        }
+    };
+    if (thread_pool_) {
+        thread_pool_->ParallelFor(0, status.size(), check_range);
+    } else {
+        check_range(0, status.size());
+    }
+
+    for (size_t i = 0; i < status.size(); ++i) {
+        if (status[i] && !passed[i]) {
+            status[i] = 0;
+            num_culled++;
+        }
+    }
+    LOG(INFO) << "Flow check culled " << num_culled << " tracks.";
+    return num_culled;
+}
+
 bool Frontend::BuildInitMap() {
     std::vector<SE3> poses{camera_left_->pose(), camera_right_->pose()};
     size_t cnt_init_landmarks = 0;
@@ -366,7 +601,8 @@ bool Frontend::BuildInitMap() {
         Vec3 pworld = Vec3::Zero();
 
         if (triangulation(poses, points, pworld) && pworld[2] > 0) {
-            auto new_map_point = MapPoint::CreateNewMappoint();
+            auto new_map_point =
+                MapPoint::CreateNewMappoint(map_->NextMapPointId());
             new_map_point->SetPos(pworld);
             new_map_point->AddObservation(current_frame_->features_left_[i]);
             new_map_point->AddObservation(current_frame_->features_right_[i]);
@@ -376,9 +612,11 @@ bool Frontend::BuildInitMap() {
             map_->InsertMapPoint(new_map_point);
         }
     }
-    current_frame_->SetKeyFrame();
+    current_frame_->SetKeyFrame(map_->NextKeyFrameId());
     map_->InsertKeyFrame(current_frame_);
     backend_->UpdateMap();
+    last_keyframe_ = current_frame_;
+    if (tracker_) tracker_->SetKeyframe(current_frame_);
 
     LOG(INFO) << "Initial map created with " << cnt_init_landmarks
               << " map points";
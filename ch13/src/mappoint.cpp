@@ -24,10 +24,9 @@ namespace myslam {
 
 MapPoint::MapPoint(long id, Vec3 position) : id_(id), pos_(position) {}
 
-MapPoint::Ptr MapPoint::CreateNewMappoint() {
-    static long factory_id = 0;
+MapPoint::Ptr MapPoint::CreateNewMappoint(unsigned long id) {
     MapPoint::Ptr new_mappoint(new MapPoint);
-    new_mappoint->id_ = factory_id++;
+    new_mappoint->id_ = id;
     return new_mappoint;
 }
 
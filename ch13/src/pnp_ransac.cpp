@@ -0,0 +1,354 @@
+#include "myslam/pnp_ransac.h"
+
+#include <Eigen/Eigenvalues>
+#include <Eigen/SVD>
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define MYSLAM_PNP_AVX_DISPATCH
+#include <immintrin.h>
+#endif
+
+namespace myslam {
+
+namespace {
+
+/// real roots of a4 x^4 + a3 x^3 + a2 x^2 + a1 x + a0, polished by Newton
+int SolveQuartic(const double a[5], double roots[4]) {
+    if (std::abs(a[4]) < 1e-12) return 0;
+    Mat44 companion = Mat44::Zero();
+    companion.block<3, 3>(1, 0).setIdentity();
+    for (int i = 0; i < 4; ++i) companion(i, 3) = -a[i] / a[4];
+    Eigen::EigenSolver<Mat44> solver(companion, false);
+
+    int num_roots = 0;
+    for (int i = 0; i < 4; ++i) {
+        std::complex<double> r = solver.eigenvalues()[i];
+        if (std::abs(r.imag()) > 1e-4 * (1 + std::abs(r.real()))) continue;
+        double x = r.real();
+        for (int iter = 0; iter < 3; ++iter) {
+            double f = (((a[4] * x + a[3]) * x + a[2]) * x + a[1]) * x + a[0];
+            double df = ((4 * a[4] * x + 3 * a[3]) * x + 2 * a[2]) * x + a[1];
+            if (std::abs(df) < 1e-14) break;
+            x -= f / df;
+        }
+        roots[num_roots++] = x;
+    }
+    return num_roots;
+}
+
+/// rigid transform with camera_points[i] = R * world_points[i] + t
+SE3 AlignPoints(const Vec3 world[3], const Vec3 camera[3]) {
+    Vec3 cw = (world[0] + world[1] + world[2]) / 3;
+    Vec3 cc = (camera[0] + camera[1] + camera[2]) / 3;
+    Mat33 W = Mat33::Zero();
+    for (int i = 0; i < 3; ++i) {
+        W += (camera[i] - cc) * (world[i] - cw).transpose();
+    }
+    Eigen::JacobiSVD<Mat33> svd(W, Eigen::ComputeFullU | Eigen::ComputeFullV);
+    Mat33 U = svd.matrixU(), V = svd.matrixV();
+    Mat33 R = U * V.transpose();
+    if (R.determinant() < 0) {
+        U.col(2) *= -1;
+        R = U * V.transpose();
+    }
+    return SE3(Eigen::Quaterniond(R), cc - R * cw);
+}
+
+/// per-pose constants shared by the scorers
+struct ScoreParams {
+    float r[9], t[3];
+    float fx, fy, cx, cy, th;
+};
+
+int ScoreScalar(const ScoreParams &p, const float *x, const float *y,
+                const float *z, const float *u, const float *v, size_t begin,
+                size_t end) {
+    int cnt = 0;
+    for (size_t i = begin; i < end; ++i) {
+        float xc = p.r[0] * x[i] + p.r[1] * y[i] + p.r[2] * z[i] + p.t[0];
+        float yc = p.r[3] * x[i] + p.r[4] * y[i] + p.r[5] * z[i] + p.t[1];
+        float zc = p.r[6] * x[i] + p.r[7] * y[i] + p.r[8] * z[i] + p.t[2];
+        if (zc <= 0) continue;
+        float du = p.fx * xc / zc + p.cx - u[i];
+        float dv = p.fy * yc / zc + p.cy - v[i];
+        if (du * du + dv * dv < p.th) cnt++;
+    }
+    return cnt;
+}
+
+#ifdef MYSLAM_PNP_AVX_DISPATCH
+/// 4 points per step, SSE2 is always there on x86-64
+int ScoreSse(const ScoreParams &p, const float *x, const float *y,
+             const float *z, const float *u, const float *v, size_t n) {
+    const __m128 r0 = _mm_set1_ps(p.r[0]), r1 = _mm_set1_ps(p.r[1]),
+                 r2 = _mm_set1_ps(p.r[2]), r3 = _mm_set1_ps(p.r[3]),
+                 r4 = _mm_set1_ps(p.r[4]), r5 = _mm_set1_ps(p.r[5]),
+                 r6 = _mm_set1_ps(p.r[6]), r7 = _mm_set1_ps(p.r[7]),
+                 r8 = _mm_set1_ps(p.r[8]);
+    const __m128 t0 = _mm_set1_ps(p.t[0]), t1 = _mm_set1_ps(p.t[1]),
+                 t2 = _mm_set1_ps(p.t[2]);
+    const __m128 fx = _mm_set1_ps(p.fx), fy = _mm_set1_ps(p.fy),
+                 cx = _mm_set1_ps(p.cx), cy = _mm_set1_ps(p.cy),
+                 th = _mm_set1_ps(p.th), zero = _mm_setzero_ps();
+    int cnt = 0;
+    for (size_t i = 0; i < n; i += 4) {
+        __m128 px = _mm_loadu_ps(x + i), py = _mm_loadu_ps(y + i),
+               pz = _mm_loadu_ps(z + i);
+        __m128 xc = _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(r0, px), _mm_mul_ps(r1, py)),
+            _mm_add_ps(_mm_mul_ps(r2, pz), t0));
+        __m128 yc = _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(r3, px), _mm_mul_ps(r4, py)),
+            _mm_add_ps(_mm_mul_ps(r5, pz), t1));
+        __m128 zc = _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(r6, px), _mm_mul_ps(r7, py)),
+            _mm_add_ps(_mm_mul_ps(r8, pz), t2));
+        __m128 inv_z = _mm_div_ps(_mm_set1_ps(1.f), zc);
+        __m128 du = _mm_sub_ps(
+            _mm_add_ps(_mm_mul_ps(_mm_mul_ps(fx, xc), inv_z), cx),
+            _mm_loadu_ps(u + i));
+        __m128 dv = _mm_sub_ps(
+            _mm_add_ps(_mm_mul_ps(_mm_mul_ps(fy, yc), inv_z), cy),
+            _mm_loadu_ps(v + i));
+        __m128 err = _mm_add_ps(_mm_mul_ps(du, du), _mm_mul_ps(dv, dv));
+        __m128 ok = _mm_and_ps(_mm_cmpgt_ps(zc, zero), _mm_cmplt_ps(err, th));
+        cnt += __builtin_popcount(_mm_movemask_ps(ok));
+    }
+    return cnt;
+}
+
+/// 8 points per step, selected at runtime
+__attribute__((target("avx2,fma"))) int ScoreAvx2(
+    const ScoreParams &p, const float *x, const float *y, const float *z,
+    const float *u, const float *v, size_t n) {
+    const __m256 r0 = _mm256_set1_ps(p.r[0]), r1 = _mm256_set1_ps(p.r[1]),
+                 r2 = _mm256_set1_ps(p.r[2]), r3 = _mm256_set1_ps(p.r[3]),
+                 r4 = _mm256_set1_ps(p.r[4]), r5 = _mm256_set1_ps(p.r[5]),
+                 r6 = _mm256_set1_ps(p.r[6]), r7 = _mm256_set1_ps(p.r[7]),
+                 r8 = _mm256_set1_ps(p.r[8]);
+    const __m256 t0 = _mm256_set1_ps(p.t[0]), t1 = _mm256_set1_ps(p.t[1]),
+                 t2 = _mm256_set1_ps(p.t[2]);
+    const __m256 fx = _mm256_set1_ps(p.fx), fy = _mm256_set1_ps(p.fy),
+                 cx = _mm256_set1_ps(p.cx), cy = _mm256_set1_ps(p.cy),
+                 th = _mm256_set1_ps(p.th), zero = _mm256_setzero_ps();
+    int cnt = 0;
+    for (size_t i = 0; i < n; i += 8) {
+        __m256 px = _mm256_loadu_ps(x + i), py = _mm256_loadu_ps(y + i),
+               pz = _mm256_loadu_ps(z + i);
+        __m256 xc = _mm256_fmadd_ps(
+            r0, px, _mm256_fmadd_ps(r1, py, _mm256_fmadd_ps(r2, pz, t0)));
+        __m256 yc = _mm256_fmadd_ps(
+            r3, px, _mm256_fmadd_ps(r4, py, _mm256_fmadd_ps(r5, pz, t1)));
+        __m256 zc = _mm256_fmadd_ps(
+            r6, px, _mm256_fmadd_ps(r7, py, _mm256_fmadd_ps(r8, pz, t2)));
+        __m256 inv_z = _mm256_div_ps(_mm256_set1_ps(1.f), zc);
+        __m256 du = _mm256_sub_ps(
+            _mm256_fmadd_ps(_mm256_mul_ps(fx, xc), inv_z, cx),
+            _mm256_loadu_ps(u + i));
+        __m256 dv = _mm256_sub_ps(
+            _mm256_fmadd_ps(_mm256_mul_ps(fy, yc), inv_z, cy),
+            _mm256_loadu_ps(v + i));
+        __m256 err = _mm256_fmadd_ps(du, du, _mm256_mul_ps(dv, dv));
+        __m256 ok = _mm256_and_ps(_mm256_cmp_ps(zc, zero, _CMP_GT_OQ),
+                                  _mm256_cmp_ps(err, th, _CMP_LT_OQ));
+        cnt += __builtin_popcount(_mm256_movemask_ps(ok));
+    }
+    return cnt;
+}
+#endif
+
+typedef int (*ScoreFunc)(const ScoreParams &, const float *, const float *,
+                         const float *, const float *, const float *, size_t);
+
+/// pick the widest scorer supported by the running cpu
+ScoreFunc SelectScore() {
+#ifdef MYSLAM_PNP_AVX_DISPATCH
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return ScoreAvx2;
+    return ScoreSse;
+#else
+    return [](const ScoreParams &p, const float *x, const float *y,
+              const float *z, const float *u, const float *v, size_t n) {
+        return ScoreScalar(p, x, y, z, u, v, 0, n);
+    };
+#endif
+}
+
+}  // namespace
+
+int SolveP3P(const Vec3 points_world[3], const Vec3 bearings[3],
+             std::vector<SE3> &poses) {
+    poses.clear();
+    // Grunert's formulation, see Haralick et al., "Review and analysis of
+    // solutions of the three point perspective pose estimation problem"
+    const Vec3 &P1 = points_world[0], &P2 = points_world[1],
+               &P3 = points_world[2];
+    if ((P2 - P1).cross(P3 - P1).norm() < 1e-10) return 0;  // collinear
+
+    double a2 = (P2 - P3).squaredNorm(), b2 = (P1 - P3).squaredNorm(),
+           c2 = (P1 - P2).squaredNorm();
+    double cos_alpha = bearings[1].dot(bearings[2]);
+    double cos_beta = bearings[0].dot(bearings[2]);
+    double cos_gamma = bearings[0].dot(bearings[1]);
+
+    double p = (a2 - c2) / b2, q = (a2 + c2) / b2;
+    double ca2 = cos_alpha * cos_alpha, cb2 = cos_beta * cos_beta,
+           cg2 = cos_gamma * cos_gamma;
+    double abg = cos_alpha * cos_beta * cos_gamma;
+
+    double coeffs[5];
+    coeffs[4] = (p - 1) * (p - 1) - 4 * c2 / b2 * ca2;
+    coeffs[3] = 4 * (p * (1 - p) * cos_beta - (1 - q) * cos_alpha * cos_gamma +
+                     2 * c2 / b2 * ca2 * cos_beta);
+    coeffs[2] = 2 * (p * p - 1 + 2 * p * p * cb2 + 2 * (b2 - c2) / b2 * ca2 -
+                     4 * q * abg + 2 * (b2 - a2) / b2 * cg2);
+    coeffs[1] = 4 * (-p * (1 + p) * cos_beta + 2 * a2 / b2 * cg2 * cos_beta -
+                     (1 - q) * cos_alpha * cos_gamma);
+    coeffs[0] = (1 + p) * (1 + p) - 4 * a2 / b2 * cg2;
+
+    double roots[4];
+    int num_roots = SolveQuartic(coeffs, roots);
+    for (int i = 0; i < num_roots; ++i) {
+        // s2 = u * s1, s3 = v * s1
+        double v = roots[i];
+        double denom = 2 * (cos_gamma - v * cos_alpha);
+        if (std::abs(denom) < 1e-10) continue;
+        double u = ((p - 1) * v * v - 2 * p * cos_beta * v + 1 + p) / denom;
+        double s1_sq = b2 / (1 + v * v - 2 * v * cos_beta);
+        if (!(s1_sq > 0) || u <= 0 || v <= 0) continue;
+        double s1 = std::sqrt(s1_sq);
+        Vec3 points_camera[3] = {s1 * bearings[0], u * s1 * bearings[1],
+                                 v * s1 * bearings[2]};
+        poses.push_back(AlignPoints(points_world, points_camera));
+    }
+    return int(poses.size());
+}
+
+PnPRansac::PnPRansac(const Mat33 &K, double inlier_threshold,
+                     int max_iterations, double confidence)
+    : fx_(K(0, 0)),
+      fy_(K(1, 1)),
+      cx_(K(0, 2)),
+      cy_(K(1, 2)),
+      inlier_threshold_(inlier_threshold),
+      max_iterations_(max_iterations),
+      confidence_(confidence) {}
+
+void PnPRansac::SetCorrespondences(const std::vector<Vec3> &points_world,
+                                   const VecVec2 &pixels) {
+    assert(points_world.size() == pixels.size());
+    num_points_ = points_world.size();
+    size_t padded = (num_points_ + 7) / 8 * 8;
+    // padding points lie behind the camera and are never inliers
+    x_.assign(padded, 0);
+    y_.assign(padded, 0);
+    z_.assign(padded, -1);
+    u_.assign(padded, 0);
+    v_.assign(padded, 0);
+    points_world_ = points_world;
+    bearings_.resize(num_points_);
+    for (size_t i = 0; i < num_points_; ++i) {
+        x_[i] = float(points_world[i][0]);
+        y_[i] = float(points_world[i][1]);
+        z_[i] = float(points_world[i][2]);
+        u_[i] = float(pixels[i][0]);
+        v_[i] = float(pixels[i][1]);
+        bearings_[i] = Vec3((pixels[i][0] - cx_) / fx_,
+                            (pixels[i][1] - cy_) / fy_, 1)
+                           .normalized();
+    }
+}
+
+int PnPRansac::CountInliers(const SE3 &Tcw) const {
+    return Score(Tcw, nullptr);
+}
+
+int PnPRansac::Score(const SE3 &Tcw, std::vector<bool> *inliers) const {
+    static const ScoreFunc score = SelectScore();
+    ScoreParams p;
+    Mat33 R = Tcw.rotationMatrix();
+    Vec3 t = Tcw.translation();
+    for (int i = 0; i < 9; ++i) p.r[i] = float(R(i / 3, i % 3));
+    for (int i = 0; i < 3; ++i) p.t[i] = float(t[i]);
+    p.fx = float(fx_);
+    p.fy = float(fy_);
+    p.cx = float(cx_);
+    p.cy = float(cy_);
+    p.th = float(inlier_threshold_);
+
+    if (inliers == nullptr) {
+        return score(p, x_.data(), y_.data(), z_.data(), u_.data(),
+                     v_.data(), x_.size());
+    }
+
+    inliers->assign(num_points_, false);
+    int cnt = 0;
+    for (size_t i = 0; i < num_points_; ++i) {
+        if (ScoreScalar(p, x_.data(), y_.data(), z_.data(), u_.data(),
+                        v_.data(), i, i + 1)) {
+            (*inliers)[i] = true;
+            cnt++;
+        }
+    }
+    return cnt;
+}
+
+int PnPRansac::Estimate(SE3 &Tcw, std::vector<bool> &inliers) {
+    last_iterations_ = 0;
+    if (num_points_ < 4) return 0;
+
+    std::uniform_int_distribution<size_t> dist(0, num_points_ - 1);
+    std::vector<SE3> hypotheses;
+    SE3 best_pose;
+    int best_inliers = 0;
+    int needed_iterations = max_iterations_;
+
+    for (int iter = 0; iter < needed_iterations; ++iter) {
+        last_iterations_ = iter + 1;
+
+        // minimal sample of 3 distinct points
+        size_t idx[3];
+        idx[0] = dist(rng_);
+        do {
+            idx[1] = dist(rng_);
+        } while (idx[1] == idx[0]);
+        do {
+            idx[2] = dist(rng_);
+        } while (idx[2] == idx[0] || idx[2] == idx[1]);
+
+        Vec3 pw[3] = {points_world_[idx[0]], points_world_[idx[1]],
+                      points_world_[idx[2]]};
+        Vec3 bearings[3] = {bearings_[idx[0]], bearings_[idx[1]],
+                            bearings_[idx[2]]};
+        if (SolveP3P(pw, bearings, hypotheses) == 0) continue;
+
+        for (auto &pose : hypotheses) {
+            int cnt = Score(pose, nullptr);
+            if (cnt > best_inliers) {
+                best_inliers = cnt;
+                best_pose = pose;
+            }
+        }
+
+        // early termination, N = log(1-p) / log(1-w^3), once the best pose
+        // has at least a minimal sample of inliers (w = 0 gives log(1))
+        if (best_inliers < 3) continue;
+        if (best_inliers == int(num_points_)) break;
+        double w = double(best_inliers) / num_points_;
+        double no_outlier_prob = 1 - w * w * w;
+        if (no_outlier_prob < 1e-12) break;
+        double n = std::log(1 - confidence_) / std::log(no_outlier_prob);
+        // clamped as a double, the int cast overflows for small w
+        n = std::min(std::max(n, 0.0), double(max_iterations_));
+        if (n < needed_iterations) needed_iterations = int(std::ceil(n));
+    }
+
+    if (best_inliers < 4) return 0;
+    Tcw = best_pose;
+    return Score(Tcw, &inliers);
+}
+
+}  // namespace myslam
@@ -0,0 +1,161 @@
+#include "myslam/stereo_matcher.h"
+
+#include <limits>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MYSLAM_STEREO_AVX2_DISPATCH
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace myslam {
+
+namespace {
+
+/// SAD of one 16 pixel row
+inline int RowSAD16(const uchar *a, const uchar *b) {
+#if defined(__SSE2__)
+    __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a));
+    __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b));
+    __m128i sad = _mm_sad_epu8(va, vb);
+    return _mm_cvtsi128_si32(sad) + _mm_extract_epi16(sad, 4);
+#else
+    int sum = 0;
+    for (int i = 0; i < StereoMatcher::kPatchWidth; ++i)
+        sum += std::abs(int(a[i]) - int(b[i]));
+    return sum;
+#endif
+}
+
+/// SAD of a 16 x rows patch
+int PatchSAD16(const uchar *a, size_t step_a, const uchar *b, size_t step_b,
+               int rows) {
+    int sum = 0;
+    for (int r = 0; r < rows; ++r) {
+        sum += RowSAD16(a, b);
+        a += step_a;
+        b += step_b;
+    }
+    return sum;
+}
+
+#ifdef MYSLAM_STEREO_AVX2_DISPATCH
+/// same as PatchSAD16, two rows per instruction, selected at runtime
+__attribute__((target("avx2"))) int PatchSAD16Avx2(const uchar *a,
+                                                   size_t step_a,
+                                                   const uchar *b,
+                                                   size_t step_b, int rows) {
+    __m256i acc = _mm256_setzero_si256();
+    int r = 0;
+    for (; r + 1 < rows; r += 2) {
+        __m256i va = _mm256_inserti128_si256(
+            _mm256_castsi128_si256(
+                _mm_loadu_si128(reinterpret_cast<const __m128i *>(a))),
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + step_a)),
+            1);
+        __m256i vb = _mm256_inserti128_si256(
+            _mm256_castsi128_si256(
+                _mm_loadu_si128(reinterpret_cast<const __m128i *>(b))),
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + step_b)),
+            1);
+        acc = _mm256_add_epi64(acc, _mm256_sad_epu8(va, vb));
+        a += 2 * step_a;
+        b += 2 * step_b;
+    }
+    __m128i acc128 = _mm_add_epi64(_mm256_castsi256_si128(acc),
+                                   _mm256_extracti128_si256(acc, 1));
+    int sum = _mm_cvtsi128_si32(acc128) + _mm_extract_epi16(acc128, 4);
+    if (r < rows) sum += RowSAD16(a, b);
+    return sum;
+}
+#endif
+
+typedef int (*PatchSADFunc)(const uchar *, size_t, const uchar *, size_t,
+                            int);
+
+/// pick the widest kernel supported by the running cpu
+PatchSADFunc SelectPatchSAD() {
+#ifdef MYSLAM_STEREO_AVX2_DISPATCH
+    if (__builtin_cpu_supports("avx2")) return PatchSAD16Avx2;
+#endif
+    return PatchSAD16;
+}
+
+}  // namespace
+
+StereoMatcher::StereoMatcher(int max_disparity, int half_patch_height,
+                             float max_mean_sad, float uniqueness_ratio)
+    : max_disparity_(max_disparity),
+      half_patch_height_(half_patch_height),
+      max_mean_sad_(max_mean_sad),
+      uniqueness_ratio_(uniqueness_ratio) {}
+
+bool StereoMatcher::Match(const cv::Mat &left, const cv::Mat &right,
+                          const cv::Point2f &pt_left, cv::Point2f &pt_right,
+                          int min_disparity, int max_disparity) const {
+    const int half_width = kPatchWidth / 2;
+    const int rows = 2 * half_patch_height_ + 1;
+    int u = cvRound(pt_left.x), v = cvRound(pt_left.y);
+
+    // the left patch must be inside both images (rectified, same size)
+    if (left.size() != right.size()) return false;
+    if (u - half_width < 0 || u + half_width > left.cols ||
+        v - half_patch_height_ < 0 || v + half_patch_height_ >= left.rows) {
+        return false;
+    }
+
+    // right patch starts at u - d - half_width, it must stay inside as well
+    min_disparity = std::max(min_disparity, 0);
+    max_disparity = std::min(max_disparity, max_disparity_);
+    max_disparity = std::min(max_disparity, u - half_width);
+    if (max_disparity < min_disparity) return false;
+
+    const size_t step_left = left.step, step_right = right.step;
+    const uchar *patch_left =
+        left.data + (v - half_patch_height_) * step_left + (u - half_width);
+    const uchar *row_right =
+        right.data + (v - half_patch_height_) * step_right + (u - half_width);
+
+    // 1D search, costs[d - min_disparity]
+    // Match runs on the frontend threads, every thread keeps its own costs
+    static const PatchSADFunc patch_sad = SelectPatchSAD();
+    thread_local std::vector<int> costs;
+    if (costs.size() < size_t(max_disparity_ + 1)) {
+        costs.resize(max_disparity_ + 1);
+    }
+    int best = std::numeric_limits<int>::max(), best_d = -1;
+    for (int d = min_disparity; d <= max_disparity; ++d) {
+        int cost = patch_sad(patch_left, step_left, row_right - d,
+                             step_right, rows);
+        costs[d - min_disparity] = cost;
+        if (cost < best) {
+            best = cost;
+            best_d = d;
+        }
+    }
+
+    // validity: absolute cost and uniqueness outside the best +-1
+    if (best > max_mean_sad_ * kPatchWidth * rows) return false;
+    for (int d = min_disparity; d <= max_disparity; ++d) {
+        if (std::abs(d - best_d) <= 1) continue;
+        if (best >= uniqueness_ratio_ * costs[d - min_disparity]) return false;
+    }
+
+    // sub-pixel refinement by fitting a parabola through the neighbours
+    double disparity = best_d;
+    if (best_d > min_disparity && best_d < max_disparity) {
+        double c_minus = costs[best_d - 1 - min_disparity];
+        double c_plus = costs[best_d + 1 - min_disparity];
+        double denominator = c_minus - 2.0 * best + c_plus;
+        if (denominator > 0) {
+            disparity += 0.5 * (c_minus - c_plus) / denominator;
+        }
+    }
+
+    // keep the sub-pixel part of the left keypoint
+    pt_right = cv::Point2f(pt_left.x - disparity, pt_left.y);
+    return true;
+}
+
+}  // namespace myslam
@@ -0,0 +1,189 @@
+#include "myslam/thread_runtime.h"
+
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace myslam {
+
+ThreadOptions ThreadOptions::FromConfig(const Config &config,
+                                        const std::string &name) {
+    ThreadOptions options(name);
+    const std::string prefix = "thread." + name + ".";
+
+    // "2,3", or a single unquoted cpu which yaml reads as an int
+    cv::FileNode cpus = config.Node(prefix + "cpus");
+    std::string cpu_list;
+    if (cpus.isInt()) {
+        cpu_list = std::to_string(int(cpus));
+    } else if (cpus.isString()) {
+        cpu_list = std::string(cpus);
+    } else if (!cpus.empty()) {
+        LOG(WARNING) << prefix << "cpus is not a cpu list, ignored";
+    }
+    std::stringstream ss(cpu_list);
+    for (std::string cpu; std::getline(ss, cpu, ',');) {
+        if (cpu.find_first_not_of(" \t") == std::string::npos) continue;
+        char *end = nullptr;
+        errno = 0;
+        const long value = std::strtol(cpu.c_str(), &end, 10);
+        if (end == cpu.c_str() ||
+            end[std::strspn(end, " \t")] != '\0' || errno == ERANGE ||
+            value < 0 || value > INT_MAX) {
+            LOG(WARNING) << prefix << "cpus: skip invalid cpu \"" << cpu
+                         << "\"";
+            continue;
+        }
+        options.cpus.push_back(int(value));
+    }
+    options.nice = config.Get<int>(prefix + "nice", 0);
+    options.realtime_priority =
+        config.Get<int>(prefix + "realtime_priority", 0);
+    return options;
+}
+
+bool ApplyThreadOptions(const ThreadOptions &options) {
+    bool success = true;
+#ifdef __linux__
+    if (!options.name.empty()) {
+        // linux limits thread names to 15 characters
+        pthread_setname_np(pthread_self(), options.name.substr(0, 15).c_str());
+    }
+
+    if (!options.cpus.empty()) {
+        cpu_set_t cpu_set;
+        CPU_ZERO(&cpu_set);
+        int num_cpus = 0;
+        for (int cpu : options.cpus) {
+            // CPU_SET does not check the range of the fixed size set
+            if (cpu < 0 || cpu >= CPU_SETSIZE) {
+                LOG(WARNING) << "thread " << options.name << ": cpu " << cpu
+                             << " out of range [0, " << CPU_SETSIZE << ")";
+                success = false;
+                continue;
+            }
+            CPU_SET(cpu, &cpu_set);
+            ++num_cpus;
+        }
+        if (num_cpus > 0 && pthread_setaffinity_np(pthread_self(),
+                                                   sizeof(cpu_set),
+                                                   &cpu_set) != 0) {
+            LOG(WARNING) << "thread " << options.name
+                         << ": cannot set cpu affinity";
+            success = false;
+        }
+    }
+
+    if (options.realtime_priority > 0) {
+        sched_param param;
+        param.sched_priority = options.realtime_priority;
+        if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) != 0) {
+            LOG(WARNING) << "thread " << options.name
+                         << ": cannot set realtime priority "
+                         << options.realtime_priority;
+            success = false;
+        }
+    } else if (options.nice != 0) {
+        // on linux the nice value is per thread when addressed by tid
+        pid_t tid = pid_t(syscall(SYS_gettid));
+        if (setpriority(PRIO_PROCESS, tid, options.nice) != 0) {
+            LOG(WARNING) << "thread " << options.name << ": cannot set nice "
+                         << options.nice;
+            success = false;
+        }
+    }
+#else
+    if (!options.cpus.empty() || options.nice != 0 ||
+        options.realtime_priority > 0) {
+        LOG(WARNING) << "thread options are only supported on linux";
+        success = false;
+    }
+#endif
+    return success;
+}
+
+std::thread StartThread(const ThreadOptions &options,
+                        std::function<void()> func) {
+    return std::thread([options, func]() {
+        ApplyThreadOptions(options);
+        func();
+    });
+}
+
+ThreadPool::ThreadPool(int num_threads, const ThreadOptions &options) {
+    for (int i = 0; i < num_threads; ++i) {
+        ThreadOptions worker_options = options;
+        worker_options.name = options.name + "-" + std::to_string(i);
+        workers_.push_back(
+            StartThread(worker_options, [this]() { WorkerLoop(); }));
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::unique_lock<std::mutex> lck(tasks_mutex_);
+        stopping_ = true;
+    }
+    tasks_update_.notify_all();
+    for (auto &worker : workers_) worker.join();
+}
+
+std::future<void> ThreadPool::Submit(std::function<void()> task) {
+    std::packaged_task<void()> packaged(task);
+    std::future<void> result = packaged.get_future();
+    if (workers_.empty()) {
+        // no worker, run in the calling thread
+        packaged();
+        return result;
+    }
+    {
+        std::unique_lock<std::mutex> lck(tasks_mutex_);
+        tasks_.push_back(std::move(packaged));
+    }
+    tasks_update_.notify_one();
+    return result;
+}
+
+void ThreadPool::ParallelFor(int begin, int end,
+                             const std::function<void(int, int)> &func) {
+    if (end <= begin) return;
+    int num_chunks = std::min(NumThreads() + 1, end - begin);
+    int chunk_size = (end - begin + num_chunks - 1) / num_chunks;
+
+    std::vector<std::future<void>> results;
+    for (int start = begin + chunk_size; start < end; start += chunk_size) {
+        int stop = std::min(start + chunk_size, end);
+        results.push_back(
+            Submit([&func, start, stop]() { func(start, stop); }));
+    }
+    // the calling thread takes the first chunk
+    func(begin, std::min(begin + chunk_size, end));
+    for (auto &result : results) result.get();
+}
+
+void ThreadPool::WorkerLoop() {
+    while (true) {
+        std::packaged_task<void()> task;
+        {
+            std::unique_lock<std::mutex> lck(tasks_mutex_);
+            tasks_update_.wait(
+                lck, [this]() { return stopping_ || !tasks_.empty(); });
+            if (tasks_.empty()) return;  // stopping and nothing left
+            task = std::move(tasks_.front());
+            tasks_.pop_front();
+        }
+        task();
+    }
+}
+
+}  // namespace myslam
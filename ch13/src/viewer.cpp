@@ -10,8 +10,8 @@
 
 namespace myslam {
 
-Viewer::Viewer() {
-    viewer_thread_ = std::thread(std::bind(&Viewer::ThreadLoop, this));
+Viewer::Viewer(const ThreadOptions &options) {
+    viewer_thread_ = StartThread(options, std::bind(&Viewer::ThreadLoop, this));
 }
 
 void Viewer::Close() {
@@ -4,42 +4,75 @@
 #include "myslam/visual_odometry.h"
 #include <chrono>
 #include "myslam/config.h"
+#include "myslam/direct_tracker.h"
 
 namespace myslam {
 
-VisualOdometry::VisualOdometry(std::string &config_path)
+VisualOdometry::VisualOdometry(const std::string &config_path)
     : config_file_path_(config_path) {}
 
 bool VisualOdometry::Init() {
     // read from config file
-    if (Config::SetParameterFile(config_file_path_) == false) {
+    config_ = Config::Ptr(new Config);
+    if (config_->SetParameterFile(config_file_path_) == false) {
         return false;
     }
 
-    dataset_ =
-        Dataset::Ptr(new Dataset(Config::Get<std::string>("dataset_dir")));
-    CHECK_EQ(dataset_->Init(), true);
+    if (dataset_dir_.empty()) {
+        dataset_dir_ = config_->Get<std::string>("dataset_dir");
+    }
+    dataset_ = Dataset::Ptr(new Dataset(dataset_dir_));
+    if (dataset_->Init() == false) {
+        return false;
+    }
+
+    // threads: frontend runs in the caller of Run()
+    frontend_thread_options_ = ThreadOptions::FromConfig(*config_, "frontend");
+    int pool_size = config_->Get<int>("thread.pool.size", 0);
+    if (pool_size > 0) {
+        thread_pool_ = ThreadPool::Ptr(new ThreadPool(
+            pool_size, ThreadOptions::FromConfig(*config_, "pool")));
+    }
 
     // create components and links
-    frontend_ = Frontend::Ptr(new Frontend);
-    backend_ = Backend::Ptr(new Backend);
+    frontend_ = Frontend::Ptr(new Frontend(config_));
+    backend_ = Backend::Ptr(
+        new Backend(ThreadOptions::FromConfig(*config_, "backend")));
     map_ = Map::Ptr(new Map);
-    viewer_ = Viewer::Ptr(new Viewer);
+    if (use_viewer_) {
+        viewer_ = Viewer::Ptr(
+            new Viewer(ThreadOptions::FromConfig(*config_, "viewer")));
+    }
 
     frontend_->SetBackend(backend_);
+    frontend_->SetThreadPool(thread_pool_);
     frontend_->SetMap(map_);
     frontend_->SetViewer(viewer_);
     frontend_->SetCameras(dataset_->GetCamera(0), dataset_->GetCamera(1));
+    if (config_->Get<int>("direct_tracking", 0)) {
+        DirectTracker::Options options;
+        options.levels = config_->Get<int>("direct_levels", options.levels);
+        options.half_patch =
+            config_->Get<int>("direct_half_patch", options.half_patch);
+        options.max_error =
+            config_->Get<double>("direct_max_error", options.max_error);
+        frontend_->SetTracker(Tracker::Ptr(
+            new DirectTracker(dataset_->GetCamera(0), options)));
+    }
 
     backend_->SetMap(map_);
     backend_->SetCameras(dataset_->GetCamera(0), dataset_->GetCamera(1));
 
-    viewer_->SetMap(map_);
+    if (viewer_) viewer_->SetMap(map_);
 
+    inited_ = true;
     return true;
 }
 
 void VisualOdometry::Run() {
+    if (apply_frontend_thread_options_) {
+        ApplyThreadOptions(frontend_thread_options_);
+    }
     while (1) {
         LOG(INFO) << "VO is running";
         if (Step() == false) {
@@ -48,7 +81,7 @@ void VisualOdometry::Run() {
     }
 
     backend_->Stop();
-    viewer_->Close();
+    if (viewer_) viewer_->Close();
 
     LOG(INFO) << "VO exit";
 }
@@ -63,6 +96,9 @@ bool VisualOdometry::Step() {
     auto time_used =
         std::chrono::duration_cast<std::chrono::duration<double>>(t2 - t1);
     LOG(INFO) << "VO cost time: " << time_used.count() << " seconds.";
+
+    tracking_time_ += time_used.count();
+    trajectory_.push_back(new_frame->Pose());
     return success;
 }
 
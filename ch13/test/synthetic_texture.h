@@ -0,0 +1,22 @@
+#pragma once
+#ifndef MYSLAM_TEST_SYNTHETIC_TEXTURE_H
+#define MYSLAM_TEST_SYNTHETIC_TEXTURE_H
+
+#include <cmath>
+
+// synthetic images shared by the tests, defined at any real position
+
+/// smooth texture so that sub-pixel shifts are well defined, 58 to 198
+inline double Texture(double x, double y) {
+    return 128 + 40 * std::sin(0.31 * x + 0.17 * y) +
+           30 * std::sin(0.13 * x - 0.29 * y + 1);
+}
+
+/// coarser texture that survives a 4 level pyramid, 15 to 205
+inline double CoarseTexture(double x, double y) {
+    return 110 + 45 * std::sin(0.11 * x + 0.07 * y) +
+           35 * std::sin(0.05 * x - 0.13 * y + 1) +
+           15 * std::sin(0.23 * x + 0.19 * y + 2);
+}
+
+#endif  // MYSLAM_TEST_SYNTHETIC_TEXTURE_H
@@ -0,0 +1,114 @@
+#include <gtest/gtest.h>
+#include <random>
+#include "myslam/bilinear.h"
+
+using myslam::BorderPolicy;
+
+// reference bilinear interpolation in double, pixels outside by the policy
+double Reference(const cv::Mat &img, double x, double y, BorderPolicy border) {
+    auto pixel = [&](int u, int v) -> double {
+        if (u < 0 || v < 0 || u >= img.cols || v >= img.rows) {
+            if (border == BorderPolicy::ZERO) return 0;
+            u = std::min(std::max(u, 0), img.cols - 1);
+            v = std::min(std::max(v, 0), img.rows - 1);
+        }
+        return img.at<uchar>(v, u);
+    };
+    const int u = int(std::floor(x)), v = int(std::floor(y));
+    const double ax = x - u, ay = y - v;
+    return (1 - ax) * (1 - ay) * pixel(u, v) + ax * (1 - ay) * pixel(u + 1, v) +
+           (1 - ax) * ay * pixel(u, v + 1) + ax * ay * pixel(u + 1, v + 1);
+}
+
+cv::Mat RandomImage(int rows, int cols, std::mt19937 &rng) {
+    std::uniform_int_distribution<int> value(0, 255);
+    cv::Mat img(rows, cols, CV_8UC1);
+    for (int v = 0; v < rows; ++v)
+        for (int u = 0; u < cols; ++u) img.at<uchar>(v, u) = uchar(value(rng));
+    return img;
+}
+
+TEST(MyslamTest, BilinearSingleAndBatch) {
+    std::mt19937 rng(3);
+    const cv::Mat img = RandomImage(37, 53, rng);
+    // a third of the points at or beyond the border
+    std::uniform_real_distribution<float> ux(-3, 56), uy(-3, 40);
+    const int n = 203;
+    std::vector<float> xs(n), ys(n);
+    for (int i = 0; i < n; ++i) {
+        xs[i] = ux(rng);
+        ys[i] = uy(rng);
+    }
+    xs[0] = 52;  // last column and row exactly
+    ys[0] = 36;
+
+    for (BorderPolicy border : {BorderPolicy::CLAMP, BorderPolicy::ZERO}) {
+        std::vector<float> values(n), gx(n), gy(n), values_only(n);
+        myslam::SampleBilinearBatch(img, xs.data(), ys.data(), n, values.data(),
+                                    gx.data(), gy.data(), border);
+        myslam::SampleBilinearBatch(img, xs.data(), ys.data(), n,
+                                    values_only.data(), nullptr, nullptr,
+                                    border);
+        for (int i = 0; i < n; ++i) {
+            const float x = xs[i], y = ys[i];
+            const double ref = Reference(img, x, y, border);
+            const double ref_gx = 0.5 * (Reference(img, x + 1, y, border) -
+                                         Reference(img, x - 1, y, border));
+            const double ref_gy = 0.5 * (Reference(img, x, y + 1, border) -
+                                         Reference(img, x, y - 1, border));
+            EXPECT_NEAR(myslam::SampleBilinear(img, x, y, border), ref, 1e-3);
+            float dx, dy;
+            EXPECT_NEAR(myslam::SampleBilinear(img, x, y, dx, dy, border), ref,
+                        1e-3);
+            EXPECT_NEAR(dx, ref_gx, 1e-3);
+            EXPECT_NEAR(dy, ref_gy, 1e-3);
+            EXPECT_NEAR(values[i], ref, 1e-3);
+            EXPECT_NEAR(values_only[i], ref, 1e-3);
+            EXPECT_NEAR(gx[i], ref_gx, 1e-3);
+            EXPECT_NEAR(gy[i], ref_gy, 1e-3);
+        }
+    }
+
+    // float images, e.g. precomputed gradients
+    cv::Mat img_float(img.rows, img.cols, CV_32FC1);
+    for (int v = 0; v < img.rows; ++v)
+        for (int u = 0; u < img.cols; ++u)
+            img_float.at<float>(v, u) = img.at<uchar>(v, u) * 0.5f - 20;
+    EXPECT_NEAR(myslam::SampleBilinear<float>(img_float, 10.3f, 7.8f),
+                Reference(img, 10.3, 7.8, BorderPolicy::CLAMP) * 0.5 - 20,
+                1e-3);
+}
+
+TEST(MyslamTest, BilinearPatch) {
+    std::mt19937 rng(5);
+    const cv::Mat img = RandomImage(40, 50, rng);
+    std::uniform_real_distribution<float> ux(-2, 52), uy(-2, 42);
+    for (int half : {1, 3, 8}) {
+        const int area = (2 * half + 1) * (2 * half + 1);
+        std::vector<float> values(area), gx(area), gy(area), values_only(area);
+        for (int k = 0; k < 50; ++k) {
+            const float x = ux(rng), y = uy(rng);
+            myslam::SampleBilinearPatch(img, x, y, half, values.data(),
+                                        gx.data(), gy.data());
+            myslam::SampleBilinearPatch(img, x, y, half, values_only.data());
+            for (int r = -half; r <= half; ++r) {
+                for (int c = -half; c <= half; ++c) {
+                    const int i = (r + half) * (2 * half + 1) + c + half;
+                    float dx, dy;
+                    const float ref =
+                        myslam::SampleBilinear(img, x + c, y + r, dx, dy);
+                    // fixed point weights inside the image
+                    EXPECT_NEAR(values[i], ref, 0.05);
+                    EXPECT_NEAR(values_only[i], ref, 0.05);
+                    EXPECT_NEAR(gx[i], dx, 0.05);
+                    EXPECT_NEAR(gy[i], dy, 0.05);
+                }
+            }
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,67 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include "myslam/direct_tracker.h"
+#include "myslam/feature.h"
+#include "myslam/mappoint.h"
+#include "synthetic_texture.h"
+
+TEST(MyslamTest, DirectTrackerPlane) {
+    const int width = 320, height = 240;
+    const double depth = 4;  // fronto-parallel plane in the keyframe camera
+    myslam::Camera::Ptr camera(new myslam::Camera(
+        300, 300, 160, 120, 0.5, SE3(SO3(), Vec3(0.1, 0, 0))));
+    const SE3 T_kf_w(SO3::exp(Vec3(0.02, -0.01, 0.03)), Vec3(0.3, 0, 0.1));
+    // motion of the left camera from the keyframe to the current frame
+    const SE3 T21(SO3::exp(Vec3(0.005, -0.01, 0.004)), Vec3(0.04, -0.02, 0.06));
+    const SE3 T12 = T21.inverse();
+    const double gain = 1.1, offset = 5;
+
+    cv::Mat img1(height, width, CV_8UC1), img2(height, width, CV_8UC1);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            img1.at<uchar>(y, x) = uchar(std::lround(CoarseTexture(x, y)));
+            // intersect the ray of (x, y) with the plane, keyframe pixel
+            Vec3 ray = T12.so3() * camera->pixel2camera(Vec2(x, y));
+            double s = (depth - T12.translation()[2]) / ray[2];
+            Vec2 px = camera->camera2pixel(s * ray + T12.translation());
+            img2.at<uchar>(y, x) =
+                uchar(std::lround(gain * CoarseTexture(px[0], px[1]) + offset));
+        }
+    }
+
+    // features link to map points by weak pointers, the test keeps them
+    myslam::Frame::Ptr keyframe(
+        new myslam::Frame(0, 0, T_kf_w, img1, cv::Mat()));
+    std::vector<myslam::MapPoint::Ptr> map_points;
+    for (int y = 20; y < height - 20; y += 12) {
+        for (int x = 20; x < width - 20; x += 12) {
+            Vec3 pw = camera->pixel2world(Vec2(x, y), T_kf_w, depth);
+            map_points.push_back(myslam::MapPoint::Ptr(
+                new myslam::MapPoint(map_points.size(), pw)));
+            myslam::Feature::Ptr feature(new myslam::Feature(
+                keyframe, cv::KeyPoint(cv::Point2f(x, y), 7)));
+            feature->map_point_ = map_points.back();
+            keyframe->features_left_.push_back(feature);
+        }
+    }
+
+    myslam::DirectTracker tracker(camera);
+    tracker.SetKeyframe(keyframe);
+    myslam::Frame::Ptr current(
+        new myslam::Frame(1, 0.1, T_kf_w, img2, cv::Mat()));
+    int inliers = tracker.Track(current);
+
+    const SE3 T_cur_w = camera->pose_inv_ * T21 * camera->pose() * T_kf_w;
+    EXPECT_GT(inliers, 0.9 * keyframe->features_left_.size());
+    EXPECT_LT((current->Pose().translation() - T_cur_w.translation()).norm(),
+              5e-3);
+    EXPECT_LT((current->Pose().so3() * T_cur_w.so3().inverse()).log().norm(),
+              1e-3);
+    EXPECT_NEAR(tracker.BrightnessA(), std::log(gain), 0.02);
+    EXPECT_NEAR(tracker.BrightnessB(), offset, 3);
+}
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
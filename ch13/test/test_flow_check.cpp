@@ -0,0 +1,73 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include "myslam/flow_check.h"
+#include "synthetic_texture.h"
+
+// img2 is img1 moved by (shift_x, shift_y) with a gain and an offset
+void MakeImages(double shift_x, double shift_y, cv::Mat &img1, cv::Mat &img2) {
+    const int width = 160, height = 120;
+    img1 = cv::Mat(height, width, CV_8UC1);
+    img2 = cv::Mat(height, width, CV_8UC1);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            img1.at<uchar>(y, x) = uchar(std::lround(Texture(x, y)));
+            img2.at<uchar>(y, x) = uchar(std::lround(
+                1.2 * Texture(x - shift_x, y - shift_y) + 10));
+        }
+    }
+}
+
+TEST(MyslamTest, FlowCheckNCC) {
+    cv::Mat img1, img2;
+    MakeImages(3.5, -2.25, img1, img2);
+    int cnt_total = 0;
+    for (int y = 20; y < 100; y += 11) {
+        for (int x = 20; x < 140; x += 13) {
+            cv::Point2f pt1(x, y), pt2(x + 3.5f, y - 2.25f);
+            // invariant to the gain and offset
+            EXPECT_GT(myslam::FlowCheck::PatchNCC(img1, pt1, img2, pt2, 3),
+                      0.98);
+            // a wrong track, half a period of the texture away
+            EXPECT_LT(myslam::FlowCheck::PatchNCC(img1, pt1, img2,
+                                                  pt2 + cv::Point2f(10, 0), 3),
+                      0.5);
+            cnt_total++;
+        }
+    }
+    EXPECT_GT(cnt_total, 50);
+
+    cv::Mat flat(120, 160, CV_8UC1, cv::Scalar(100));
+    EXPECT_EQ(myslam::FlowCheck::PatchNCC(flat, cv::Point2f(50, 50), img2,
+                                          cv::Point2f(50, 50), 3),
+              0);
+}
+
+TEST(MyslamTest, FlowCheckForwardBackward) {
+    cv::Mat img1, img2;
+    MakeImages(3.5, -2.25, img1, img2);
+    const cv::Point2f pt1(60, 50), pt2(63.5f, 47.75f);
+
+    myslam::FlowCheck check;
+    float ncc = 0;
+    EXPECT_FALSE(check.Enabled());
+    EXPECT_TRUE(check.Check(img1, img2, pt1, pt2, cv::Point2f(), ncc));
+    EXPECT_EQ(ncc, 1);
+
+    check.forward_backward = true;
+    check.max_fb_error = 1.0;
+    EXPECT_TRUE(check.Check(img1, img2, pt1, pt2,
+                            pt1 + cv::Point2f(0.5f, -0.5f), ncc));
+    EXPECT_FALSE(
+        check.Check(img1, img2, pt1, pt2, pt1 + cv::Point2f(2, 0), ncc));
+
+    check.min_ncc = 0.9;
+    EXPECT_TRUE(check.Check(img1, img2, pt1, pt2, pt1, ncc));
+    EXPECT_GT(ncc, 0.98);
+    EXPECT_FALSE(check.Check(img1, img2, pt1, pt2 + cv::Point2f(10, 0),
+                             pt1, ncc));
+}
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,53 @@
+#include <gtest/gtest.h>
+#include "myslam/common_include.h"
+#include "myslam/g2o_types.h"
+
+// analytic jacobian of the stereo pose-only edge against central differences
+// of computeError, with the left multiplied update of VertexPose
+TEST(MyslamTest, StereoProjectionPoseOnlyJacobian) {
+    Mat33 K;
+    K << 718.9, 0, 607.2, 0, 718.9, 185.2, 0, 0, 1;
+    const double baseline = 0.537;
+    const SE3 pose(SO3::exp(Vec3(0.1, -0.2, 0.05)), Vec3(0.3, -0.1, 0.5));
+    const Vec3 points[] = {Vec3(1, -2, 15), Vec3(-4, 1.5, 8),
+                           Vec3(0.2, 0.3, 3)};
+
+    for (const Vec3 &point : points) {
+        myslam::VertexPose vertex;
+        vertex.setEstimate(pose);
+        myslam::EdgeStereoProjectionPoseOnly edge(point, K, baseline);
+        edge.setVertex(0, &vertex);
+        edge.setMeasurement(Vec3(600, 180, 570));
+        edge.linearizeOplus();
+        const Eigen::Matrix<double, 3, 6> analytic = edge.jacobianOplusXi();
+
+        const double eps = 1e-6;
+        Eigen::Matrix<double, 3, 6> numeric;
+        for (int k = 0; k < 6; ++k) {
+            Vec6 delta = Vec6::Zero();
+            delta[k] = eps;
+            vertex.setEstimate(pose);
+            vertex.oplusImpl(delta.data());
+            edge.computeError();
+            const Vec3 error_plus = edge.error();
+            delta[k] = -eps;
+            vertex.setEstimate(pose);
+            vertex.oplusImpl(delta.data());
+            edge.computeError();
+            numeric.col(k) = (error_plus - edge.error()) / (2 * eps);
+        }
+
+        for (int i = 0; i < 3; ++i) {
+            for (int k = 0; k < 6; ++k) {
+                EXPECT_NEAR(analytic(i, k), numeric(i, k),
+                            1e-4 * (1 + std::abs(numeric(i, k))))
+                    << "row " << i << " col " << k;
+            }
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,102 @@
+#include <gtest/gtest.h>
+#include <Eigen/Cholesky>
+#include <cstring>
+#include <random>
+#include "myslam/normal_equations.h"
+
+typedef myslam::NormalEquations<6> NormalEquations6;
+typedef Eigen::Matrix<double, 6, 1> Vector6;
+
+namespace {
+
+/// a linear least squares problem e_i = J_i^T x - y_i with known x
+struct LinearProblem {
+    std::vector<Vector6, Eigen::aligned_allocator<Vector6>> jacobians;
+    std::vector<double> observations;
+    Vector6 x;
+
+    explicit LinearProblem(int n) {
+        std::mt19937 rng(7);
+        std::normal_distribution<double> noise(0, 1);
+        for (int k = 0; k < 6; ++k) x[k] = noise(rng);
+        for (int i = 0; i < n; ++i) {
+            Vector6 J;
+            for (int k = 0; k < 6; ++k) J[k] = 100 * noise(rng);
+            jacobians.push_back(J);
+            observations.push_back(J.dot(x) + 1e-3 * noise(rng));
+        }
+    }
+
+    /// residuals at zero, every other one counted as inlier
+    void Accumulate(int begin, int end, NormalEquations6 &eq) const {
+        for (int i = begin; i < end; ++i) {
+            eq.Add(jacobians[i], -observations[i]);
+            if (i % 2 == 0) ++eq.num_inliers;
+        }
+    }
+};
+
+bool BitwiseEqual(const NormalEquations6 &a, const NormalEquations6 &b) {
+    return std::memcmp(a.H.data(), b.H.data(), sizeof(double) * 36) == 0 &&
+           std::memcmp(a.b.data(), b.b.data(), sizeof(double) * 6) == 0 &&
+           std::memcmp(&a.cost, &b.cost, sizeof(double)) == 0 &&
+           a.num_residuals == b.num_residuals &&
+           a.num_inliers == b.num_inliers;
+}
+
+}  // namespace
+
+TEST(MyslamTest, NormalEquationsSolve) {
+    const int n = 10007;
+    LinearProblem problem(n);
+    myslam::NormalEquationsReducer<6> reducer(64);
+    NormalEquations6 eq =
+        reducer.Reduce(0, n, [&](int begin, int end, NormalEquations6 &e) {
+            problem.Accumulate(begin, end, e);
+        });
+
+    EXPECT_EQ(eq.num_residuals, n);
+    EXPECT_EQ(eq.num_inliers, (n + 1) / 2);
+    EXPECT_LT((eq.H - eq.H.transpose()).norm(), 1e-12 * eq.H.norm());
+    Vector6 dx = eq.H.ldlt().solve(eq.b);
+    EXPECT_LT((dx - problem.x).norm(), 1e-5);
+
+    // same sums as a serial accumulation up to rounding
+    NormalEquations6 serial;
+    problem.Accumulate(0, n, serial);
+    serial.Symmetrize();
+    EXPECT_LT((serial.H - eq.H).norm(), 1e-12 * serial.H.norm());
+    EXPECT_NEAR(serial.cost, eq.cost, 1e-12 * serial.cost);
+}
+
+TEST(MyslamTest, NormalEquationsDeterministic) {
+    const int n = 5003;
+    LinearProblem problem(n);
+    auto accumulate = [&](int begin, int end, NormalEquations6 &e) {
+        problem.Accumulate(begin, end, e);
+    };
+
+    const int threads_before = cv::getNumThreads();
+    myslam::NormalEquationsReducer<6> reducer(32);
+    cv::setNumThreads(1);
+    const NormalEquations6 reference = reducer.Reduce(0, n, accumulate);
+    for (int threads : {2, 3, 4, 8, 16}) {
+        cv::setNumThreads(threads);
+        for (int repeat = 0; repeat < 5; ++repeat) {
+            EXPECT_TRUE(
+                BitwiseEqual(reference, reducer.Reduce(0, n, accumulate)))
+                << "threads " << threads;
+        }
+    }
+    cv::setNumThreads(threads_before);
+
+    // empty range
+    const NormalEquations6 &empty = reducer.Reduce(0, 0, accumulate);
+    EXPECT_EQ(empty.num_residuals, 0);
+    EXPECT_EQ(empty.cost, 0);
+}
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
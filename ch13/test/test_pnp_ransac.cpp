@@ -0,0 +1,66 @@
+#include <gtest/gtest.h>
+#include <random>
+#include "myslam/common_include.h"
+#include "myslam/pnp_ransac.h"
+
+TEST(MyslamTest, P3P) {
+    SE3 Tcw(SO3::exp(Vec3(0.1, -0.3, 0.2)), Vec3(0.5, -0.2, 1.0));
+    Vec3 points_camera[3] = {Vec3(-2, 1, 8), Vec3(3, -1, 12), Vec3(1, 2, 6)};
+    Vec3 points_world[3], bearings[3];
+    for (int i = 0; i < 3; ++i) {
+        points_world[i] = Tcw.inverse() * points_camera[i];
+        bearings[i] = points_camera[i].normalized();
+    }
+
+    std::vector<SE3> poses;
+    EXPECT_GT(myslam::SolveP3P(points_world, bearings, poses), 0);
+    double min_error = 1e9;
+    for (auto &pose : poses) {
+        min_error =
+            std::min(min_error, (pose.matrix() - Tcw.matrix()).norm());
+    }
+    EXPECT_LT(min_error, 1e-6);
+}
+
+TEST(MyslamTest, PnPRansacWithOutliers) {
+    Mat33 K;
+    K << 718.9, 0, 607.2, 0, 718.9, 185.2, 0, 0, 1;
+    SE3 Tcw(SO3::exp(Vec3(0.05, -0.1, 0.02)), Vec3(0.2, -0.1, 1.5));
+
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<double> uniform(-1, 1);
+    std::vector<Vec3> points_world;
+    myslam::VecVec2 pixels;
+    std::vector<bool> is_inlier;
+    for (int i = 0; i < 300; ++i) {
+        Vec3 pc(10 * uniform(rng), 3 * uniform(rng), 20 + 15 * uniform(rng));
+        points_world.push_back(Tcw.inverse() * pc);
+        Vec3 uv = K * pc / pc[2];
+        // half of the correspondences are wrong
+        bool inlier = i % 2 == 0;
+        is_inlier.push_back(inlier);
+        pixels.push_back(inlier ? Vec2(uv[0], uv[1])
+                                : Vec2(607 + 600 * uniform(rng),
+                                       185 + 180 * uniform(rng)));
+    }
+
+    myslam::PnPRansac ransac(K);
+    ransac.SetCorrespondences(points_world, pixels);
+    SE3 pose;
+    std::vector<bool> inliers;
+    int cnt_inliers = ransac.Estimate(pose, inliers);
+    EXPECT_GE(cnt_inliers, 150);
+    EXPECT_LT(ransac.LastIterations(), 200);
+    EXPECT_LT((pose.matrix() - Tcw.matrix()).norm(), 1e-3);
+    for (size_t i = 0; i < inliers.size(); ++i) {
+        if (is_inlier[i]) {
+            EXPECT_TRUE(inliers[i]);
+        }
+    }
+    EXPECT_EQ(cnt_inliers, ransac.CountInliers(pose));
+}
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,45 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include "myslam/common_include.h"
+#include "myslam/stereo_matcher.h"
+#include "synthetic_texture.h"
+
+TEST(MyslamTest, StereoMatcherSubPixel) {
+    const int width = 320, height = 120;
+    const double disparity = 17.3;
+    cv::Mat left(height, width, CV_8UC1), right(height, width, CV_8UC1);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            left.at<uchar>(y, x) = uchar(std::lround(Texture(x, y)));
+            right.at<uchar>(y, x) =
+                uchar(std::lround(Texture(x + disparity, y)));
+        }
+    }
+
+    myslam::StereoMatcher matcher(64);
+    int cnt_matched = 0, cnt_total = 0;
+    for (int y = 10; y < height - 10; y += 7) {
+        for (int x = 40; x < width - 10; x += 9) {
+            cv::Point2f pt_left(x, y), pt_right;
+            cnt_total++;
+            if (matcher.Match(left, right, pt_left, pt_right)) {
+                cnt_matched++;
+                EXPECT_NEAR(pt_left.x - pt_right.x, disparity, 0.2);
+                EXPECT_FLOAT_EQ(pt_left.y, pt_right.y);
+            }
+        }
+    }
+    EXPECT_GT(cnt_matched, cnt_total * 0.9);
+}
+
+TEST(MyslamTest, StereoMatcherRejectsTexturelessPatch) {
+    cv::Mat flat(120, 320, CV_8UC1, cv::Scalar(100));
+    myslam::StereoMatcher matcher(64);
+    cv::Point2f pt_right;
+    EXPECT_FALSE(matcher.Match(flat, flat, cv::Point2f(100, 50), pt_right));
+}
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
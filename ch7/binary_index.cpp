@@ -0,0 +1,124 @@
+#include "binary_index.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+MultiIndexHashing::MultiIndexHashing(const Options &options)
+    : options_(options), heads_(kNumTables * kNumBuckets, -1) {
+  // probe masks of every substring radius that can be searched
+  const int max_weight = min(max(options_.max_substring_radius, 0), 16);
+  masks_by_weight_.resize(max_weight + 1);
+  for (int mask = 0; mask < kNumBuckets; ++mask) {
+    int weight = __builtin_popcount(mask);
+    if (weight <= max_weight) masks_by_weight_[weight].push_back(uint16_t(mask));
+  }
+}
+
+void MultiIndexHashing::Clear() {
+  descriptors_.clear();
+  valid_.clear();
+  next_.clear();
+  fill(heads_.begin(), heads_.end(), -1);
+}
+
+void MultiIndexHashing::Build(const DescriptorMatrix &descriptors) {
+  Clear();
+  descriptors_.reserve(descriptors.rows());
+  valid_.reserve(descriptors.rows());
+  next_.reserve(descriptors.rows() * kNumTables);
+  for (int i = 0; i < descriptors.rows(); ++i) {
+    Append(descriptors.row(i), descriptors.valid(i));
+  }
+}
+
+int MultiIndexHashing::Insert(const uint8_t *descriptor) {
+  return Append(descriptor, true);
+}
+
+int MultiIndexHashing::Append(const uint8_t *descriptor, bool valid) {
+  const int id = Size();
+  Descriptor d;
+  memcpy(d.data(), descriptor, DescriptorMatrix::kBytes);
+  descriptors_.push_back(d);
+  valid_.push_back(valid);
+  for (int t = 0; t < kNumTables; ++t) {
+    // invalid descriptors keep their id but are in no bucket
+    if (!valid) {
+      next_.push_back(-1);
+      continue;
+    }
+    int &head = heads_[t * kNumBuckets + Substring(d, t)];
+    next_.push_back(head);
+    head = id;
+  }
+  return id;
+}
+
+int MultiIndexHashing::KnnSearch(const Descriptor &query, int k, vector<cv::DMatch> &neighbors, int query_idx,
+                                 vector<uint32_t> &visited, uint32_t stamp) const {
+  neighbors.clear();
+  if (k <= 0) return 0;
+  neighbors.reserve(k + 1);
+
+  uint16_t keys[kNumTables];
+  for (int t = 0; t < kNumTables; ++t) keys[t] = Substring(query, t);
+
+  int checked = 0;
+  for (int s = 0; s < int(masks_by_weight_.size()); ++s) {
+    for (int t = 0; t < kNumTables; ++t) {
+      const int *heads = heads_.data() + t * kNumBuckets;
+      for (uint16_t mask : masks_by_weight_[s]) {
+        for (int id = heads[keys[t] ^ mask]; id >= 0; id = next_[id * kNumTables + t]) {
+          if (visited[id] == stamp) continue;
+          visited[id] = stamp;
+          ++checked;
+          const Descriptor &d = descriptors_[id];
+          int dist = __builtin_popcountll(d[0] ^ query[0]) + __builtin_popcountll(d[1] ^ query[1]) +
+                     __builtin_popcountll(d[2] ^ query[2]) + __builtin_popcountll(d[3] ^ query[3]);
+          if (dist >= options_.max_distance) continue;
+          if (int(neighbors.size()) == k && dist >= neighbors.back().distance) continue;
+          cv::DMatch m(query_idx, id, float(dist));
+          neighbors.insert(upper_bound(neighbors.begin(), neighbors.end(), m), m);
+          if (int(neighbors.size()) > k) neighbors.pop_back();
+        }
+      }
+    }
+
+    // every descriptor closer than 16 * (s + 1) has been seen, the unseen ones cannot enter the result
+    int bound = int(neighbors.size()) == k ? int(neighbors.back().distance) + 1 : options_.max_distance;
+    if (bound <= kNumTables * (s + 1)) break;
+  }
+  return checked;
+}
+
+int MultiIndexHashing::KnnSearch(const uint8_t *query, int k, vector<cv::DMatch> &neighbors, int query_idx) const {
+  Descriptor q;
+  memcpy(q.data(), query, DescriptorMatrix::kBytes);
+  // visited marks of this thread, kept across queries and indexes, a new stamp per query so they are never cleared
+  thread_local vector<uint32_t> visited;
+  thread_local uint32_t stamp = 0;
+  if (visited.size() < descriptors_.size()) visited.resize(descriptors_.size(), 0);
+  if (++stamp == 0) {
+    fill(visited.begin(), visited.end(), 0);
+    stamp = 1;
+  }
+  return KnnSearch(q, k, neighbors, query_idx, visited, stamp);
+}
+
+void MultiIndexHashing::KnnMatch(const DescriptorMatrix &queries, int k,
+                                 vector<vector<cv::DMatch>> &matches) const {
+  matches.assign(queries.rows(), vector<cv::DMatch>());
+  cv::parallel_for_(cv::Range(0, queries.rows()), [&](const cv::Range &range) {
+    // the visited marks are reused by all queries of this range, a new stamp per query
+    vector<uint32_t> visited(Size(), 0);
+    uint32_t stamp = 0;
+    for (int i = range.start; i < range.end; ++i) {
+      if (!queries.valid(i)) continue;
+      Descriptor q;
+      memcpy(q.data(), queries.row(i), DescriptorMatrix::kBytes);
+      KnnSearch(q, k, matches[i], i, visited, ++stamp);
+    }
+  });
+}
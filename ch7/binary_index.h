@@ -0,0 +1,77 @@
+#pragma once
+
+#include <opencv2/core/core.hpp>
+#include <array>
+#include <cstdint>
+#include <vector>
+#include "hamming_matcher.h"
+
+/**
+ * Multi-index hashing (Norouzi et al., "Fast search in hamming space with multi-index hashing", CVPR 2012)
+ * for 256 bit descriptors.
+ *
+ * Every descriptor is cut into 16 substrings of 16 bits, each substring is the key of its own hash table.
+ * If two descriptors differ by d bits, at least one of the substrings differs by at most d / 16 bits, so a query
+ * probes the buckets within substring radius s = 0, 1, 2, ... of its own substrings, and after radius s every
+ * descriptor closer than 16 * (s + 1) bits has been seen. The search stops when the k-th neighbor is provably
+ * found, or when max_substring_radius is reached (approximate search beyond 16 * (max_substring_radius + 1) bits).
+ * The tables are direct addressed (65536 buckets each), a bucket is a linked list of ids so insertion is O(1).
+ */
+class MultiIndexHashing {
+public:
+  struct Options {
+    int max_substring_radius = 2;  // exact up to 16 * (max_substring_radius + 1) - 1 bits
+    int max_distance = 256;        // neighbors with distance >= max_distance are not returned
+  };
+
+  static const int kNumTables = 16;
+  static const int kNumBuckets = 1 << 16;
+
+  MultiIndexHashing() : MultiIndexHashing(Options()) {}
+
+  explicit MultiIndexHashing(const Options &options);
+
+  /// remove all descriptors
+  void Clear();
+
+  /// index all rows of descriptors, the id of a descriptor is its row, invalid rows are stored but never returned
+  void Build(const DescriptorMatrix &descriptors);
+
+  /// add one 32 byte descriptor, returns its id
+  int Insert(const uint8_t *descriptor);
+
+  /// number of stored descriptors
+  int Size() const { return int(descriptors_.size()); }
+
+  /**
+   * k nearest neighbors of one descriptor, sorted by distance
+   * @param query 32 byte descriptor
+   * @param k number of neighbors
+   * @param neighbors trainIdx is the id, queryIdx is set to query_idx
+   * @return number of candidates whose full distance was computed
+   */
+  int KnnSearch(const uint8_t *query, int k, std::vector<cv::DMatch> &neighbors, int query_idx = 0) const;
+
+  /// k nearest neighbors of every valid row of queries, processed in parallel
+  void KnnMatch(const DescriptorMatrix &queries, int k, std::vector<std::vector<cv::DMatch>> &matches) const;
+
+private:
+  typedef std::array<uint64_t, 4> Descriptor;
+
+  static uint16_t Substring(const Descriptor &d, int table) {
+    return uint16_t(d[table / 4] >> (16 * (table % 4)));
+  }
+
+  /// store a descriptor, only valid ones are added to the tables
+  int Append(const uint8_t *descriptor, bool valid);
+
+  int KnnSearch(const Descriptor &query, int k, std::vector<cv::DMatch> &neighbors, int query_idx,
+                std::vector<uint32_t> &visited, uint32_t stamp) const;
+
+  Options options_;
+  std::vector<Descriptor> descriptors_;
+  std::vector<uint8_t> valid_;
+  std::vector<int> heads_;  // first id of every bucket of every table, -1 if empty
+  std::vector<int> next_;   // next id in the same bucket, kNumTables per id
+  std::vector<std::vector<uint16_t>> masks_by_weight_;  // 16 bit masks grouped by their popcount
+};
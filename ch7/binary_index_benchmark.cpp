@@ -0,0 +1,140 @@
+#include <opencv2/opencv.hpp>
+#include <chrono>
+#include <iomanip>
+#include <string>
+#include "binary_index.h"
+#include "hamming_matcher.h"
+#include "orb_extractor.h"
+
+using namespace std;
+
+/**
+ * Recall and throughput of MultiIndexHashing against brute force HammingMatcher:
+ * the descriptors of the first image are indexed, the descriptors of the second image are the queries.
+ * An index filled by Insert must return the same neighbors as Build, the program exits non zero otherwise.
+ * usage: binary_index_benchmark [img1 img2 num_features]
+ */
+
+// global variables
+string first_file = "./1.png";
+string second_file = "./2.png";
+
+double Seconds(chrono::steady_clock::time_point t1, chrono::steady_clock::time_point t2) {
+  return chrono::duration_cast<chrono::duration<double>>(t2 - t1).count();
+}
+
+int main(int argc, char **argv) {
+  int num_features = 2000;
+  if (argc >= 3) {
+    first_file = argv[1];
+    second_file = argv[2];
+  }
+  if (argc >= 4) num_features = atoi(argv[3]);
+
+  cv::Mat first_image = cv::imread(first_file, 0);
+  cv::Mat second_image = cv::imread(second_file, 0);
+  assert(first_image.data != nullptr && second_image.data != nullptr);
+
+  ORBExtractor::Options extractor_options;
+  extractor_options.num_features = num_features;
+  ORBExtractor extractor(extractor_options);
+  vector<cv::KeyPoint> keypoints1, keypoints2;
+  DescriptorMatrix train, query;
+  extractor.Extract(first_image, keypoints1, train);
+  extractor.Extract(second_image, keypoints2, query);
+  cout << "train descriptors: " << train.numValid() << ", queries: " << query.numValid() << endl;
+
+  const int k = 2;
+  const int repeat = 10;
+
+  // brute force reference
+  HammingMatcher matcher;
+  vector<vector<cv::DMatch>> knn_bf;
+  chrono::steady_clock::time_point t1 = chrono::steady_clock::now();
+  for (int r = 0; r < repeat; ++r) matcher.KnnMatch(query, train, k, knn_bf);
+  chrono::steady_clock::time_point t2 = chrono::steady_clock::now();
+  double time_bf = Seconds(t1, t2) / repeat;
+  cout << "brute force (" << HammingMatcher::KernelName() << "): " << time_bf * 1e3 << " ms, "
+       << query.numValid() / time_bf << " queries/s" << endl;
+
+  // queries with a good nearest neighbor, the ones that matter for matching
+  const int good_distance = 50;
+  int num_good = 0;
+  for (auto &knn : knn_bf) {
+    if (!knn.empty() && knn[0].distance < good_distance) ++num_good;
+  }
+
+  // Build stores invalid rows but never returns them, Insert only takes the valid ones
+  vector<int> valid_rows;  // train row of every inserted id
+  for (int i = 0; i < train.rows(); ++i)
+    if (train.valid(i)) valid_rows.push_back(i);
+
+  bool same_index = true;
+  cout << "radius  build(ms)  insert(ms)  query(ms)  queries/s  speedup  candidates  recall@1  recall@" << k
+       << "  recall@1(d<" << good_distance << ")  insert==build" << endl;
+  for (int radius = 0; radius <= 3; ++radius) {
+    MultiIndexHashing::Options options;
+    options.max_substring_radius = radius;
+    MultiIndexHashing index(options);
+
+    t1 = chrono::steady_clock::now();
+    index.Build(train);
+    t2 = chrono::steady_clock::now();
+    double time_build = Seconds(t1, t2);
+
+    MultiIndexHashing incremental(options);
+    t1 = chrono::steady_clock::now();
+    for (int row : valid_rows) incremental.Insert(train.row(row));
+    t2 = chrono::steady_clock::now();
+    double time_insert = Seconds(t1, t2);
+
+    vector<vector<cv::DMatch>> knn;
+    t1 = chrono::steady_clock::now();
+    for (int r = 0; r < repeat; ++r) index.KnnMatch(query, k, knn);
+    t2 = chrono::steady_clock::now();
+    double time_query = Seconds(t1, t2) / repeat;
+
+    // incremental insertion must give the same neighbors, ids mapped back to train rows
+    vector<vector<cv::DMatch>> knn_incremental;
+    incremental.KnnMatch(query, k, knn_incremental);
+    bool same = knn_incremental.size() == knn.size();
+    for (size_t i = 0; same && i < knn.size(); ++i) {
+      same = knn_incremental[i].size() == knn[i].size();
+      for (size_t j = 0; same && j < knn[i].size(); ++j) {
+        same = valid_rows[knn_incremental[i][j].trainIdx] == knn[i][j].trainIdx &&
+               knn_incremental[i][j].distance == knn[i][j].distance;
+      }
+    }
+    same_index &= same;
+
+    // a neighbor is recalled if its distance equals the brute force one (ties are interchangeable)
+    long candidates = 0;
+    int hit1 = 0, hitk = 0, hit_good = 0;
+    vector<cv::DMatch> neighbors;
+    for (int i = 0; i < query.rows(); ++i) {
+      if (!query.valid(i)) continue;
+      candidates += index.KnnSearch(query.row(i), k, neighbors, i);
+      const vector<cv::DMatch> &ref = knn_bf[i];
+      if (ref.empty()) continue;
+      bool same1 = !knn[i].empty() && knn[i][0].distance == ref[0].distance;
+      bool samek = knn[i].size() == ref.size();
+      for (size_t j = 0; samek && j < ref.size(); ++j) samek = knn[i][j].distance == ref[j].distance;
+      hit1 += same1;
+      hitk += samek;
+      if (ref[0].distance < good_distance) hit_good += same1;
+    }
+
+    const int n = query.numValid();
+    cout << setw(6) << radius << setw(11) << time_build * 1e3 << setw(12) << time_insert * 1e3
+         << setw(11) << time_query * 1e3 << setw(11) << int(n / time_query) << setw(9) << time_bf / time_query
+         << setw(12) << double(candidates) / n / train.numValid() << setw(10) << double(hit1) / n
+         << setw(10) << double(hitk) / n << setw(16) << double(hit_good) / max(num_good, 1) << setw(15)
+         << (same ? "yes" : "NO") << endl;
+  }
+  cout << "candidates: fraction of the train descriptors whose distance was computed per query" << endl;
+  if (!same_index) {
+    cout << "the index filled by Insert differs from Build" << endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,162 @@
+#include <opencv2/opencv.hpp>
+#include <benchmark/benchmark.h>
+#include <map>
+#include <string>
+#include "benchmark_support.h"
+#include "orb_extractor.h"
+
+using namespace std;
+
+/**
+ * Feature extraction micro benchmarks, to choose the extractor of a VO frontend on a given machine:
+ * - OrbSelf: ORBExtractor::Extract, pyramid + grid FAST + quadtree + descriptors (orb_self)
+ * - CvOrb: cv::ORB::detectAndCompute (orb_cv)
+ * - Fast: cv::FAST with non maximum suppression, the best responses kept
+ * - Gftt: cv::GFTTDetector with the parameters of the ch13 frontend
+ * - OrbSelfDescribe / CvOrbDescribe: descriptors only, on the FAST corners of the image
+ * Every benchmark runs over image scales (percent of the input), keypoint budgets and OpenCV thread counts, and
+ * reports the keypoints found and the pixels per second.
+ * usage: extractor_benchmark [image] [google benchmark flags]
+ * the results are written to extractor_benchmark.json unless --benchmark_out is given
+ */
+
+namespace {
+
+string image_file = "./1.png";
+
+/// gray input image scaled by percent, cached per scale
+const cv::Mat &Image(int percent) {
+  static map<int, cv::Mat> cache;
+  auto it = cache.find(percent);
+  if (it != cache.end()) return it->second;
+
+  static cv::Mat original;
+  if (original.empty()) original = BenchmarkImage(image_file);
+  cv::Mat scaled;
+  cv::resize(original, scaled, cv::Size(), percent / 100.0, percent / 100.0, cv::INTER_LINEAR);
+  return cache[percent] = scaled;
+}
+
+void ReportCounters(benchmark::State &state, const cv::Mat &img, size_t keypoints) {
+  state.SetItemsProcessed(state.iterations() * int64_t(img.total()));
+  state.counters["keypoints"] = double(keypoints);
+  state.counters["width"] = img.cols;
+  state.counters["height"] = img.rows;
+}
+
+/// FAST corners of an image, the input of the descriptor benchmarks
+vector<cv::KeyPoint> FastCorners(const cv::Mat &img, int budget) {
+  vector<cv::KeyPoint> keypoints;
+  cv::FAST(img, keypoints, 20, true);
+  cv::KeyPointsFilter::retainBest(keypoints, budget);
+  for (auto &kp : keypoints) kp.size = 31;  // cv::ORB's patch size, so it keeps the keypoints away from the border
+  return keypoints;
+}
+
+// arguments: image scale in percent, keypoint budget, threads
+
+void BM_OrbSelf(benchmark::State &state) {
+  const cv::Mat &img = Image(state.range(0));
+  ScopedThreads threads(state.range(2));
+  ORBExtractor::Options options;
+  options.num_features = state.range(1);
+  ORBExtractor extractor(options);
+  vector<cv::KeyPoint> keypoints;
+  DescriptorMatrix descriptors;
+  for (auto _ : state) {
+    extractor.Extract(img, keypoints, descriptors);
+    benchmark::DoNotOptimize(descriptors);
+  }
+  ReportCounters(state, img, keypoints.size());
+}
+
+void BM_CvOrb(benchmark::State &state) {
+  const cv::Mat &img = Image(state.range(0));
+  ScopedThreads threads(state.range(2));
+  cv::Ptr<cv::ORB> orb = cv::ORB::create(state.range(1));
+  vector<cv::KeyPoint> keypoints;
+  cv::Mat descriptors;
+  for (auto _ : state) {
+    orb->detectAndCompute(img, cv::Mat(), keypoints, descriptors);
+    benchmark::DoNotOptimize(descriptors.data);
+  }
+  ReportCounters(state, img, keypoints.size());
+}
+
+void BM_Fast(benchmark::State &state) {
+  const cv::Mat &img = Image(state.range(0));
+  ScopedThreads threads(state.range(2));
+  vector<cv::KeyPoint> keypoints;
+  for (auto _ : state) {
+    cv::FAST(img, keypoints, 20, true);
+    cv::KeyPointsFilter::retainBest(keypoints, state.range(1));
+    benchmark::DoNotOptimize(keypoints.data());
+  }
+  ReportCounters(state, img, keypoints.size());
+}
+
+void BM_Gftt(benchmark::State &state) {
+  const cv::Mat &img = Image(state.range(0));
+  ScopedThreads threads(state.range(2));
+  cv::Ptr<cv::GFTTDetector> gftt = cv::GFTTDetector::create(state.range(1), 0.01, 20);
+  vector<cv::KeyPoint> keypoints;
+  for (auto _ : state) {
+    gftt->detect(img, keypoints);
+    benchmark::DoNotOptimize(keypoints.data());
+  }
+  ReportCounters(state, img, keypoints.size());
+}
+
+void BM_OrbSelfDescribe(benchmark::State &state) {
+  const cv::Mat &img = Image(state.range(0));
+  ScopedThreads threads(state.range(2));
+  const vector<cv::KeyPoint> corners = FastCorners(img, state.range(1));
+  ORBDescriptorEngine engine;
+  vector<cv::KeyPoint> keypoints;
+  DescriptorMatrix descriptors;
+  for (auto _ : state) {
+    keypoints = corners;
+    engine.Compute(img, keypoints, descriptors);
+    benchmark::DoNotOptimize(descriptors);
+  }
+  ReportCounters(state, img, keypoints.size());
+}
+
+void BM_CvOrbDescribe(benchmark::State &state) {
+  const cv::Mat &img = Image(state.range(0));
+  ScopedThreads threads(state.range(2));
+  const vector<cv::KeyPoint> corners = FastCorners(img, state.range(1));
+  cv::Ptr<cv::ORB> orb = cv::ORB::create();
+  vector<cv::KeyPoint> keypoints;
+  cv::Mat descriptors;
+  for (auto _ : state) {
+    keypoints = corners;
+    orb->compute(img, keypoints, descriptors);
+    benchmark::DoNotOptimize(descriptors.data);
+  }
+  ReportCounters(state, img, keypoints.size());
+}
+
+/// image scales x keypoint budgets x thread counts
+void Sweep(benchmark::internal::Benchmark *b) {
+  b->ArgNames({"scale", "budget", "threads"});
+  for (int scale : {50, 100, 200}) {
+    for (int budget : {500, 1000, 2000}) {
+      AddThreadCounts(b, {scale, budget});
+    }
+  }
+  b->Unit(benchmark::kMillisecond)->UseRealTime();
+}
+
+BENCHMARK(BM_OrbSelf)->Apply(Sweep);
+BENCHMARK(BM_CvOrb)->Apply(Sweep);
+BENCHMARK(BM_Fast)->Apply(Sweep);
+BENCHMARK(BM_Gftt)->Apply(Sweep);
+BENCHMARK(BM_OrbSelfDescribe)->Apply(Sweep);
+BENCHMARK(BM_CvOrbDescribe)->Apply(Sweep);
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  return RunBenchmarks(argc, argv, image_file, "extractor_benchmark.json");
+}
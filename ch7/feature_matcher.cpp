@@ -0,0 +1,68 @@
+#include "feature_matcher.h"
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+using namespace std;
+
+namespace {
+
+HammingMatcher::Options MatcherOptions(const FeatureMatcher::Options &options) {
+  HammingMatcher::Options matcher_options;
+  matcher_options.max_distance = options.max_distance;
+  matcher_options.ratio = options.ratio;
+  matcher_options.cross_check = options.cross_check;
+  return matcher_options;
+}
+
+}  // namespace
+
+FeatureMatcher::FeatureMatcher(const Options &options)
+    : options_(options), extractor_(options.extractor), matcher_(MatcherOptions(options)) {}
+
+void FeatureMatcher::Extract(const cv::Mat &img, FeatureFrame &frame) {
+  // gray_ is only written by cvtColor, never shared with the caller's image
+  const cv::Mat *gray = &img;
+  if (img.channels() == 3) {
+    cv::cvtColor(img, gray_, cv::COLOR_BGR2GRAY);
+    gray = &gray_;
+  } else if (img.channels() == 4) {
+    cv::cvtColor(img, gray_, cv::COLOR_BGRA2GRAY);
+    gray = &gray_;
+  }
+  extractor_.Extract(*gray, frame.keypoints, frame.descriptors);
+}
+
+void FeatureMatcher::Match(const FeatureFrame &frame1, const FeatureFrame &frame2,
+                           vector<cv::DMatch> &matches) const {
+  matcher_.Match(frame1.descriptors, frame2.descriptors, matches);
+}
+
+void FeatureMatcher::Match(const cv::Mat &img_1, const cv::Mat &img_2,
+                           vector<cv::KeyPoint> &keypoints_1,
+                           vector<cv::KeyPoint> &keypoints_2,
+                           vector<cv::DMatch> &matches) {
+  Extract(img_1, frame1_);
+  Extract(img_2, frame2_);
+  Match(frame1_, frame2_, matches);
+  keypoints_1 = frame1_.keypoints;
+  keypoints_2 = frame2_.keypoints;
+}
+
+void FeatureMatcher::MatchPairs(const vector<cv::Mat> &images, const vector<pair<int, int>> &pairs,
+                                vector<FeatureFrame> &frames, vector<vector<cv::DMatch>> &matches) {
+  // the extractor is already parallel over pyramid levels, images are extracted one after another
+  vector<bool> used(images.size(), false);
+  for (auto &p : pairs) {
+    used[p.first] = used[p.second] = true;
+  }
+  frames.resize(images.size());
+  for (size_t i = 0; i < images.size(); ++i) {
+    if (used[i]) Extract(images[i], frames[i]);
+  }
+
+  // the matcher is parallel over queries
+  matches.resize(pairs.size());
+  for (size_t i = 0; i < pairs.size(); ++i) {
+    Match(frames[pairs[i].first], frames[pairs[i].second], matches[i]);
+  }
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <opencv2/core/core.hpp>
+#include <utility>
+#include <vector>
+#include "hamming_matcher.h"
+#include "orb_extractor.h"
+
+/// keypoints and descriptors of one image
+struct FeatureFrame {
+  std::vector<cv::KeyPoint> keypoints;
+  DescriptorMatrix descriptors;
+};
+
+/**
+ * ORB feature extraction and matching of image pairs, shared by the pose estimation and triangulation examples.
+ * The extractor (pyramid and per level buffers), the gray image and the frames live as long as the object, so
+ * matching a stream of images stops allocating after the first pairs.
+ * Matches are filtered by a distance threshold, Lowe's ratio test and the mutual (cross) check.
+ */
+class FeatureMatcher {
+public:
+  struct Options {
+    ORBExtractor::Options extractor;
+    int max_distance = 64;    // matches with distance >= max_distance are rejected
+    float ratio = 0.8f;       // best < ratio * second best, 0 to disable
+    bool cross_check = true;  // keep only mutual best matches
+  };
+
+  FeatureMatcher() : FeatureMatcher(Options()) {}
+
+  explicit FeatureMatcher(const Options &options);
+
+  /// detect keypoints and compute descriptors of a gray or BGR image
+  void Extract(const cv::Mat &img, FeatureFrame &frame);
+
+  /// match two frames, queryIdx refers to frame1 and trainIdx to frame2
+  void Match(const FeatureFrame &frame1, const FeatureFrame &frame2, std::vector<cv::DMatch> &matches) const;
+
+  /// extract and match two images
+  void Match(const cv::Mat &img_1, const cv::Mat &img_2,
+             std::vector<cv::KeyPoint> &keypoints_1,
+             std::vector<cv::KeyPoint> &keypoints_2,
+             std::vector<cv::DMatch> &matches);
+
+  /**
+   * match a batch of image pairs, every image is extracted once however many pairs use it
+   * (e.g. the consecutive pairs of a sequence)
+   * @param images input images
+   * @param pairs indices of the two images of each pair
+   * @param frames features of every image used by a pair, reused between calls
+   * @param matches matches of every pair
+   */
+  void MatchPairs(const std::vector<cv::Mat> &images, const std::vector<std::pair<int, int>> &pairs,
+                  std::vector<FeatureFrame> &frames, std::vector<std::vector<cv::DMatch>> &matches);
+
+  const Options &GetOptions() const { return options_; }
+
+private:
+  Options options_;
+  ORBExtractor extractor_;
+  HammingMatcher matcher_;
+  cv::Mat gray_;
+  FeatureFrame frame1_, frame2_;  // buffers of the two image Match
+};
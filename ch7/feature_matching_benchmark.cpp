@@ -0,0 +1,99 @@
+#include <opencv2/opencv.hpp>
+#include <chrono>
+#include <string>
+#include "feature_matcher.h"
+
+using namespace std;
+
+/**
+ * Throughput of feature matching on a stream of image pairs (frame i with frame i + 1):
+ * - the former find_feature_matches of the examples: new ORB detector, extractor and matcher for every pair,
+ *   min/max distance filtering
+ * - FeatureMatcher::Match for every pair: persistent extractor and buffers, ratio test and mutual check
+ * - FeatureMatcher::MatchPairs on the whole stream: every frame is extracted once
+ * usage: feature_matching_benchmark [num_frames] [img1 img2 ...]
+ */
+
+// the implementation the examples used to copy
+void LegacyFindFeatureMatches(const cv::Mat &img_1, const cv::Mat &img_2,
+                              vector<cv::KeyPoint> &keypoints_1,
+                              vector<cv::KeyPoint> &keypoints_2,
+                              vector<cv::DMatch> &matches) {
+  cv::Mat descriptors_1, descriptors_2;
+  cv::Ptr<cv::FeatureDetector> detector = cv::ORB::create();
+  cv::Ptr<cv::DescriptorExtractor> descriptor = cv::ORB::create();
+  cv::Ptr<cv::DescriptorMatcher> matcher = cv::DescriptorMatcher::create("BruteForce-Hamming");
+  detector->detect(img_1, keypoints_1);
+  detector->detect(img_2, keypoints_2);
+  descriptor->compute(img_1, keypoints_1, descriptors_1);
+  descriptor->compute(img_2, keypoints_2, descriptors_2);
+
+  vector<cv::DMatch> match;
+  matcher->match(descriptors_1, descriptors_2, match);
+  double min_dist = 10000;
+  for (auto &m : match) min_dist = min(min_dist, double(m.distance));
+  matches.clear();
+  for (auto &m : match) {
+    if (m.distance <= max(2 * min_dist, 30.0)) matches.push_back(m);
+  }
+}
+
+int main(int argc, char **argv) {
+  int num_frames = 20;
+  vector<string> files = {"./1.png", "./2.png"};
+  if (argc >= 2) num_frames = max(2, atoi(argv[1]));
+  if (argc >= 3) files.assign(argv + 2, argv + argc);
+
+  vector<cv::Mat> loaded;
+  for (auto &file : files) {
+    loaded.push_back(cv::imread(file, CV_LOAD_IMAGE_COLOR));
+    assert(loaded.back().data != nullptr);
+  }
+
+  // the stream cycles through the images, each frame has its own buffer as a camera would deliver
+  vector<cv::Mat> frames(num_frames);
+  for (int i = 0; i < num_frames; ++i) frames[i] = loaded[i % loaded.size()].clone();
+  vector<pair<int, int>> pairs;
+  for (int i = 0; i + 1 < num_frames; ++i) pairs.push_back(make_pair(i, i + 1));
+  const int num_pairs = pairs.size();
+
+  vector<cv::KeyPoint> keypoints_1, keypoints_2;
+  vector<cv::DMatch> matches;
+  long total_matches = 0;
+  chrono::steady_clock::time_point t1 = chrono::steady_clock::now();
+  for (auto &p : pairs) {
+    LegacyFindFeatureMatches(frames[p.first], frames[p.second], keypoints_1, keypoints_2, matches);
+    total_matches += matches.size();
+  }
+  chrono::steady_clock::time_point t2 = chrono::steady_clock::now();
+  double time_legacy = chrono::duration_cast<chrono::duration<double>>(t2 - t1).count();
+  cout << "find_feature_matches:       " << num_pairs / time_legacy << " pairs/s, "
+       << double(total_matches) / num_pairs << " matches per pair" << endl;
+
+  FeatureMatcher matcher;
+  total_matches = 0;
+  t1 = chrono::steady_clock::now();
+  for (auto &p : pairs) {
+    matcher.Match(frames[p.first], frames[p.second], keypoints_1, keypoints_2, matches);
+    total_matches += matches.size();
+  }
+  t2 = chrono::steady_clock::now();
+  double time_pairwise = chrono::duration_cast<chrono::duration<double>>(t2 - t1).count();
+  cout << "FeatureMatcher::Match:      " << num_pairs / time_pairwise << " pairs/s, "
+       << double(total_matches) / num_pairs << " matches per pair" << endl;
+
+  vector<FeatureFrame> features;
+  vector<vector<cv::DMatch>> batch_matches;
+  t1 = chrono::steady_clock::now();
+  matcher.MatchPairs(frames, pairs, features, batch_matches);
+  t2 = chrono::steady_clock::now();
+  double time_batch = chrono::duration_cast<chrono::duration<double>>(t2 - t1).count();
+  total_matches = 0;
+  for (auto &m : batch_matches) total_matches += m.size();
+  cout << "FeatureMatcher::MatchPairs: " << num_pairs / time_batch << " pairs/s, "
+       << double(total_matches) / num_pairs << " matches per pair" << endl;
+
+  cout << "speedup: " << time_legacy / time_pairwise << " (pairwise), " << time_legacy / time_batch << " (batch)"
+       << endl;
+  return 0;
+}
@@ -0,0 +1,251 @@
+#include "hamming_matcher.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define HAMMING_SIMD_DISPATCH
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+// -------------------------------------------------------------------------------------------------- //
+// DescriptorMatrix
+
+void DescriptorMatrix::FreeDeleter::operator()(uint8_t *p) const {
+  free(p);
+}
+
+DescriptorMatrix &DescriptorMatrix::operator=(const DescriptorMatrix &other) {
+  if (this == &other) return *this;
+  resize(other.rows_);
+  if (padded_rows_ > 0) {
+    memcpy(data_.get(), other.data_.get(), padded_rows_ * kBytes);
+  }
+  valid_ = other.valid_;
+  return *this;
+}
+
+DescriptorMatrix DescriptorMatrix::FromMat(const cv::Mat &descriptors) {
+  assert(descriptors.empty() || (descriptors.type() == CV_8U && descriptors.cols == kBytes));
+  DescriptorMatrix result(descriptors.rows);
+  for (int i = 0; i < descriptors.rows; ++i) {
+    memcpy(result.row(i), descriptors.ptr<uint8_t>(i), kBytes);
+  }
+  return result;
+}
+
+void DescriptorMatrix::resize(int rows) {
+  rows_ = rows;
+  padded_rows_ = (rows + kBlockRows - 1) / kBlockRows * kBlockRows;
+  // the buffer only grows, so matrices reused frame after frame stop allocating
+  if (padded_rows_ > capacity_rows_) {
+    data_.reset();
+    void *p = nullptr;
+    if (posix_memalign(&p, 64, padded_rows_ * kBytes) != 0) {
+      capacity_rows_ = 0;
+      throw bad_alloc();
+    }
+    data_.reset(static_cast<uint8_t *>(p));
+    capacity_rows_ = padded_rows_;
+  }
+  if (padded_rows_ > 0) {
+    memset(data_.get(), 0, padded_rows_ * kBytes);
+  }
+  valid_.assign(rows, 1);
+}
+
+void DescriptorMatrix::setInvalid(int i) {
+  memset(row(i), 0, kBytes);
+  valid_[i] = 0;
+}
+
+int DescriptorMatrix::numValid() const {
+  return int(count(valid_.begin(), valid_.end(), 1));
+}
+
+// -------------------------------------------------------------------------------------------------- //
+// distance kernels, all of them compute distances of one query to 8 rows per step
+
+namespace {
+
+typedef void (*DistanceKernel)(const uint8_t *query, const uint8_t *train, int rows, int *distances);
+
+void DistancesScalar(const uint8_t *query, const uint8_t *train, int rows, int *distances) {
+  uint64_t q[4];
+  memcpy(q, query, 32);
+  for (int r = 0; r < rows; ++r) {
+    uint64_t t[4];
+    memcpy(t, train + r * 32, 32);
+    distances[r] = __builtin_popcountll(q[0] ^ t[0]) + __builtin_popcountll(q[1] ^ t[1]) +
+                   __builtin_popcountll(q[2] ^ t[2]) + __builtin_popcountll(q[3] ^ t[3]);
+  }
+}
+
+#ifdef HAMMING_SIMD_DISPATCH
+// popcount by nibble lookup, then _mm256_sad_epu8 sums the bytes of each 64 bit lane
+__attribute__((target("avx2")))
+void DistancesAvx2(const uint8_t *query, const uint8_t *train, int rows, int *distances) {
+  const __m256i lut = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                       0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+  const __m256i low_mask = _mm256_set1_epi8(0x0f);
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i order = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+  const __m256i q = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(query));
+
+  for (int r = 0; r < rows; r += 8) {
+    __m256i s[8];
+    for (int j = 0; j < 8; ++j) {
+      __m256i x = _mm256_xor_si256(q, _mm256_load_si256(reinterpret_cast<const __m256i *>(train + (r + j) * 32)));
+      __m256i cnt = _mm256_add_epi8(_mm256_shuffle_epi8(lut, _mm256_and_si256(x, low_mask)),
+                                    _mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(x, 4), low_mask)));
+      s[j] = _mm256_sad_epu8(cnt, zero);  // 4 partial sums per row
+    }
+    // v01 = [row0 q0+q1, row1 q0+q1 | row0 q2+q3, row1 q2+q3]
+    __m256i v01 = _mm256_add_epi64(_mm256_unpacklo_epi64(s[0], s[1]), _mm256_unpackhi_epi64(s[0], s[1]));
+    __m256i v23 = _mm256_add_epi64(_mm256_unpacklo_epi64(s[2], s[3]), _mm256_unpackhi_epi64(s[2], s[3]));
+    __m256i v45 = _mm256_add_epi64(_mm256_unpacklo_epi64(s[4], s[5]), _mm256_unpackhi_epi64(s[4], s[5]));
+    __m256i v67 = _mm256_add_epi64(_mm256_unpacklo_epi64(s[6], s[7]), _mm256_unpackhi_epi64(s[6], s[7]));
+    // rows 0-3 and 4-7 as 64 bit lanes
+    __m256i lo = _mm256_add_epi64(_mm256_permute2x128_si256(v01, v23, 0x20),
+                                  _mm256_permute2x128_si256(v01, v23, 0x31));
+    __m256i hi = _mm256_add_epi64(_mm256_permute2x128_si256(v45, v67, 0x20),
+                                  _mm256_permute2x128_si256(v45, v67, 0x31));
+    // interleave to 32 bit [r0, r4, r1, r5, ...] and restore the order
+    __m256i packed = _mm256_or_si256(lo, _mm256_slli_epi64(hi, 32));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(distances + r), _mm256_permutevar8x32_epi32(packed, order));
+  }
+}
+
+// two rows per 512 bit register, native 64 bit popcount
+__attribute__((target("avx512f,avx512vpopcntdq")))
+void DistancesAvx512(const uint8_t *query, const uint8_t *train, int rows, int *distances) {
+  const __m512i q = _mm512_broadcast_i64x4(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(query)));
+  const __m256i order = _mm256_setr_epi32(0, 2, 1, 3, 4, 6, 5, 7);
+
+  for (int r = 0; r < rows; r += 8) {
+    const uint8_t *t = train + r * 32;
+    __m512i a = _mm512_popcnt_epi64(_mm512_xor_si512(q, _mm512_load_si512(t)));
+    __m512i b = _mm512_popcnt_epi64(_mm512_xor_si512(q, _mm512_load_si512(t + 64)));
+    __m512i c = _mm512_popcnt_epi64(_mm512_xor_si512(q, _mm512_load_si512(t + 128)));
+    __m512i d = _mm512_popcnt_epi64(_mm512_xor_si512(q, _mm512_load_si512(t + 192)));
+    // 128 bit lanes of ab: [r0, r2], [r0, r2], [r1, r3], [r1, r3], partial sums
+    __m512i ab = _mm512_add_epi64(_mm512_unpacklo_epi64(a, b), _mm512_unpackhi_epi64(a, b));
+    __m512i cd = _mm512_add_epi64(_mm512_unpacklo_epi64(c, d), _mm512_unpackhi_epi64(c, d));
+    // [r0, r2, r1, r3, r4, r6, r5, r7]
+    __m512i sum = _mm512_add_epi64(_mm512_shuffle_i64x2(ab, cd, _MM_SHUFFLE(2, 0, 2, 0)),
+                                   _mm512_shuffle_i64x2(ab, cd, _MM_SHUFFLE(3, 1, 3, 1)));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(distances + r),
+                        _mm256_permutevar8x32_epi32(_mm512_cvtepi64_epi32(sum), order));
+  }
+}
+#endif
+
+struct Kernel {
+  DistanceKernel func;
+  const char *name;
+};
+
+Kernel SelectKernel() {
+#ifdef HAMMING_SIMD_DISPATCH
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vpopcntdq")) {
+    return {DistancesAvx512, "avx512-vpopcntdq"};
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    return {DistancesAvx2, "avx2"};
+  }
+#endif
+  return {DistancesScalar, "scalar"};
+}
+
+const Kernel &GetKernel() {
+  static const Kernel kernel = SelectKernel();
+  return kernel;
+}
+
+}  // namespace
+
+// -------------------------------------------------------------------------------------------------- //
+// HammingMatcher
+
+void HammingMatcher::ComputeDistances(const uint8_t *query, const DescriptorMatrix &train, int *distances) {
+  if (train.paddedRows() == 0) return;
+  GetKernel().func(query, train.row(0), train.paddedRows(), distances);
+}
+
+const char *HammingMatcher::KernelName() {
+  return GetKernel().name;
+}
+
+void HammingMatcher::BestTwo(const DescriptorMatrix &query, const DescriptorMatrix &train,
+                             vector<cv::DMatch> &best, vector<int> &second_distance) const {
+  best.assign(query.rows(), cv::DMatch(-1, -1, 256));
+  second_distance.assign(query.rows(), 256);
+
+  cv::parallel_for_(cv::Range(0, query.rows()), [&](const cv::Range &range) {
+    vector<int> distances(train.paddedRows());
+    for (int i = range.start; i < range.end; ++i) {
+      if (!query.valid(i)) continue;
+      ComputeDistances(query.row(i), train, distances.data());
+      int best_idx = -1, best_dist = 256, second_dist = 256;
+      for (int j = 0; j < train.rows(); ++j) {
+        int d = distances[j];
+        if (d >= second_dist || !train.valid(j)) continue;
+        if (d < best_dist) {
+          second_dist = best_dist;
+          best_dist = d;
+          best_idx = j;
+        } else {
+          second_dist = d;
+        }
+      }
+      best[i] = cv::DMatch(i, best_idx, float(best_dist));
+      second_distance[i] = second_dist;
+    }
+  });
+}
+
+void HammingMatcher::Match(const DescriptorMatrix &query, const DescriptorMatrix &train,
+                           vector<cv::DMatch> &matches) const {
+  vector<cv::DMatch> best, best_reverse;
+  vector<int> second, second_reverse;
+  BestTwo(query, train, best, second);
+  if (options_.cross_check) {
+    BestTwo(train, query, best_reverse, second_reverse);
+  }
+
+  matches.clear();
+  for (auto &m : best) {
+    if (m.trainIdx < 0 || m.distance >= options_.max_distance) continue;
+    if (options_.ratio > 0 && m.distance >= options_.ratio * second[m.queryIdx]) continue;
+    if (options_.cross_check && best_reverse[m.trainIdx].trainIdx != m.queryIdx) continue;
+    matches.push_back(m);
+  }
+}
+
+void HammingMatcher::KnnMatch(const DescriptorMatrix &query, const DescriptorMatrix &train, int k,
+                              vector<vector<cv::DMatch>> &matches) const {
+  matches.assign(query.rows(), vector<cv::DMatch>());
+  cv::parallel_for_(cv::Range(0, query.rows()), [&](const cv::Range &range) {
+    vector<int> distances(train.paddedRows());
+    for (int i = range.start; i < range.end; ++i) {
+      if (!query.valid(i)) continue;
+      ComputeDistances(query.row(i), train, distances.data());
+      // keep the k best with insertion, k is small
+      vector<cv::DMatch> &knn = matches[i];
+      knn.reserve(k + 1);
+      for (int j = 0; j < train.rows(); ++j) {
+        int d = distances[j];
+        if (d >= options_.max_distance || !train.valid(j)) continue;
+        if (int(knn.size()) == k && d >= knn.back().distance) continue;
+        cv::DMatch m(i, j, float(d));
+        knn.insert(upper_bound(knn.begin(), knn.end(), m), m);
+        if (int(knn.size()) > k) knn.pop_back();
+      }
+    }
+  });
+}
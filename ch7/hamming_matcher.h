@@ -0,0 +1,117 @@
+#pragma once
+
+#include <opencv2/core/core.hpp>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+/**
+ * 256 bit binary descriptors (ORB/BRIEF) stored row by row in one contiguous buffer.
+ * Each row is 32 bytes and 32 byte aligned, the buffer is padded to a multiple of 8 rows with zeros
+ * so the SIMD kernels can always process 8 rows at once.
+ * Rows whose keypoint has no descriptor (e.g. too close to the border) are marked invalid.
+ */
+class DescriptorMatrix {
+public:
+  static const int kBytes = 32;     // bytes per descriptor
+  static const int kBlockRows = 8;  // rows processed together by the matcher
+
+  DescriptorMatrix() = default;
+
+  explicit DescriptorMatrix(int rows) { resize(rows); }
+
+  DescriptorMatrix(const DescriptorMatrix &other) { *this = other; }
+
+  DescriptorMatrix &operator=(const DescriptorMatrix &other);
+
+  DescriptorMatrix(DescriptorMatrix &&other) noexcept { swap(other); }
+
+  DescriptorMatrix &operator=(DescriptorMatrix &&other) noexcept {
+    swap(other);
+    return *this;
+  }
+
+  void swap(DescriptorMatrix &other) noexcept {
+    std::swap(rows_, other.rows_);
+    std::swap(padded_rows_, other.padded_rows_);
+    std::swap(capacity_rows_, other.capacity_rows_);
+    data_.swap(other.data_);
+    valid_.swap(other.valid_);
+  }
+
+  /// copy from a N x 32 CV_8U matrix, e.g. the output of cv::ORB
+  static DescriptorMatrix FromMat(const cv::Mat &descriptors);
+
+  /// resize to rows descriptors, all zero and valid, the buffer is reallocated only when it grows
+  void resize(int rows);
+
+  int rows() const { return rows_; }
+
+  /// rows including the zero padding
+  int paddedRows() const { return padded_rows_; }
+
+  uint8_t *row(int i) { return data_.get() + i * kBytes; }
+
+  const uint8_t *row(int i) const { return data_.get() + i * kBytes; }
+
+  bool valid(int i) const { return valid_[i] != 0; }
+
+  /// mark a row as invalid, its bits are cleared
+  void setInvalid(int i);
+
+  /// number of valid rows
+  int numValid() const;
+
+private:
+  struct FreeDeleter {
+    void operator()(uint8_t *p) const;
+  };
+
+  int rows_ = 0;
+  int padded_rows_ = 0;
+  int capacity_rows_ = 0;
+  std::unique_ptr<uint8_t[], FreeDeleter> data_;
+  std::vector<uint8_t> valid_;
+};
+
+/**
+ * Brute-force hamming matcher over DescriptorMatrix
+ * One query is compared with 8 train descriptors at once, using AVX-512 VPOPCNTDQ or AVX2 when the cpu
+ * supports them (checked at runtime), queries are distributed over threads with cv::parallel_for_.
+ */
+class HammingMatcher {
+public:
+  struct Options {
+    int max_distance = 256;   // matches with distance >= max_distance are rejected, 256 to disable
+    float ratio = 0;          // Lowe's ratio test best < ratio * second best, 0 to disable
+    bool cross_check = false; // keep only mutual best matches
+  };
+
+  HammingMatcher() = default;
+
+  explicit HammingMatcher(const Options &options) : options_(options) {}
+
+  /// best match of every valid query, filtered with the options
+  void Match(const DescriptorMatrix &query, const DescriptorMatrix &train, std::vector<cv::DMatch> &matches) const;
+
+  /// k nearest train descriptors of every query, sorted by distance (max_distance is applied)
+  void KnnMatch(const DescriptorMatrix &query, const DescriptorMatrix &train, int k,
+                std::vector<std::vector<cv::DMatch>> &matches) const;
+
+  /**
+   * hamming distances between one descriptor and all padded rows of train
+   * @param distances output, at least train.paddedRows() ints
+   */
+  static void ComputeDistances(const uint8_t *query, const DescriptorMatrix &train, int *distances);
+
+  /// name of the kernel selected for this cpu
+  static const char *KernelName();
+
+private:
+  /// best and second best train index for each query, -1 if none
+  void BestTwo(const DescriptorMatrix &query, const DescriptorMatrix &train,
+               std::vector<cv::DMatch> &best, std::vector<int> &second_distance) const;
+
+  Options options_;
+};
@@ -0,0 +1,238 @@
+#include "icp_solver.h"
+
+#include <opencv2/core/core.hpp>
+#include <Eigen/Cholesky>
+#include <Eigen/SVD>
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+namespace {
+
+typedef Eigen::Matrix<double, 6, 6> Matrix6d;
+typedef Eigen::Matrix<double, 6, 1> Vector6d;
+
+/// normal equations of the point-to-plane error
+struct PlaneNormalEquations {
+  Matrix6d H = Matrix6d::Zero();
+  Vector6d b = Vector6d::Zero();
+  double cost = 0;
+};
+
+/// run accumulate(begin, end, partial[block]) over fixed blocks of [0, n) in parallel
+template <typename Partial, typename Allocator, typename Func>
+void ForEachBlock(int n, int block_size, vector<Partial, Allocator> &partial, Func accumulate) {
+  block_size = max(1, block_size);
+  const int num_blocks = (n + block_size - 1) / block_size;
+  partial.assign(num_blocks, Partial());
+  cv::parallel_for_(cv::Range(0, num_blocks), [&](const cv::Range &range) {
+    for (int i = range.start; i < range.end; ++i) {
+      accumulate(i * block_size, min(n, (i + 1) * block_size), partial[i]);
+    }
+  });
+}
+
+}  // namespace
+
+void IcpSolver::AccumulateMoments(const IcpCorrespondences &c, const vector<uint8_t> *mask, int begin, int end,
+                                  const Eigen::Vector3d &o1, const Eigen::Vector3d &o2, Moments &moments) const {
+  // shifted by a point of the cloud so the single pass covariance does not lose precision
+  double s1[3] = {0, 0, 0}, s2[3] = {0, 0, 0}, w[9] = {0, 0, 0, 0, 0, 0, 0, 0, 0};
+  int n = 0;
+  for (int i = begin; i < end; ++i) {
+    if (mask && !(*mask)[i]) continue;
+    const double a[3] = {c.x1[i] - o1[0], c.y1[i] - o1[1], c.z1[i] - o1[2]};
+    const double b[3] = {c.x2[i] - o2[0], c.y2[i] - o2[1], c.z2[i] - o2[2]};
+    for (int r = 0; r < 3; ++r) {
+      s1[r] += a[r];
+      s2[r] += b[r];
+      for (int k = 0; k < 3; ++k) w[r * 3 + k] += a[r] * b[k];
+    }
+    ++n;
+  }
+  moments.sum1 = Eigen::Vector3d(s1[0], s1[1], s1[2]);
+  moments.sum2 = Eigen::Vector3d(s2[0], s2[1], s2[2]);
+  moments.cross = Eigen::Map<const Eigen::Matrix<double, 3, 3, Eigen::RowMajor>>(w);
+  moments.n = n;
+}
+
+Sophus::SE3d IcpSolver::FromMoments(const Moments &moments, const Eigen::Vector3d &o1, const Eigen::Vector3d &o2) {
+  if (moments.n < 3) return Sophus::SE3d();
+  const Eigen::Vector3d mean1 = moments.sum1 / moments.n, mean2 = moments.sum2 / moments.n;
+  // W = sum q1 * q2^T with q the points minus their centroid
+  const Eigen::Matrix3d W = moments.cross - moments.n * mean1 * mean2.transpose();
+
+  Eigen::JacobiSVD<Eigen::Matrix3d> svd(W, Eigen::ComputeFullU | Eigen::ComputeFullV);
+  const Eigen::Matrix3d U = svd.matrixU(), V = svd.matrixV();
+  // flip the axis of the smallest singular value if U * V^T is a reflection
+  Eigen::Vector3d d(1, 1, (U * V.transpose()).determinant() < 0 ? -1 : 1);
+  const Eigen::Matrix3d R = U * d.asDiagonal() * V.transpose();
+  const Eigen::Vector3d t = (mean1 + o1) - R * (mean2 + o2);
+  return Sophus::SE3d(Eigen::Quaterniond(R).normalized(), t);
+}
+
+Sophus::SE3d IcpSolver::Align(const IcpCorrespondences &correspondences, const vector<uint8_t> *mask) const {
+  const int n = correspondences.size();
+  int first = 0;
+  while (first < n && mask && !(*mask)[first]) ++first;
+  if (first == n) return Sophus::SE3d();
+  const Eigen::Vector3d o1(correspondences.x1[first], correspondences.y1[first], correspondences.z1[first]);
+  const Eigen::Vector3d o2(correspondences.x2[first], correspondences.y2[first], correspondences.z2[first]);
+
+  vector<Moments> partial;
+  ForEachBlock(n, options_.block_size, partial, [&](int begin, int end, Moments &moments) {
+    AccumulateMoments(correspondences, mask, begin, end, o1, o2, moments);
+  });
+
+  // fixed summation order: same result for any number of threads
+  Moments total;
+  for (auto &p : partial) {
+    total.sum1 += p.sum1;
+    total.sum2 += p.sum2;
+    total.cross += p.cross;
+    total.n += p.n;
+  }
+  return FromMoments(total, o1, o2);
+}
+
+int IcpSolver::RefinePointToPlane(const IcpCorrespondences &correspondences, const vector<uint8_t> *mask,
+                                  Sophus::SE3d &T) const {
+  if (!correspondences.hasNormals()) return 0;
+  const IcpCorrespondences &c = correspondences;
+  const int n = c.size();
+
+  vector<PlaneNormalEquations, Eigen::aligned_allocator<PlaneNormalEquations>> partial;
+  Sophus::SE3d last_T = T;
+  double last_cost = 0;
+  int iter = 0;
+  for (; iter < options_.plane_iterations; ++iter) {
+    const Eigen::Matrix3d R = T.rotationMatrix();
+    const Eigen::Vector3d t = T.translation();
+    ForEachBlock(n, options_.block_size, partial, [&](int begin, int end, PlaneNormalEquations &result) {
+      for (int i = begin; i < end; ++i) {
+        if (mask && !(*mask)[i]) continue;
+        const Eigen::Vector3d q = R * Eigen::Vector3d(c.x2[i], c.y2[i], c.z2[i]) + t;
+        const Eigen::Vector3d normal(c.nx1[i], c.ny1[i], c.nz1[i]);
+        const double e = normal.dot(q - Eigen::Vector3d(c.x1[i], c.y1[i], c.z1[i]));
+        // d(exp(dx) * T * p2) / d(dx) = [I, -q^], projected on the normal
+        Vector6d J;
+        J << normal, q.cross(normal);
+        result.H.noalias() += J * J.transpose();
+        result.b.noalias() -= J * e;
+        result.cost += e * e;
+      }
+    });
+    PlaneNormalEquations total;
+    for (auto &p : partial) {
+      total.H += p.H;
+      total.b += p.b;
+      total.cost += p.cost;
+    }
+
+    if (iter > 0 && total.cost >= last_cost) {
+      // cost increase, keep the previous pose
+      T = last_T;
+      break;
+    }
+    // a little damping for planar scenes where some directions are unobservable
+    total.H.diagonal().array() += 1e-9 * (total.H.trace() + 1e-12);
+    Vector6d dx = total.H.ldlt().solve(total.b);
+    if (!dx.allFinite()) break;
+    last_T = T;
+    last_cost = total.cost;
+    T = Sophus::SE3d::exp(dx) * T;
+    if (dx.norm() < 1e-8) {
+      ++iter;
+      break;
+    }
+  }
+  return iter;
+}
+
+int IcpSolver::CountInliers(const IcpCorrespondences &c, const Sophus::SE3d &T, vector<uint8_t> *inliers) const {
+  const Eigen::Matrix3d R = T.rotationMatrix();
+  const Eigen::Vector3d t = T.translation();
+  const double th2 = options_.inlier_threshold * options_.inlier_threshold;
+  const int n = c.size();
+  if (inliers) inliers->assign(n, 0);
+  int count = 0;
+  for (int i = 0; i < n; ++i) {
+    const double dx = R(0, 0) * c.x2[i] + R(0, 1) * c.y2[i] + R(0, 2) * c.z2[i] + t[0] - c.x1[i];
+    const double dy = R(1, 0) * c.x2[i] + R(1, 1) * c.y2[i] + R(1, 2) * c.z2[i] + t[1] - c.y1[i];
+    const double dz = R(2, 0) * c.x2[i] + R(2, 1) * c.y2[i] + R(2, 2) * c.z2[i] + t[2] - c.z1[i];
+    const bool inlier = dx * dx + dy * dy + dz * dz < th2;
+    count += inlier;
+    if (inliers) (*inliers)[i] = inlier;
+  }
+  return count;
+}
+
+int IcpSolver::Estimate(const IcpCorrespondences &correspondences, Sophus::SE3d &T, vector<uint8_t> &inliers) {
+  const IcpCorrespondences &c = correspondences;
+  const int n = c.size();
+  inliers.assign(n, 0);
+  last_iterations_ = 0;
+  if (n < 3) return 0;
+
+  auto point1 = [&](int i) { return Eigen::Vector3d(c.x1[i], c.y1[i], c.z1[i]); };
+  auto point2 = [&](int i) { return Eigen::Vector3d(c.x2[i], c.y2[i], c.z2[i]); };
+
+  uniform_int_distribution<int> pick(0, n - 1);
+  const double th = options_.inlier_threshold;
+  int best_count = 0, max_iterations = options_.max_iterations;
+  Sophus::SE3d best_T;
+  for (; last_iterations_ < max_iterations; ++last_iterations_) {
+    int idx[3] = {pick(rng_), pick(rng_), pick(rng_)};
+    if (idx[0] == idx[1] || idx[0] == idx[2] || idx[1] == idx[2]) continue;
+
+    // rigid motions keep distances, and three points must not be collinear
+    bool consistent = true;
+    for (int k = 0; k < 3 && consistent; ++k) {
+      int a = idx[k], b = idx[(k + 1) % 3];
+      consistent = fabs((point1(a) - point1(b)).norm() - (point2(a) - point2(b)).norm()) < 2 * th;
+    }
+    if (!consistent) continue;
+    if ((point2(idx[1]) - point2(idx[0])).cross(point2(idx[2]) - point2(idx[0])).norm() < 1e-9) continue;
+
+    Moments moments;
+    const Eigen::Vector3d o1 = point1(idx[0]), o2 = point2(idx[0]);
+    for (int k : idx) {
+      const Eigen::Vector3d a = point1(k) - o1, b = point2(k) - o2;
+      moments.sum1 += a;
+      moments.sum2 += b;
+      moments.cross += a * b.transpose();
+      ++moments.n;
+    }
+    const Sophus::SE3d hypothesis = FromMoments(moments, o1, o2);
+    const int count = CountInliers(c, hypothesis);
+    if (count > best_count) {
+      best_count = count;
+      best_T = hypothesis;
+      // N = log(1 - p) / log(1 - w^3)
+      const double w = double(count) / n;
+      const double all_inliers = w * w * w;
+      if (all_inliers > 1 - 1e-12) {
+        max_iterations = 0;
+      } else {
+        const double needed = log(1 - options_.confidence) / log(1 - all_inliers);
+        max_iterations = int(min(double(options_.max_iterations), ceil(needed)));
+      }
+    }
+  }
+  if (best_count < 3) return 0;
+
+  // closed form on all inliers, then point-to-plane
+  CountInliers(c, best_T, &inliers);
+  vector<uint8_t> refit_inliers;
+  Sophus::SE3d refit = Align(c, &inliers);
+  if (CountInliers(c, refit, &refit_inliers) >= best_count) {
+    best_T = refit;
+    inliers.swap(refit_inliers);
+  }
+  T = best_T;
+  if (options_.plane_iterations > 0 && c.hasNormals()) {
+    RefinePointToPlane(c, &inliers, T);
+  }
+  return CountInliers(c, T, &inliers);
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <Eigen/Core>
+#include <sophus/se3.hpp>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+/// 3D-3D correspondences stored as structure of arrays
+struct IcpCorrespondences {
+  std::vector<double> x1, y1, z1;     // points of the first frame
+  std::vector<double> x2, y2, z2;     // matched points of the second frame
+  std::vector<double> nx1, ny1, nz1;  // optional unit normals of the first frame (point-to-plane), zero if unknown
+
+  int size() const { return int(x1.size()); }
+
+  bool hasNormals() const { return !x1.empty() && nx1.size() == x1.size(); }
+
+  void clear() {
+    x1.clear(), y1.clear(), z1.clear(), x2.clear(), y2.clear(), z2.clear();
+    nx1.clear(), ny1.clear(), nz1.clear();
+  }
+
+  void reserve(int n) {
+    x1.reserve(n), y1.reserve(n), z1.reserve(n), x2.reserve(n), y2.reserve(n), z2.reserve(n);
+  }
+
+  void push_back(const Eigen::Vector3d &p1, const Eigen::Vector3d &p2) {
+    x1.push_back(p1[0]), y1.push_back(p1[1]), z1.push_back(p1[2]);
+    x2.push_back(p2[0]), y2.push_back(p2[1]), z2.push_back(p2[2]);
+  }
+
+  void push_back(const Eigen::Vector3d &p1, const Eigen::Vector3d &p2, const Eigen::Vector3d &n1) {
+    push_back(p1, p2);
+    nx1.push_back(n1[0]), ny1.push_back(n1[1]), nz1.push_back(n1[2]);
+  }
+};
+
+/**
+ * 3D-3D alignment p1 = T * p2 (T = T_12)
+ * - closed form: centroids and the 3x3 cross covariance in one pass over the points, reduced over fixed blocks in
+ *   parallel, then SVD of the 3x3 (Arun / Umeyama, reflection corrected)
+ * - RANSAC over minimal 3 point sets with an adaptive number of iterations, refit on the inliers
+ * - optional point-to-plane Gauss-Newton refinement when the first frame has normals
+ */
+class IcpSolver {
+public:
+  struct Options {
+    double inlier_threshold = 0.05;  // distance |p1 - T * p2| of inliers, in meters
+    int max_iterations = 200;        // RANSAC iterations at most
+    double confidence = 0.99;        // RANSAC stops when an all inlier sample was drawn with this probability
+    int plane_iterations = 5;        // point-to-plane steps after RANSAC, 0 to disable
+    int block_size = 256;            // points per block of the parallel reductions
+  };
+
+  IcpSolver() : IcpSolver(Options()) {}
+
+  explicit IcpSolver(const Options &options) : options_(options) {}
+
+  /**
+   * closed form alignment
+   * @param mask if not null, only the points with mask[i] != 0 are used
+   * @return T_12, identity if less than 3 points
+   */
+  Sophus::SE3d Align(const IcpCorrespondences &correspondences, const std::vector<uint8_t> *mask = nullptr) const;
+
+  /**
+   * point-to-plane refinement, minimizes sum (n1 . (T * p2 - p1))^2 over the masked points
+   * @return number of Gauss-Newton steps taken
+   */
+  int RefinePointToPlane(const IcpCorrespondences &correspondences, const std::vector<uint8_t> *mask,
+                         Sophus::SE3d &T) const;
+
+  /**
+   * RANSAC, refit on the inliers and point-to-plane refinement if there are normals
+   * @param T output T_12
+   * @param inliers output inlier mask
+   * @return number of inliers, 0 on failure
+   */
+  int Estimate(const IcpCorrespondences &correspondences, Sophus::SE3d &T, std::vector<uint8_t> &inliers);
+
+  /// inlier mask of a pose, returns the number of inliers
+  int CountInliers(const IcpCorrespondences &correspondences, const Sophus::SE3d &T,
+                   std::vector<uint8_t> *inliers = nullptr) const;
+
+  /// RANSAC iterations used by the last Estimate
+  int LastIterations() const { return last_iterations_; }
+
+private:
+  /// shifted first and second moments of a range of points
+  struct Moments {
+    Eigen::Vector3d sum1 = Eigen::Vector3d::Zero();
+    Eigen::Vector3d sum2 = Eigen::Vector3d::Zero();
+    Eigen::Matrix3d cross = Eigen::Matrix3d::Zero();  // sum (p1 - o1) * (p2 - o2)^T
+    int n = 0;
+  };
+
+  void AccumulateMoments(const IcpCorrespondences &c, const std::vector<uint8_t> *mask, int begin, int end,
+                         const Eigen::Vector3d &o1, const Eigen::Vector3d &o2, Moments &moments) const;
+
+  /// T_12 from the moments, o1 and o2 are the shifts used when accumulating
+  static Sophus::SE3d FromMoments(const Moments &moments, const Eigen::Vector3d &o1, const Eigen::Vector3d &o2);
+
+  Options options_;
+  std::mt19937 rng_{0};
+  int last_iterations_ = 0;
+};
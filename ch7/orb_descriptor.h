@@ -0,0 +1,54 @@
+#pragma once
+
+#include <opencv2/core/core.hpp>
+#include <vector>
+#include "hamming_matcher.h"
+
+/**
+ * ORB (oriented BRIEF) descriptor engine, compatible with cv::ORB on level 0:
+ * - orientation by the intensity centroid of a circular patch of radius 15, on the raw image
+ * - 256 point pair tests of the 31x31 learned pattern, on the image blurred by a 7x7 Gaussian (sigma 2)
+ *
+ * The pattern is rotated ahead of time: orientation is quantized into orientation_bins bins (30 bins of 12 degrees as
+ * in the ORB paper) and every bin has a table of integer pixel offsets, so no trigonometry or rounding is done per
+ * keypoint. With orientation_bins = 0 the exact angle is used and the descriptor is bit exact with cv::ORB.
+ * Moments are computed with SSSE3 on the masked rows, keypoints are processed in parallel.
+ */
+class ORBDescriptorEngine {
+public:
+  struct Options {
+    int orientation_bins = 30;  // 0 to rotate the pattern by the exact angle
+    bool gaussian_blur = true;  // blur before the point pair tests as cv::ORB does
+  };
+
+  static const int kHalfPatchSize = 15;  // radius of the orientation patch
+  static const int kBorder = 19;         // keypoints closer to the image border get no descriptor
+
+  ORBDescriptorEngine() : ORBDescriptorEngine(Options()) {}
+
+  explicit ORBDescriptorEngine(const Options &options);
+
+  /**
+   * compute orientation (written to keypoint.angle, in degrees) and descriptors
+   * @param img 8 bit gray image
+   * @param keypoints keypoints, those within kBorder of the image border are marked invalid in descriptors
+   * @param descriptors one row per keypoint
+   * @return number of valid descriptors
+   */
+  int Compute(const cv::Mat &img, std::vector<cv::KeyPoint> &keypoints, DescriptorMatrix &descriptors) const;
+
+  /// intensity centroid orientation in degrees [0, 360), same as cv::ORB
+  float ComputeAngle(const cv::Mat &img, const cv::Point2f &pt) const;
+
+private:
+  /// point pair tests around one keypoint, offsets are the 512 linear offsets of the rotated pattern
+  void ComputeDescriptor(const cv::Mat &blurred, const cv::KeyPoint &kp, const int *offsets, uint8_t *desc) const;
+
+  /// linear pixel offsets of the 512 pattern points for every orientation bin, for a row step
+  std::vector<int> MakeOffsetTable(int step) const;
+
+  Options options_;
+  int umax_[kHalfPatchSize + 2];                  // half width of the circular patch per row
+  uint8_t row_masks_[kHalfPatchSize + 1][32];    // umax_ as byte masks over u in [-16, 15]
+  std::vector<cv::Point> rotated_pattern_;       // orientation_bins x 512 rotated points
+};
@@ -0,0 +1,197 @@
+#include "orb_extractor.h"
+
+#include <opencv2/features2d/features2d.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+using namespace std;
+
+ORBExtractor::ORBExtractor(const Options &options) : options_(options), engine_(options.descriptor) {
+  const int n_levels = options_.num_levels;
+  scale_factors_.resize(n_levels);
+  scale_factors_[0] = 1;
+  for (int i = 1; i < n_levels; ++i) {
+    scale_factors_[i] = scale_factors_[i - 1] * options_.scale_factor;
+  }
+
+  // the number of features of a level is proportional to its area: geometric series of 1 / scale_factor
+  features_per_level_.resize(n_levels);
+  float factor = 1.0f / options_.scale_factor;
+  float n_desired = options_.num_features * (1 - factor) / (1 - pow(factor, float(n_levels)));
+  int sum_features = 0;
+  for (int level = 0; level < n_levels - 1; ++level) {
+    features_per_level_[level] = cvRound(n_desired);
+    sum_features += features_per_level_[level];
+    n_desired *= factor;
+  }
+  features_per_level_[n_levels - 1] = max(options_.num_features - sum_features, 0);
+}
+
+void ORBExtractor::BuildPyramid(const cv::Mat &img) {
+  pyramid_.resize(options_.num_levels);
+  pyramid_[0] = img;
+  for (int level = 1; level < options_.num_levels; ++level) {
+    float scale = 1.0f / scale_factors_[level];
+    cv::Size size(cvRound(img.cols * scale), cvRound(img.rows * scale));
+    cv::resize(pyramid_[level - 1], pyramid_[level], size, 0, 0, cv::INTER_LINEAR);
+  }
+}
+
+void ORBExtractor::DetectLevel(int level, vector<cv::KeyPoint> &keypoints) const {
+  keypoints.clear();
+  const cv::Mat &img = pyramid_[level];
+  // FAST needs 3 pixels around the corner, corners are kept ORBDescriptorEngine::kBorder away from the border
+  const int min_x = ORBDescriptorEngine::kBorder - 3, min_y = min_x;
+  const int max_x = img.cols - ORBDescriptorEngine::kBorder + 3, max_y = img.rows - ORBDescriptorEngine::kBorder + 3;
+  if (max_x - min_x < 7 || max_y - min_y < 7) return;
+
+  const int cell = options_.cell_size;
+  const int n_cols = max(1, (max_x - min_x) / cell), n_rows = max(1, (max_y - min_y) / cell);
+  const int cell_w = int(ceil(float(max_x - min_x) / n_cols)), cell_h = int(ceil(float(max_y - min_y) / n_rows));
+
+  vector<cv::KeyPoint> candidates;
+  for (int i = 0; i < n_rows; ++i) {
+    int y0 = min_y + i * cell_h;
+    if (y0 >= max_y - 6) continue;
+    int y1 = min(y0 + cell_h + 6, max_y);
+    for (int j = 0; j < n_cols; ++j) {
+      int x0 = min_x + j * cell_w;
+      if (x0 >= max_x - 6) continue;
+      int x1 = min(x0 + cell_w + 6, max_x);
+
+      // adaptive threshold: retry with the lower one if the cell has no corner
+      cv::Mat cell_img = img(cv::Rect(x0, y0, x1 - x0, y1 - y0));
+      vector<cv::KeyPoint> cell_keypoints;
+      cv::FAST(cell_img, cell_keypoints, options_.ini_th_fast, true);
+      if (cell_keypoints.empty()) {
+        cv::FAST(cell_img, cell_keypoints, options_.min_th_fast, true);
+      }
+      for (auto &kp : cell_keypoints) {
+        kp.pt.x += x0;
+        kp.pt.y += y0;
+        candidates.push_back(kp);
+      }
+    }
+  }
+
+  const int n = features_per_level_[level];
+  if (options_.use_quadtree) {
+    keypoints = DistributeQuadtree(candidates, min_x + 3, max_x - 3, min_y + 3, max_y - 3, n);
+  } else {
+    keypoints.swap(candidates);
+    cv::KeyPointsFilter::retainBest(keypoints, n);
+    if (int(keypoints.size()) > n) keypoints.resize(n);
+  }
+}
+
+vector<cv::KeyPoint> ORBExtractor::DistributeQuadtree(const vector<cv::KeyPoint> &keypoints, float min_x,
+                                                      float max_x, float min_y, float max_y, int n) {
+  if (n <= 0 || keypoints.empty()) return {};
+
+  struct Node {
+    float x0, y0, x1, y1;
+    vector<cv::KeyPoint> keypoints;
+  };
+
+  // initial nodes, roughly square
+  const int n_ini = max(1, cvRound((max_x - min_x) / (max_y - min_y)));
+  const float width = (max_x - min_x) / n_ini;
+  vector<Node> nodes(n_ini);
+  for (int i = 0; i < n_ini; ++i) {
+    nodes[i] = Node{min_x + i * width, min_y, min_x + (i + 1) * width, max_y, {}};
+  }
+  for (auto &kp : keypoints) {
+    int i = min(n_ini - 1, max(0, int((kp.pt.x - min_x) / width)));
+    nodes[i].keypoints.push_back(kp);
+  }
+  nodes.erase(remove_if(nodes.begin(), nodes.end(), [](const Node &node) { return node.keypoints.empty(); }),
+              nodes.end());
+
+  // split the most crowded nodes first until there are n nodes or nothing can be split
+  while (int(nodes.size()) < n) {
+    vector<int> splittable;
+    for (size_t i = 0; i < nodes.size(); ++i) {
+      if (nodes[i].keypoints.size() > 1 && nodes[i].x1 - nodes[i].x0 > 1) splittable.push_back(i);
+    }
+    if (splittable.empty()) break;
+    sort(splittable.begin(), splittable.end(),
+         [&](int a, int b) { return nodes[a].keypoints.size() > nodes[b].keypoints.size(); });
+
+    for (int idx : splittable) {
+      if (int(nodes.size()) >= n) break;
+      Node parent = std::move(nodes[idx]);
+      float cx = 0.5f * (parent.x0 + parent.x1), cy = 0.5f * (parent.y0 + parent.y1);
+      Node children[4] = {{parent.x0, parent.y0, cx, cy, {}}, {cx, parent.y0, parent.x1, cy, {}},
+                          {parent.x0, cy, cx, parent.y1, {}}, {cx, cy, parent.x1, parent.y1, {}}};
+      for (auto &kp : parent.keypoints) {
+        children[(kp.pt.x < cx ? 0 : 1) + (kp.pt.y < cy ? 0 : 2)].keypoints.push_back(kp);
+      }
+      bool replaced = false;
+      for (auto &child : children) {
+        if (child.keypoints.empty()) continue;
+        if (!replaced) {
+          nodes[idx] = std::move(child);
+          replaced = true;
+        } else {
+          nodes.push_back(std::move(child));
+        }
+      }
+    }
+  }
+
+  // the strongest corner of each node
+  vector<cv::KeyPoint> result;
+  result.reserve(nodes.size());
+  for (auto &node : nodes) {
+    result.push_back(*max_element(node.keypoints.begin(), node.keypoints.end(),
+                                  [](const cv::KeyPoint &a, const cv::KeyPoint &b) {
+                                    return a.response < b.response;
+                                  }));
+  }
+  if (int(result.size()) > n) {
+    cv::KeyPointsFilter::retainBest(result, n);
+    result.resize(n);
+  }
+  return result;
+}
+
+void ORBExtractor::Extract(const cv::Mat &img, vector<cv::KeyPoint> &keypoints, DescriptorMatrix &descriptors) {
+  assert(img.type() == CV_8UC1);
+  BuildPyramid(img);
+
+  // every level is independent: detect, distribute, describe
+  const int n_levels = options_.num_levels;
+  vector<vector<cv::KeyPoint>> &level_keypoints = level_keypoints_;
+  vector<DescriptorMatrix> &level_descriptors = level_descriptors_;
+  level_keypoints.resize(n_levels);
+  level_descriptors.resize(n_levels);
+  cv::parallel_for_(cv::Range(0, n_levels), [&](const cv::Range &range) {
+    for (int level = range.start; level < range.end; ++level) {
+      DetectLevel(level, level_keypoints[level]);
+      engine_.Compute(pyramid_[level], level_keypoints[level], level_descriptors[level]);
+    }
+  });
+
+  // gather in level 0 coordinates
+  int total = 0;
+  for (auto &kps : level_keypoints) total += kps.size();
+  keypoints.clear();
+  keypoints.reserve(total);
+  descriptors.resize(total);
+  int row = 0;
+  for (int level = 0; level < n_levels; ++level) {
+    const float scale = scale_factors_[level];
+    for (size_t i = 0; i < level_keypoints[level].size(); ++i, ++row) {
+      cv::KeyPoint kp = level_keypoints[level][i];
+      kp.octave = level;
+      kp.size = (2 * ORBDescriptorEngine::kHalfPatchSize + 1) * scale;
+      kp.pt *= scale;
+      keypoints.push_back(kp);
+      memcpy(descriptors.row(row), level_descriptors[level].row(i), DescriptorMatrix::kBytes);
+      if (!level_descriptors[level].valid(i)) descriptors.setInvalid(row);
+    }
+  }
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <opencv2/core/core.hpp>
+#include <vector>
+#include "hamming_matcher.h"
+#include "orb_descriptor.h"
+
+/**
+ * Multi-scale ORB extractor
+ * - scale pyramid of num_levels levels, each one scale_factor smaller than the previous one
+ * - FAST on a grid of cell_size cells per level, a cell without corners is retried with the lower threshold
+ * - the corners of a level are distributed over the image by a quadtree (or simply the top responses are kept)
+ *   so that every level gets its share of num_features
+ * - orientation and descriptors are computed per level by ORBDescriptorEngine
+ * Levels are processed in parallel. Keypoints are returned in level 0 coordinates with octave set to the level.
+ */
+class ORBExtractor {
+public:
+  struct Options {
+    int num_features = 500;    // total number of features over all levels
+    float scale_factor = 1.2f; // scale between two levels
+    int num_levels = 8;
+    int ini_th_fast = 20;      // FAST threshold
+    int min_th_fast = 7;       // lower FAST threshold used in cells without corners
+    int cell_size = 30;        // size of the FAST grid cells in pixels
+    bool use_quadtree = true;  // distribute with a quadtree, otherwise keep the best responses
+    ORBDescriptorEngine::Options descriptor;
+  };
+
+  ORBExtractor() : ORBExtractor(Options()) {}
+
+  explicit ORBExtractor(const Options &options);
+
+  /**
+   * detect keypoints and compute descriptors
+   * @param img 8 bit gray image
+   * @param keypoints keypoints in level 0 coordinates
+   * @param descriptors one row per keypoint
+   */
+  void Extract(const cv::Mat &img, std::vector<cv::KeyPoint> &keypoints, DescriptorMatrix &descriptors);
+
+  /// pyramid of the last extracted image
+  const std::vector<cv::Mat> &Pyramid() const { return pyramid_; }
+
+  /// scale of each level w.r.t. level 0
+  const std::vector<float> &ScaleFactors() const { return scale_factors_; }
+
+  /// feature budget of each level
+  const std::vector<int> &FeaturesPerLevel() const { return features_per_level_; }
+
+  const Options &GetOptions() const { return options_; }
+
+private:
+  void BuildPyramid(const cv::Mat &img);
+
+  /// grid FAST on one level, coordinates in the level image
+  void DetectLevel(int level, std::vector<cv::KeyPoint> &keypoints) const;
+
+  /// keep at most n keypoints spread over [min_x, max_x) x [min_y, max_y) with a quadtree
+  static std::vector<cv::KeyPoint> DistributeQuadtree(const std::vector<cv::KeyPoint> &keypoints, float min_x,
+                                                      float max_x, float min_y, float max_y, int n);
+
+  Options options_;
+  ORBDescriptorEngine engine_;
+  std::vector<float> scale_factors_;
+  std::vector<int> features_per_level_;
+  std::vector<cv::Mat> pyramid_;
+
+  // per level results, kept to reuse their buffers in the next Extract
+  std::vector<std::vector<cv::KeyPoint>> level_keypoints_;
+  std::vector<DescriptorMatrix> level_descriptors_;
+};
@@ -0,0 +1,130 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <random>
+#include <g2o/core/sparse_optimizer.h>
+#include <g2o/core/block_solver.h>
+#include <g2o/core/robust_kernel_impl.h>
+#include <g2o/core/optimization_algorithm_gauss_newton.h>
+#include <g2o/solvers/dense/linear_solver_dense.h>
+#include "pnp_g2o_types.h"
+#include "pnp_refiner.h"
+
+using namespace std;
+
+/**
+ * PnPRefiner against the g2o pose-only optimization of pose_estimation_3d2d on synthetic data:
+ * points in front of the camera, 1 pixel noise, 10% outliers, initial pose perturbed from the ground truth.
+ * Time includes building the problem (graph or SoA arrays).
+ */
+
+typedef vector<Eigen::Vector2d, Eigen::aligned_allocator<Eigen::Vector2d>> VecVector2d;
+typedef vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d>> VecVector3d;
+
+const double fx = 520.9, fy = 521.0, cx = 325.1, cy = 249.7;
+
+Sophus::SE3d SolveG2O(const VecVector3d &points_3d, const VecVector2d &points_2d, const Sophus::SE3d &initial,
+                      bool robust) {
+  typedef g2o::BlockSolver<g2o::BlockSolverTraits<6, 3>> BlockSolverType;
+  typedef g2o::LinearSolverDense<BlockSolverType::PoseMatrixType> LinearSolverType;
+  auto solver = new g2o::OptimizationAlgorithmGaussNewton(
+    g2o::make_unique<BlockSolverType>(g2o::make_unique<LinearSolverType>()));
+  g2o::SparseOptimizer optimizer;
+  optimizer.setAlgorithm(solver);
+
+  VertexPose *vertex_pose = new VertexPose();
+  vertex_pose->setId(0);
+  vertex_pose->setEstimate(initial);
+  optimizer.addVertex(vertex_pose);
+
+  Eigen::Matrix3d K;
+  K << fx, 0, cx, 0, fy, cy, 0, 0, 1;
+  for (size_t i = 0; i < points_2d.size(); ++i) {
+    EdgeProjection *edge = new EdgeProjection(points_3d[i], K);
+    edge->setId(i + 1);
+    edge->setVertex(0, vertex_pose);
+    edge->setMeasurement(points_2d[i]);
+    edge->setInformation(Eigen::Matrix2d::Identity());
+    if (robust) {
+      auto rk = new g2o::RobustKernelHuber;
+      rk->setDelta(2.4477);
+      edge->setRobustKernel(rk);
+    }
+    optimizer.addEdge(edge);
+  }
+  optimizer.initializeOptimization();
+  optimizer.optimize(10);
+  return vertex_pose->estimate();
+}
+
+Sophus::SE3d SolveRefiner(const VecVector3d &points_3d, const VecVector2d &points_2d, const Sophus::SE3d &initial,
+                          const PnPRefiner &refiner) {
+  PnPCorrespondences correspondences;
+  correspondences.reserve(points_3d.size());
+  for (size_t i = 0; i < points_3d.size(); ++i) {
+    correspondences.push_back(points_3d[i], points_2d[i]);
+  }
+  Sophus::SE3d pose = initial;
+  refiner.Refine(correspondences, pose);
+  return pose;
+}
+
+int main(int argc, char **argv) {
+  mt19937 rng(0);
+  uniform_real_distribution<double> uniform(-1, 1);
+  normal_distribution<double> noise(0, 1);
+
+  Eigen::Matrix<double, 6, 1> twist;
+  twist << 0.3, -0.1, 0.2, 0.05, -0.1, 0.08;
+  const Sophus::SE3d pose_gt = Sophus::SE3d::exp(twist);
+  twist << 0.02, 0.02, -0.02, 0.01, -0.01, 0.01;
+  const Sophus::SE3d initial = Sophus::SE3d::exp(twist) * pose_gt;
+
+  PnPRefiner::Options gn_options;
+  gn_options.levenberg_marquardt = false;
+  const PnPRefiner gn(fx, fy, cx, cy, gn_options);
+  PnPRefiner::Options robust_options;
+  robust_options.kernel = PnPRefiner::Kernel::kHuber;
+  const PnPRefiner robust(fx, fy, cx, cy, robust_options);
+
+  cout << "points   g2o(ms)  g2o huber(ms)  gn(ms)  lm huber(ms)  speedup  | translation error: g2o huber  lm huber"
+       << endl;
+  for (int n : {100, 300, 1000, 3000, 10000}) {
+    VecVector3d points_3d;
+    VecVector2d points_2d;
+    while (int(points_3d.size()) < n) {
+      Eigen::Vector3d pc(uniform(rng) * 3, uniform(rng) * 2, 4 + 3 * uniform(rng));
+      Eigen::Vector2d px(fx * pc[0] / pc[2] + cx, fy * pc[1] / pc[2] + cy);
+      if (points_3d.size() % 10 == 9) {
+        px += Eigen::Vector2d(uniform(rng), uniform(rng)) * 50;  // outlier
+      } else {
+        px += Eigen::Vector2d(noise(rng), noise(rng));
+      }
+      points_3d.push_back(pose_gt.inverse() * pc);
+      points_2d.push_back(px);
+    }
+
+    const int repeat = max(1, 10000 / n);
+    double times[4] = {0, 0, 0, 0};
+    Sophus::SE3d poses[4];
+    for (int method = 0; method < 4; ++method) {
+      chrono::steady_clock::time_point t1 = chrono::steady_clock::now();
+      for (int r = 0; r < repeat; ++r) {
+        switch (method) {
+          case 0: poses[0] = SolveG2O(points_3d, points_2d, initial, false); break;
+          case 1: poses[1] = SolveG2O(points_3d, points_2d, initial, true); break;
+          case 2: poses[2] = SolveRefiner(points_3d, points_2d, initial, gn); break;
+          default: poses[3] = SolveRefiner(points_3d, points_2d, initial, robust); break;
+        }
+      }
+      chrono::steady_clock::time_point t2 = chrono::steady_clock::now();
+      times[method] = chrono::duration_cast<chrono::duration<double>>(t2 - t1).count() / repeat * 1e3;
+    }
+
+    cout << setw(6) << n << setw(10) << times[0] << setw(15) << times[1] << setw(8) << times[2] << setw(14)
+         << times[3] << setw(9) << times[1] / times[3] << "  | " << setw(30)
+         << (poses[1].translation() - pose_gt.translation()).norm() << setw(10)
+         << (poses[3].translation() - pose_gt.translation()).norm() << endl;
+  }
+  return 0;
+}
@@ -0,0 +1,145 @@
+#include "pnp_refiner.h"
+
+#include <opencv2/core/core.hpp>
+#include <Eigen/Cholesky>
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+
+using namespace std;
+
+void PnPRefiner::Accumulate(const PnPCorrespondences &correspondences, const Sophus::SE3d &pose, int begin,
+                            int end, NormalEquations &result) const {
+  const Eigen::Matrix3d R = pose.rotationMatrix();
+  const Eigen::Vector3d t = pose.translation();
+  const double r00 = R(0, 0), r01 = R(0, 1), r02 = R(0, 2), tx = t[0];
+  const double r10 = R(1, 0), r11 = R(1, 1), r12 = R(1, 2), ty = t[1];
+  const double r20 = R(2, 0), r21 = R(2, 1), r22 = R(2, 2), tz = t[2];
+  const double *px = correspondences.x.data(), *py = correspondences.y.data(), *pz = correspondences.z.data();
+  const double *pu = correspondences.u.data(), *pv = correspondences.v.data();
+  const double delta2 = options_.kernel_delta * options_.kernel_delta;
+
+  Matrix6d H = Matrix6d::Zero();
+  Vector6d b = Vector6d::Zero();
+  double cost = 0;
+  int num_inliers = 0;
+  for (int i = begin; i < end; ++i) {
+    const double X = r00 * px[i] + r01 * py[i] + r02 * pz[i] + tx;
+    const double Y = r10 * px[i] + r11 * py[i] + r12 * pz[i] + ty;
+    const double Z = r20 * px[i] + r21 * py[i] + r22 * pz[i] + tz;
+    if (Z < 1e-6) continue;  // behind the camera
+    const double inv_z = 1.0 / Z, inv_z2 = inv_z * inv_z;
+    const double eu = pu[i] - (fx_ * X * inv_z + cx_);
+    const double ev = pv[i] - (fy_ * Y * inv_z + cy_);
+    const double e2 = eu * eu + ev * ev;
+
+    // robust cost rho(e2) and its weight rho'(e2)
+    double rho = e2, w = 1;
+    if (options_.kernel == Kernel::kHuber && e2 > delta2) {
+      const double e = sqrt(e2);
+      rho = 2 * options_.kernel_delta * e - delta2;
+      w = options_.kernel_delta / e;
+    } else if (options_.kernel == Kernel::kCauchy) {
+      rho = delta2 * log1p(e2 / delta2);
+      w = 1.0 / (1.0 + e2 / delta2);
+    }
+    cost += rho;
+    num_inliers += e2 <= delta2;
+
+    // d(e) / d(left perturbation), same as bundleAdjustmentGaussNewton
+    const double ju[6] = {-fx_ * inv_z, 0, fx_ * X * inv_z2, fx_ * X * Y * inv_z2, -fx_ - fx_ * X * X * inv_z2,
+                          fx_ * Y * inv_z};
+    const double jv[6] = {0, -fy_ * inv_z, fy_ * Y * inv_z2, fy_ + fy_ * Y * Y * inv_z2, -fy_ * X * Y * inv_z2,
+                          -fy_ * X * inv_z};
+    for (int r = 0; r < 6; ++r) {
+      const double wu = w * ju[r], wv = w * jv[r];
+      for (int c = r; c < 6; ++c) {
+        H(r, c) += wu * ju[c] + wv * jv[c];
+      }
+      b[r] -= wu * eu + wv * ev;
+    }
+  }
+  result.H = H;
+  result.b = b;
+  result.cost = cost;
+  result.num_inliers = num_inliers;
+}
+
+void PnPRefiner::Linearize(const PnPCorrespondences &correspondences, const Sophus::SE3d &pose,
+                           NormalEquations &result) const {
+  const int n = correspondences.size();
+  const int block_size = max(1, options_.block_size);
+  const int num_blocks = (n + block_size - 1) / block_size;
+  vector<NormalEquations, Eigen::aligned_allocator<NormalEquations>> partial(num_blocks);
+  cv::parallel_for_(cv::Range(0, num_blocks), [&](const cv::Range &range) {
+    for (int i = range.start; i < range.end; ++i) {
+      Accumulate(correspondences, pose, i * block_size, min(n, (i + 1) * block_size), partial[i]);
+    }
+  });
+
+  // fixed summation order: same result for any number of threads
+  result = NormalEquations();
+  for (auto &p : partial) {
+    result.H += p.H;
+    result.b += p.b;
+    result.cost += p.cost;
+    result.num_inliers += p.num_inliers;
+  }
+  result.H.triangularView<Eigen::StrictlyLower>() = result.H.transpose();
+}
+
+PnPRefiner::Summary PnPRefiner::Refine(const PnPCorrespondences &correspondences, Sophus::SE3d &pose) const {
+  Summary summary;
+  NormalEquations current;
+  Linearize(correspondences, pose, current);
+  summary.iterations = 1;
+  summary.initial_cost = current.cost;
+
+  double lambda = options_.initial_lambda;
+  for (int iter = 0; iter < options_.max_iterations && correspondences.size() >= 3; ++iter) {
+    Matrix6d H = current.H;
+    if (options_.levenberg_marquardt) {
+      H.diagonal() *= 1 + lambda;
+    }
+    Vector6d dx = H.ldlt().solve(current.b);
+    if (!dx.allFinite()) {
+      if (options_.verbose) cout << "result is nan!" << endl;
+      break;
+    }
+    if (dx.norm() < options_.update_tolerance) {
+      summary.converged = true;
+      break;
+    }
+
+    Sophus::SE3d candidate = Sophus::SE3d::exp(dx) * pose;
+    NormalEquations next;
+    Linearize(correspondences, candidate, next);
+    ++summary.iterations;
+
+    if (next.cost >= current.cost) {
+      if (options_.verbose) cout << "cost: " << next.cost << ", last cost: " << current.cost << endl;
+      // gauss-newton gives up, levenberg-marquardt takes a shorter step
+      if (!options_.levenberg_marquardt) break;
+      lambda *= 10;
+      if (lambda > 1e8) break;
+      continue;
+    }
+
+    const double decrease = (current.cost - next.cost) / max(current.cost, 1e-12);
+    pose = candidate;
+    current = next;
+    lambda = max(lambda * 0.1, 1e-10);
+    if (options_.verbose) {
+      cout << "iteration " << iter << " cost=" << std::setprecision(12) << current.cost << endl;
+    }
+    if (decrease < options_.cost_tolerance) {
+      summary.converged = true;
+      break;
+    }
+  }
+
+  summary.final_cost = current.cost;
+  summary.num_inliers = current.num_inliers;
+  return summary;
+}
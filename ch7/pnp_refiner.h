@@ -0,0 +1,96 @@
+#pragma once
+
+#include <Eigen/Core>
+#include <sophus/se3.hpp>
+#include <vector>
+
+/// 3D-2D correspondences stored as structure of arrays
+struct PnPCorrespondences {
+  std::vector<double> x, y, z;  // points in the reference frame
+  std::vector<double> u, v;     // observed pixels
+
+  int size() const { return int(x.size()); }
+
+  void clear() {
+    x.clear(), y.clear(), z.clear(), u.clear(), v.clear();
+  }
+
+  void reserve(int n) {
+    x.reserve(n), y.reserve(n), z.reserve(n), u.reserve(n), v.reserve(n);
+  }
+
+  void push_back(const Eigen::Vector3d &point, const Eigen::Vector2d &pixel) {
+    x.push_back(point[0]), y.push_back(point[1]), z.push_back(point[2]);
+    u.push_back(pixel[0]), v.push_back(pixel[1]);
+  }
+};
+
+/**
+ * Pose-only bundle adjustment (PnP refinement) of T_cw, left perturbation on SE3 as in bundleAdjustmentGaussNewton.
+ * - H and b are accumulated over fixed blocks of points in parallel, then summed in block order, so the result does
+ *   not depend on the number of threads
+ * - Huber or Cauchy weighting of the reprojection error (iteratively reweighted least squares)
+ * - Levenberg-Marquardt damping (H + lambda * diag(H)), or plain Gauss-Newton that stops when the cost increases
+ * - stops when the update or the relative decrease of the cost is below a tolerance
+ */
+class PnPRefiner {
+public:
+  enum class Kernel { kNone, kHuber, kCauchy };
+
+  struct Options {
+    int max_iterations = 10;
+    Kernel kernel = Kernel::kNone;
+    double kernel_delta = 2.4477;        // in pixels, sqrt(5.991) (95% of chi2 with 2 dof)
+    bool levenberg_marquardt = true;
+    double initial_lambda = 1e-4;
+    double update_tolerance = 1e-6;      // stop when |dx| is smaller
+    double cost_tolerance = 1e-10;       // stop when the relative cost decrease is smaller
+    int block_size = 256;                // points per block of the parallel reduction
+    bool verbose = false;                // print the cost of every iteration
+  };
+
+  struct Summary {
+    double initial_cost = 0;
+    double final_cost = 0;
+    int iterations = 0;          // linearizations
+    int num_inliers = 0;         // points in front of the camera with error within kernel_delta at the end
+    bool converged = false;
+  };
+
+  PnPRefiner(double fx, double fy, double cx, double cy) : PnPRefiner(fx, fy, cx, cy, Options()) {}
+
+  PnPRefiner(double fx, double fy, double cx, double cy, const Options &options)
+    : fx_(fx), fy_(fy), cx_(cx), cy_(cy), options_(options) {}
+
+  /**
+   * refine pose with the correspondences
+   * @param correspondences points in the reference frame and their pixels in the current frame
+   * @param pose initial guess of T_cw, refined in place
+   */
+  Summary Refine(const PnPCorrespondences &correspondences, Sophus::SE3d &pose) const;
+
+  const Options &GetOptions() const { return options_; }
+
+private:
+  typedef Eigen::Matrix<double, 6, 6> Matrix6d;
+  typedef Eigen::Matrix<double, 6, 1> Vector6d;
+
+  /// normal equations and robust cost of all correspondences at a pose
+  struct NormalEquations {
+    Matrix6d H = Matrix6d::Zero();
+    Vector6d b = Vector6d::Zero();
+    double cost = 0;
+    int num_inliers = 0;
+  };
+
+  /// normal equations of the points in [begin, end)
+  void Accumulate(const PnPCorrespondences &correspondences, const Sophus::SE3d &pose, int begin, int end,
+                  NormalEquations &result) const;
+
+  /// parallel over blocks, reduced in block order
+  void Linearize(const PnPCorrespondences &correspondences, const Sophus::SE3d &pose,
+                 NormalEquations &result) const;
+
+  double fx_, fy_, cx_, cy_;
+  Options options_;
+};
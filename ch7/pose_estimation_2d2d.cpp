@@ -2,7 +2,11 @@
 #include <opencv2/core/core.hpp>
 #include <opencv2/features2d/features2d.hpp>
 #include <opencv2/highgui/highgui.hpp>
-#include <opencv2/calib3d/calib3d.hpp>
+#include <Eigen/Core>
+#include <opencv2/core/eigen.hpp>
+#include <chrono>
+#include "feature_matcher.h"
+#include "two_view_geometry.h"
 // #include "extra.h" // use this if in OpenCV2
 
 using namespace std;
@@ -12,12 +16,6 @@ using namespace cv;
  * 本程序演示了如何使用2D-2D的特征匹配估计相机运动
  * **************************************************/
 
-void find_feature_matches(
-  const Mat &img_1, const Mat &img_2,
-  std::vector<KeyPoint> &keypoints_1,
-  std::vector<KeyPoint> &keypoints_2,
-  std::vector<DMatch> &matches);
-
 void pose_estimation_2d2d(
   std::vector<KeyPoint> keypoints_1,
   std::vector<KeyPoint> keypoints_2,
@@ -39,7 +37,8 @@ int main(int argc, char **argv) {
 
   vector<KeyPoint> keypoints_1, keypoints_2;
   vector<DMatch> matches;
-  find_feature_matches(img_1, img_2, keypoints_1, keypoints_2, matches);
+  FeatureMatcher matcher;
+  matcher.Match(img_1, img_2, keypoints_1, keypoints_2, matches);
   cout << "一共找到了" << matches.size() << "组匹配点" << endl;
 
   //-- 估计两张图像间运动
@@ -67,53 +66,6 @@ int main(int argc, char **argv) {
   return 0;
 }
 
-void find_feature_matches(const Mat &img_1, const Mat &img_2,
-                          std::vector<KeyPoint> &keypoints_1,
-                          std::vector<KeyPoint> &keypoints_2,
-                          std::vector<DMatch> &matches) {
-  //-- 初始化
-  Mat descriptors_1, descriptors_2;
-  // used in OpenCV3
-  Ptr<FeatureDetector> detector = ORB::create();
-  Ptr<DescriptorExtractor> descriptor = ORB::create();
-  // use this if you are in OpenCV2
-  // Ptr<FeatureDetector> detector = FeatureDetector::create ( "ORB" );
-  // Ptr<DescriptorExtractor> descriptor = DescriptorExtractor::create ( "ORB" );
-  Ptr<DescriptorMatcher> matcher = DescriptorMatcher::create("BruteForce-Hamming");
-  //-- 第一步:检测 Oriented FAST 角点位置
-  detector->detect(img_1, keypoints_1);
-  detector->detect(img_2, keypoints_2);
-
-  //-- 第二步:根据角点位置计算 BRIEF 描述子
-  descriptor->compute(img_1, keypoints_1, descriptors_1);
-  descriptor->compute(img_2, keypoints_2, descriptors_2);
-
-  //-- 第三步:对两幅图像中的BRIEF描述子进行匹配，使用 Hamming 距离
-  vector<DMatch> match;
-  //BFMatcher matcher ( NORM_HAMMING );
-  matcher->match(descriptors_1, descriptors_2, match);
-
-  //-- 第四步:匹配点对筛选
-  double min_dist = 10000, max_dist = 0;
-
-  //找出所有匹配之间的最小距离和最大距离, 即是最相似的和最不相似的两组点之间的距离
-  for (int i = 0; i < descriptors_1.rows; i++) {
-    double dist = match[i].distance;
-    if (dist < min_dist) min_dist = dist;
-    if (dist > max_dist) max_dist = dist;
-  }
-
-  printf("-- Max dist : %f \n", max_dist);
-  printf("-- Min dist : %f \n", min_dist);
-
-  //当描述子之间的距离大于两倍的最小距离时,即认为匹配有误.但有时候最小距离会非常小,设置一个经验值30作为下限.
-  for (int i = 0; i < descriptors_1.rows; i++) {
-    if (match[i].distance <= max(2 * min_dist, 30.0)) {
-      matches.push_back(match[i]);
-    }
-  }
-}
-
 Point2d pixel2cam(const Point2d &p, const Mat &K) {
   return Point2d
     (
@@ -138,27 +90,37 @@ void pose_estimation_2d2d(std::vector<KeyPoint> keypoints_1,
     points2.push_back(keypoints_2[matches[i].trainIdx].pt);
   }
 
-  //-- 计算基础矩阵
-  Mat fundamental_matrix;
-  fundamental_matrix = findFundamentalMat(points1, points2, CV_FM_8POINT);
-  cout << "fundamental_matrix is " << endl << fundamental_matrix << endl;
-
-  //-- 计算本质矩阵
-  Point2d principal_point(325.1, 249.7);  //相机光心, TUM dataset标定值
-  double focal_length = 521;      //相机焦距, TUM dataset标定值
-  Mat essential_matrix;
-  essential_matrix = findEssentialMat(points1, points2, focal_length, principal_point);
-  cout << "essential_matrix is " << endl << essential_matrix << endl;
-
-  //-- 计算单应矩阵
-  //-- 但是本例中场景不是平面，单应矩阵意义不大
-  Mat homography_matrix;
-  homography_matrix = findHomography(points1, points2, RANSAC, 3);
-  cout << "homography_matrix is " << endl << homography_matrix << endl;
-
-  //-- 从本质矩阵中恢复旋转和平移信息.
-  // 此函数仅在Opencv3中提供
-  recoverPose(essential_matrix, points1, points2, R, t, focal_length, principal_point);
+  //-- 同时估计本质矩阵和单应矩阵, 按得分选择模型 (PROSAC按描述子距离排序采样)
+  vector<float> quality;
+  for (DMatch m: matches) quality.push_back(m.distance);
+  Eigen::Matrix3d K_eigen;
+  cv2eigen(K, K_eigen);
+  TwoViewGeometry geometry(K_eigen);
+  TwoViewGeometry::Result result;
+  chrono::steady_clock::time_point t1 = chrono::steady_clock::now();
+  bool success = geometry.Estimate(points1, points2, quality, result);
+  chrono::steady_clock::time_point t2 = chrono::steady_clock::now();
+  chrono::duration<double> time_used = chrono::duration_cast<chrono::duration<double>>(t2 - t1);
+  cout << "two view geometry cost time: " << time_used.count() << " seconds, kernel "
+       << TwoViewGeometry::KernelName() << endl;
+
+  //-- 基础矩阵 F = K^-T E K^-1
+  Eigen::Matrix3d F = K_eigen.inverse().transpose() * result.E * K_eigen.inverse();
+  cout << "fundamental_matrix is " << endl << F / F(2, 2) << endl;
+  cout << "essential_matrix is " << endl << result.E << endl;
+  //-- 本例中场景不是平面，单应矩阵意义不大, 得分比 S_H / (S_H + S_E) 较小
+  cout << "homography_matrix is " << endl << K_eigen * result.H * K_eigen.inverse() << endl;
+  cout << "score E = " << result.score_essential << ", score H = " << result.score_homography << ", selected "
+       << (result.model == TwoViewGeometry::Model::kHomography ? "homography" : "essential") << endl;
+
+  int num_inliers = 0;
+  for (uint8_t inlier: result.inliers) num_inliers += inlier;
+  cout << num_inliers << " inliers, " << result.num_triangulated << " triangulated, parallax "
+       << result.parallax << " deg" << (success ? "" : " (not well determined)") << endl;
+
+  //-- 从选择的模型中恢复旋转和平移信息.
+  eigen2cv(result.R, R);
+  eigen2cv(result.t, t);
   cout << "R is " << endl << R << endl;
   cout << "t is " << endl << t << endl;
 
@@ -13,16 +13,13 @@
 #include <g2o/solvers/dense/linear_solver_dense.h>
 #include <sophus/se3.hpp>
 #include <chrono>
+#include "feature_matcher.h"
+#include "pnp_g2o_types.h"
+#include "pnp_refiner.h"
 
 using namespace std;
 using namespace cv;
 
-void find_feature_matches(
-  const Mat &img_1, const Mat &img_2,
-  std::vector<KeyPoint> &keypoints_1,
-  std::vector<KeyPoint> &keypoints_2,
-  std::vector<DMatch> &matches);
-
 // 像素坐标转相机归一化坐标
 Point2d pixel2cam(const Point2d &p, const Mat &K);
 
@@ -57,7 +54,8 @@ int main(int argc, char **argv) {
 
   vector<KeyPoint> keypoints_1, keypoints_2;
   vector<DMatch> matches;
-  find_feature_matches(img_1, img_2, keypoints_1, keypoints_2, matches);
+  FeatureMatcher matcher;
+  matcher.Match(img_1, img_2, keypoints_1, keypoints_2, matches);
   cout << "一共找到了" << matches.size() << "组匹配点" << endl;
 
   // 建立3D点
@@ -114,53 +112,6 @@ int main(int argc, char **argv) {
   return 0;
 }
 
-void find_feature_matches(const Mat &img_1, const Mat &img_2,
-                          std::vector<KeyPoint> &keypoints_1,
-                          std::vector<KeyPoint> &keypoints_2,
-                          std::vector<DMatch> &matches) {
-  //-- 初始化
-  Mat descriptors_1, descriptors_2;
-  // used in OpenCV3
-  Ptr<FeatureDetector> detector = ORB::create();
-  Ptr<DescriptorExtractor> descriptor = ORB::create();
-  // use this if you are in OpenCV2
-  // Ptr<FeatureDetector> detector = FeatureDetector::create ( "ORB" );
-  // Ptr<DescriptorExtractor> descriptor = DescriptorExtractor::create ( "ORB" );
-  Ptr<DescriptorMatcher> matcher = DescriptorMatcher::create("BruteForce-Hamming");
-  //-- 第一步:检测 Oriented FAST 角点位置
-  detector->detect(img_1, keypoints_1);
-  detector->detect(img_2, keypoints_2);
-
-  //-- 第二步:根据角点位置计算 BRIEF 描述子
-  descriptor->compute(img_1, keypoints_1, descriptors_1);
-  descriptor->compute(img_2, keypoints_2, descriptors_2);
-
-  //-- 第三步:对两幅图像中的BRIEF描述子进行匹配，使用 Hamming 距离
-  vector<DMatch> match;
-  // BFMatcher matcher ( NORM_HAMMING );
-  matcher->match(descriptors_1, descriptors_2, match);
-
-  //-- 第四步:匹配点对筛选
-  double min_dist = 10000, max_dist = 0;
-
-  //找出所有匹配之间的最小距离和最大距离, 即是最相似的和最不相似的两组点之间的距离
-  for (int i = 0; i < descriptors_1.rows; i++) {
-    double dist = match[i].distance;
-    if (dist < min_dist) min_dist = dist;
-    if (dist > max_dist) max_dist = dist;
-  }
-
-  printf("-- Max dist : %f \n", max_dist);
-  printf("-- Min dist : %f \n", min_dist);
-
-  //当描述子之间的距离大于两倍的最小距离时,即认为匹配有误.但有时候最小距离会非常小,设置一个经验值30作为下限.
-  for (int i = 0; i < descriptors_1.rows; i++) {
-    if (match[i].distance <= max(2 * min_dist, 30.0)) {
-      matches.push_back(match[i]);
-    }
-  }
-}
-
 Point2d pixel2cam(const Point2d &p, const Mat &K) {
   return Point2d
     (
@@ -174,136 +125,24 @@ void bundleAdjustmentGaussNewton(
   const VecVector2d &points_2d,
   const Mat &K,
   Sophus::SE3d &pose) {
-  typedef Eigen::Matrix<double, 6, 1> Vector6d;
-  const int iterations = 10;
-  double cost = 0, lastCost = 0;
-  double fx = K.at<double>(0, 0);
-  double fy = K.at<double>(1, 1);
-  double cx = K.at<double>(0, 2);
-  double cy = K.at<double>(1, 2);
-
-  for (int iter = 0; iter < iterations; iter++) {
-    Eigen::Matrix<double, 6, 6> H = Eigen::Matrix<double, 6, 6>::Zero();
-    Vector6d b = Vector6d::Zero();
-
-    cost = 0;
-    // compute cost
-    for (int i = 0; i < points_3d.size(); i++) {
-      Eigen::Vector3d pc = pose * points_3d[i];
-      double inv_z = 1.0 / pc[2];
-      double inv_z2 = inv_z * inv_z;
-      Eigen::Vector2d proj(fx * pc[0] / pc[2] + cx, fy * pc[1] / pc[2] + cy);
-
-      Eigen::Vector2d e = points_2d[i] - proj;
-
-      cost += e.squaredNorm();
-      Eigen::Matrix<double, 2, 6> J;
-      J << -fx * inv_z,
-        0,
-        fx * pc[0] * inv_z2,
-        fx * pc[0] * pc[1] * inv_z2,
-        -fx - fx * pc[0] * pc[0] * inv_z2,
-        fx * pc[1] * inv_z,
-        0,
-        -fy * inv_z,
-        fy * pc[1] * inv_z2,
-        fy + fy * pc[1] * pc[1] * inv_z2,
-        -fy * pc[0] * pc[1] * inv_z2,
-        -fy * pc[0] * inv_z;
-
-      H += J.transpose() * J;
-      b += -J.transpose() * e;
-    }
-
-    Vector6d dx;
-    dx = H.ldlt().solve(b);
-
-    if (isnan(dx[0])) {
-      cout << "result is nan!" << endl;
-      break;
-    }
-
-    if (iter > 0 && cost >= lastCost) {
-      // cost increase, update is not good
-      cout << "cost: " << cost << ", last cost: " << lastCost << endl;
-      break;
-    }
-
-    // update your estimation
-    pose = Sophus::SE3d::exp(dx) * pose;
-    lastCost = cost;
-
-    cout << "iteration " << iter << " cost=" << std::setprecision(12) << cost << endl;
-    if (dx.norm() < 1e-6) {
-      // converge
-      break;
-    }
+  PnPCorrespondences correspondences;
+  correspondences.reserve(points_3d.size());
+  for (size_t i = 0; i < points_3d.size(); i++) {
+    correspondences.push_back(points_3d[i], points_2d[i]);
   }
 
+  // gauss-newton as in the book, see PnPRefiner::Options for robust kernels and LM
+  PnPRefiner::Options options;
+  options.levenberg_marquardt = false;
+  options.verbose = true;
+  PnPRefiner refiner(K.at<double>(0, 0), K.at<double>(1, 1), K.at<double>(0, 2), K.at<double>(1, 2), options);
+  PnPRefiner::Summary summary = refiner.Refine(correspondences, pose);
+  cout << "cost " << summary.initial_cost << " -> " << summary.final_cost << " in " << summary.iterations
+       << " linearizations" << endl;
+
   cout << "pose by g-n: \n" << pose.matrix() << endl;
 }
 
-/// vertex and edges used in g2o ba
-class VertexPose : public g2o::BaseVertex<6, Sophus::SE3d> {
-public:
-  EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
-
-  virtual void setToOriginImpl() override {
-    _estimate = Sophus::SE3d();
-  }
-
-  /// left multiplication on SE3
-  virtual void oplusImpl(const double *update) override {
-    Eigen::Matrix<double, 6, 1> update_eigen;
-    update_eigen << update[0], update[1], update[2], update[3], update[4], update[5];
-    _estimate = Sophus::SE3d::exp(update_eigen) * _estimate;
-  }
-
-  virtual bool read(istream &in) override {}
-
-  virtual bool write(ostream &out) const override {}
-};
-
-class EdgeProjection : public g2o::BaseUnaryEdge<2, Eigen::Vector2d, VertexPose> {
-public:
-  EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
-
-  EdgeProjection(const Eigen::Vector3d &pos, const Eigen::Matrix3d &K) : _pos3d(pos), _K(K) {}
-
-  virtual void computeError() override {
-    const VertexPose *v = static_cast<VertexPose *> (_vertices[0]);
-    Sophus::SE3d T = v->estimate();
-    Eigen::Vector3d pos_pixel = _K * (T * _pos3d);
-    pos_pixel /= pos_pixel[2];
-    _error = _measurement - pos_pixel.head<2>();
-  }
-
-  virtual void linearizeOplus() override {
-    const VertexPose *v = static_cast<VertexPose *> (_vertices[0]);
-    Sophus::SE3d T = v->estimate();
-    Eigen::Vector3d pos_cam = T * _pos3d;
-    double fx = _K(0, 0);
-    double fy = _K(1, 1);
-    double cx = _K(0, 2);
-    double cy = _K(1, 2);
-    double X = pos_cam[0];
-    double Y = pos_cam[1];
-    double Z = pos_cam[2];
-    double Z2 = Z * Z;
-    _jacobianOplusXi
-      << -fx / Z, 0, fx * X / Z2, fx * X * Y / Z2, -fx - fx * X * X / Z2, fx * Y / Z,
-      0, -fy / Z, fy * Y / (Z * Z), fy + fy * Y * Y / Z2, -fy * X * Y / Z2, -fy * X / Z;
-  }
-
-  virtual bool read(istream &in) override {}
-
-  virtual bool write(ostream &out) const override {}
-
-private:
-  Eigen::Vector3d _pos3d;
-  Eigen::Matrix3d _K;
-};
-
 void bundleAdjustmentG2O(
   const VecVector3d &points_3d,
   const VecVector2d &points_2d,
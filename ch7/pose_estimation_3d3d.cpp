@@ -15,19 +15,18 @@
 #include <g2o/solvers/dense/linear_solver_dense.h>
 #include <chrono>
 #include <sophus/se3.hpp>
+#include "feature_matcher.h"
+#include "icp_solver.h"
 
 using namespace std;
 using namespace cv;
 
-void find_feature_matches(
-  const Mat &img_1, const Mat &img_2,
-  std::vector<KeyPoint> &keypoints_1,
-  std::vector<KeyPoint> &keypoints_2,
-  std::vector<DMatch> &matches);
-
 // 像素坐标转相机归一化坐标
 Point2d pixel2cam(const Point2d &p, const Mat &K);
 
+// 深度图上一个像素处的表面法向量
+bool normalFromDepth(const Mat &depth, const Mat &K, int u, int v, Eigen::Vector3d &normal);
+
 void pose_estimation_3d3d(
   const vector<Point3f> &pts1,
   const vector<Point3f> &pts2,
@@ -100,7 +99,8 @@ int main(int argc, char **argv) {
 
   vector<KeyPoint> keypoints_1, keypoints_2;
   vector<DMatch> matches;
-  find_feature_matches(img_1, img_2, keypoints_1, keypoints_2, matches);
+  FeatureMatcher matcher;
+  matcher.Match(img_1, img_2, keypoints_1, keypoints_2, matches);
   cout << "一共找到了" << matches.size() << "组匹配点" << endl;
 
   // 建立3D点
@@ -108,6 +108,7 @@ int main(int argc, char **argv) {
   Mat depth2 = imread(argv[4], CV_LOAD_IMAGE_UNCHANGED);       // 深度图为16位无符号数，单通道图像
   Mat K = (Mat_<double>(3, 3) << 520.9, 0, 325.1, 0, 521.0, 249.7, 0, 0, 1);
   vector<Point3f> pts1, pts2;
+  vector<Eigen::Vector3d> normals1;
 
   for (DMatch m:matches) {
     ushort d1 = depth1.ptr<unsigned short>(int(keypoints_1[m.queryIdx].pt.y))[int(keypoints_1[m.queryIdx].pt.x)];
@@ -120,6 +121,9 @@ int main(int argc, char **argv) {
     float dd2 = float(d2) / 5000.0;
     pts1.push_back(Point3f(p1.x * dd1, p1.y * dd1, dd1));
     pts2.push_back(Point3f(p2.x * dd2, p2.y * dd2, dd2));
+    Eigen::Vector3d n1 = Eigen::Vector3d::Zero();
+    normalFromDepth(depth1, K, int(keypoints_1[m.queryIdx].pt.x), int(keypoints_1[m.queryIdx].pt.y), n1);
+    normals1.push_back(n1);
   }
 
   cout << "3d-3d pairs: " << pts1.size() << endl;
@@ -131,6 +135,23 @@ int main(int argc, char **argv) {
   cout << "R_inv = " << R.t() << endl;
   cout << "t_inv = " << -R.t() * t << endl;
 
+  // robust version: RANSAC over 3 point sets, then point-to-plane with the normals of the first depth map
+  IcpCorrespondences correspondences;
+  for (size_t i = 0; i < pts1.size(); i++) {
+    correspondences.push_back(Eigen::Vector3d(pts1[i].x, pts1[i].y, pts1[i].z),
+                              Eigen::Vector3d(pts2[i].x, pts2[i].y, pts2[i].z), normals1[i]);
+  }
+  IcpSolver solver;
+  Sophus::SE3d T_ransac;
+  vector<uint8_t> inliers;
+  chrono::steady_clock::time_point t1 = chrono::steady_clock::now();
+  int num_inliers = solver.Estimate(correspondences, T_ransac, inliers);
+  chrono::steady_clock::time_point t2 = chrono::steady_clock::now();
+  chrono::duration<double> time_used = chrono::duration_cast<chrono::duration<double>>(t2 - t1);
+  cout << "ICP with RANSAC: " << num_inliers << " inliers in " << solver.LastIterations() << " iterations, cost "
+       << time_used.count() << " seconds." << endl;
+  cout << "T = " << endl << T_ransac.matrix() << endl;
+
   cout << "calling bundle adjustment" << endl;
 
   bundleAdjustment(pts1, pts2, R, t);
@@ -146,53 +167,6 @@ int main(int argc, char **argv) {
   }
 }
 
-void find_feature_matches(const Mat &img_1, const Mat &img_2,
-                          std::vector<KeyPoint> &keypoints_1,
-                          std::vector<KeyPoint> &keypoints_2,
-                          std::vector<DMatch> &matches) {
-  //-- 初始化
-  Mat descriptors_1, descriptors_2;
-  // used in OpenCV3
-  Ptr<FeatureDetector> detector = ORB::create();
-  Ptr<DescriptorExtractor> descriptor = ORB::create();
-  // use this if you are in OpenCV2
-  // Ptr<FeatureDetector> detector = FeatureDetector::create ( "ORB" );
-  // Ptr<DescriptorExtractor> descriptor = DescriptorExtractor::create ( "ORB" );
-  Ptr<DescriptorMatcher> matcher = DescriptorMatcher::create("BruteForce-Hamming");
-  //-- 第一步:检测 Oriented FAST 角点位置
-  detector->detect(img_1, keypoints_1);
-  detector->detect(img_2, keypoints_2);
-
-  //-- 第二步:根据角点位置计算 BRIEF 描述子
-  descriptor->compute(img_1, keypoints_1, descriptors_1);
-  descriptor->compute(img_2, keypoints_2, descriptors_2);
-
-  //-- 第三步:对两幅图像中的BRIEF描述子进行匹配，使用 Hamming 距离
-  vector<DMatch> match;
-  // BFMatcher matcher ( NORM_HAMMING );
-  matcher->match(descriptors_1, descriptors_2, match);
-
-  //-- 第四步:匹配点对筛选
-  double min_dist = 10000, max_dist = 0;
-
-  //找出所有匹配之间的最小距离和最大距离, 即是最相似的和最不相似的两组点之间的距离
-  for (int i = 0; i < descriptors_1.rows; i++) {
-    double dist = match[i].distance;
-    if (dist < min_dist) min_dist = dist;
-    if (dist > max_dist) max_dist = dist;
-  }
-
-  printf("-- Max dist : %f \n", max_dist);
-  printf("-- Min dist : %f \n", min_dist);
-
-  //当描述子之间的距离大于两倍的最小距离时,即认为匹配有误.但有时候最小距离会非常小,设置一个经验值30作为下限.
-  for (int i = 0; i < descriptors_1.rows; i++) {
-    if (match[i].distance <= max(2 * min_dist, 30.0)) {
-      matches.push_back(match[i]);
-    }
-  }
-}
-
 Point2d pixel2cam(const Point2d &p, const Mat &K) {
   return Point2d(
     (p.x - K.at<double>(0, 2)) / K.at<double>(0, 0),
@@ -203,40 +177,17 @@ Point2d pixel2cam(const Point2d &p, const Mat &K) {
 void pose_estimation_3d3d(const vector<Point3f> &pts1,
                           const vector<Point3f> &pts2,
                           Mat &R, Mat &t) {
-  Point3f p1, p2;     // center of mass
-  int N = pts1.size();
-  for (int i = 0; i < N; i++) {
-    p1 += pts1[i];
-    p2 += pts2[i];
-  }
-  p1 = Point3f(Vec3f(p1) / N);
-  p2 = Point3f(Vec3f(p2) / N);
-  vector<Point3f> q1(N), q2(N); // remove the center
-  for (int i = 0; i < N; i++) {
-    q1[i] = pts1[i] - p1;
-    q2[i] = pts2[i] - p2;
-  }
-
-  // compute q1*q2^T
-  Eigen::Matrix3d W = Eigen::Matrix3d::Zero();
-  for (int i = 0; i < N; i++) {
-    W += Eigen::Vector3d(q1[i].x, q1[i].y, q1[i].z) * Eigen::Vector3d(q2[i].x, q2[i].y, q2[i].z).transpose();
+  IcpCorrespondences correspondences;
+  correspondences.reserve(pts1.size());
+  for (size_t i = 0; i < pts1.size(); i++) {
+    correspondences.push_back(Eigen::Vector3d(pts1[i].x, pts1[i].y, pts1[i].z),
+                              Eigen::Vector3d(pts2[i].x, pts2[i].y, pts2[i].z));
   }
-  cout << "W=" << W << endl;
 
-  // SVD on W
-  Eigen::JacobiSVD<Eigen::Matrix3d> svd(W, Eigen::ComputeFullU | Eigen::ComputeFullV);
-  Eigen::Matrix3d U = svd.matrixU();
-  Eigen::Matrix3d V = svd.matrixV();
-
-  cout << "U=" << U << endl;
-  cout << "V=" << V << endl;
-
-  Eigen::Matrix3d R_ = U * (V.transpose());
-  if (R_.determinant() < 0) {
-    R_ = -R_;
-  }
-  Eigen::Vector3d t_ = Eigen::Vector3d(p1.x, p1.y, p1.z) - R_ * Eigen::Vector3d(p2.x, p2.y, p2.z);
+  // centroids, W = sum q1 * q2^T and its SVD
+  Sophus::SE3d T = IcpSolver().Align(correspondences);
+  Eigen::Matrix3d R_ = T.rotationMatrix();
+  Eigen::Vector3d t_ = T.translation();
 
   // convert to cv::Mat
   R = (Mat_<double>(3, 3) <<
@@ -298,3 +249,25 @@ void bundleAdjustment(
   );
   t = (Mat_<double>(3, 1) << t_(0, 0), t_(1, 0), t_(2, 0));
 }
+
+bool normalFromDepth(const Mat &depth, const Mat &K, int u, int v, Eigen::Vector3d &normal) {
+  const int r = 2;
+  if (u < r || v < r || u >= depth.cols - r || v >= depth.rows - r) return false;
+  auto backProject = [&](int x, int y, Eigen::Vector3d &p) {
+    ushort d = depth.ptr<unsigned short>(y)[x];
+    if (d == 0) return false;
+    double z = d / 5000.0;
+    p = Eigen::Vector3d((x - K.at<double>(0, 2)) / K.at<double>(0, 0) * z,
+                        (y - K.at<double>(1, 2)) / K.at<double>(1, 1) * z, z);
+    return true;
+  };
+  Eigen::Vector3d center, left, right, up, down;
+  if (!backProject(u, v, center) || !backProject(u - r, v, left) || !backProject(u + r, v, right) ||
+      !backProject(u, v - r, up) || !backProject(u, v + r, down))
+    return false;
+  normal = (right - left).cross(down - up);
+  if (normal.norm() < 1e-12) return false;
+  normal.normalize();
+  if (normal.dot(center) > 0) normal = -normal;  // towards the camera
+  return true;
+}
@@ -1,15 +1,13 @@
 #include <iostream>
 #include <opencv2/opencv.hpp>
+#include <Eigen/Core>
+#include <opencv2/core/eigen.hpp>
+#include "feature_matcher.h"
+#include "triangulator.h"
 // #include "extra.h" // used in opencv2
 using namespace std;
 using namespace cv;
 
-void find_feature_matches(
-  const Mat &img_1, const Mat &img_2,
-  std::vector<KeyPoint> &keypoints_1,
-  std::vector<KeyPoint> &keypoints_2,
-  std::vector<DMatch> &matches);
-
 void pose_estimation_2d2d(
   const std::vector<KeyPoint> &keypoints_1,
   const std::vector<KeyPoint> &keypoints_2,
@@ -21,7 +19,8 @@ void triangulation(
   const vector<KeyPoint> &keypoint_2,
   const std::vector<DMatch> &matches,
   const Mat &R, const Mat &t,
-  vector<Point3d> &points
+  vector<Point3d> &points,
+  vector<uint8_t> &valid
 );
 
 /// 作图用
@@ -46,7 +45,8 @@ int main(int argc, char **argv) {
 
   vector<KeyPoint> keypoints_1, keypoints_2;
   vector<DMatch> matches;
-  find_feature_matches(img_1, img_2, keypoints_1, keypoints_2, matches);
+  FeatureMatcher matcher;
+  matcher.Match(img_1, img_2, keypoints_1, keypoints_2, matches);
   cout << "一共找到了" << matches.size() << "组匹配点" << endl;
 
   //-- 估计两张图像间运动
@@ -55,13 +55,15 @@ int main(int argc, char **argv) {
 
   //-- 三角化
   vector<Point3d> points;
-  triangulation(keypoints_1, keypoints_2, matches, R, t, points);
+  vector<uint8_t> valid;
+  triangulation(keypoints_1, keypoints_2, matches, R, t, points, valid);
 
   //-- 验证三角化点与特征点的重投影关系
   Mat K = (Mat_<double>(3, 3) << 520.9, 0, 325.1, 0, 521.0, 249.7, 0, 0, 1);
   Mat img1_plot = img_1.clone();
   Mat img2_plot = img_2.clone();
   for (int i = 0; i < matches.size(); i++) {
+    if (!valid[i]) continue;
     // 第一个图
     float depth1 = points[i].z;
     cout << "depth: " << depth1 << endl;
@@ -80,53 +82,6 @@ int main(int argc, char **argv) {
   return 0;
 }
 
-void find_feature_matches(const Mat &img_1, const Mat &img_2,
-                          std::vector<KeyPoint> &keypoints_1,
-                          std::vector<KeyPoint> &keypoints_2,
-                          std::vector<DMatch> &matches) {
-  //-- 初始化
-  Mat descriptors_1, descriptors_2;
-  // used in OpenCV3
-  Ptr<FeatureDetector> detector = ORB::create();
-  Ptr<DescriptorExtractor> descriptor = ORB::create();
-  // use this if you are in OpenCV2
-  // Ptr<FeatureDetector> detector = FeatureDetector::create ( "ORB" );
-  // Ptr<DescriptorExtractor> descriptor = DescriptorExtractor::create ( "ORB" );
-  Ptr<DescriptorMatcher> matcher = DescriptorMatcher::create("BruteForce-Hamming");
-  //-- 第一步:检测 Oriented FAST 角点位置
-  detector->detect(img_1, keypoints_1);
-  detector->detect(img_2, keypoints_2);
-
-  //-- 第二步:根据角点位置计算 BRIEF 描述子
-  descriptor->compute(img_1, keypoints_1, descriptors_1);
-  descriptor->compute(img_2, keypoints_2, descriptors_2);
-
-  //-- 第三步:对两幅图像中的BRIEF描述子进行匹配，使用 Hamming 距离
-  vector<DMatch> match;
-  // BFMatcher matcher ( NORM_HAMMING );
-  matcher->match(descriptors_1, descriptors_2, match);
-
-  //-- 第四步:匹配点对筛选
-  double min_dist = 10000, max_dist = 0;
-
-  //找出所有匹配之间的最小距离和最大距离, 即是最相似的和最不相似的两组点之间的距离
-  for (int i = 0; i < descriptors_1.rows; i++) {
-    double dist = match[i].distance;
-    if (dist < min_dist) min_dist = dist;
-    if (dist > max_dist) max_dist = dist;
-  }
-
-  printf("-- Max dist : %f \n", max_dist);
-  printf("-- Min dist : %f \n", min_dist);
-
-  //当描述子之间的距离大于两倍的最小距离时,即认为匹配有误.但有时候最小距离会非常小,设置一个经验值30作为下限.
-  for (int i = 0; i < descriptors_1.rows; i++) {
-    if (match[i].distance <= max(2 * min_dist, 30.0)) {
-      matches.push_back(match[i]);
-    }
-  }
-}
-
 void pose_estimation_2d2d(
   const std::vector<KeyPoint> &keypoints_1,
   const std::vector<KeyPoint> &keypoints_2,
@@ -159,39 +114,40 @@ void triangulation(
   const vector<KeyPoint> &keypoint_2,
   const std::vector<DMatch> &matches,
   const Mat &R, const Mat &t,
-  vector<Point3d> &points) {
-  Mat T1 = (Mat_<float>(3, 4) <<
-    1, 0, 0, 0,
-    0, 1, 0, 0,
-    0, 0, 1, 0);
-  Mat T2 = (Mat_<float>(3, 4) <<
-    R.at<double>(0, 0), R.at<double>(0, 1), R.at<double>(0, 2), t.at<double>(0, 0),
-    R.at<double>(1, 0), R.at<double>(1, 1), R.at<double>(1, 2), t.at<double>(1, 0),
-    R.at<double>(2, 0), R.at<double>(2, 1), R.at<double>(2, 2), t.at<double>(2, 0)
-  );
-
-  Mat K = (Mat_<double>(3, 3) << 520.9, 0, 325.1, 0, 521.0, 249.7, 0, 0, 1);
-  vector<Point2f> pts_1, pts_2;
+  vector<Point3d> &points,
+  vector<uint8_t> &valid) {
+  Eigen::Matrix3d K;
+  K << 520.9, 0, 325.1, 0, 521.0, 249.7, 0, 0, 1;
+  Eigen::Matrix3d R_21;
+  Eigen::Vector3d t_21;
+  cv2eigen(R, R_21);
+  cv2eigen(t, t_21);
+  // 第一个相机为世界坐标系
+  vector<Sophus::SE3d> poses = {Sophus::SE3d(), Sophus::SE3d(Eigen::Quaterniond(R_21).normalized(), t_21)};
+
+  // 每个匹配是一条有两个观测的轨迹, 直接使用像素坐标
+  TrackObservations tracks;
+  tracks.reserve(matches.size(), 2 * matches.size());
   for (DMatch m:matches) {
-    // 将像素坐标转换至相机坐标
-    pts_1.push_back(pixel2cam(keypoint_1[m.queryIdx].pt, K));
-    pts_2.push_back(pixel2cam(keypoint_2[m.trainIdx].pt, K));
+    const Point2f &p1 = keypoint_1[m.queryIdx].pt, &p2 = keypoint_2[m.trainIdx].pt;
+    tracks.push_back(0, Eigen::Vector2d(p1.x, p1.y));
+    tracks.push_back(1, Eigen::Vector2d(p2.x, p2.y));
+    tracks.endTrack();
   }
 
-  Mat pts_4d;
-  cv::triangulatePoints(T1, T2, pts_1, pts_2, pts_4d);
-
-  // 转换成非齐次坐标
-  for (int i = 0; i < pts_4d.cols; i++) {
-    Mat x = pts_4d.col(i);
-    x /= x.at<float>(3, 0); // 归一化
-    Point3d p(
-      x.at<float>(0, 0),
-      x.at<float>(1, 0),
-      x.at<float>(2, 0)
-    );
-    points.push_back(p);
+  // 视差太小或在相机后面的点被标记为无效, 本例基线较短, 放宽视差阈值
+  Triangulator::Options options;
+  options.min_parallax = 0.5;
+  Triangulator triangulator(K, options);
+  TriangulatedPoints result;
+  int num_valid = triangulator.Triangulate(poses, tracks, result);
+  cout << "triangulated " << num_valid << " of " << tracks.numTracks() << " points" << endl;
+
+  points.clear();
+  for (int i = 0; i < result.size(); i++) {
+    points.push_back(Point3d(result.x[i], result.y[i], result.z[i]));
   }
+  valid = result.valid;
 }
 
 Point2f pixel2cam(const Point2d &p, const Mat &K) {
@@ -0,0 +1,82 @@
+#include "triangulator.h"
+
+#include <opencv2/core/core.hpp>
+#include <Eigen/Cholesky>
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+int Triangulator::TriangulateRange(const vector<View> &views, const TrackObservations &tracks, int begin, int end,
+                                   TriangulatedPoints &points) const {
+  const double cos_min_parallax = cos(options_.min_parallax * M_PI / 180);
+  const double max_error2 = options_.max_reprojection_error * options_.max_reprojection_error;
+  int num_valid = 0;
+  for (int i = begin; i < end; ++i) {
+    const int first = tracks.offsets[i], last = tracks.offsets[i + 1];
+    points.x[i] = points.y[i] = points.z[i] = 0;
+    points.parallax[i] = 0;
+    points.error[i] = -1;
+    points.valid[i] = 0;
+    if (last - first < 2) continue;
+
+    // X minimizes sum |(I - d d^T) (X - C)|^2 over the rays (C, d) of the observations
+    Eigen::Matrix3d A = Eigen::Matrix3d::Zero();
+    Eigen::Vector3d b = Eigen::Vector3d::Zero();
+    for (int k = first; k < last; ++k) {
+      const View &view = views[tracks.view[k]];
+      const Eigen::Vector3d d = (view.R_wc * Eigen::Vector3d((tracks.u[k] - cx_) / fx_,
+                                                             (tracks.v[k] - cy_) / fy_, 1)).normalized();
+      const Eigen::Matrix3d P = Eigen::Matrix3d::Identity() - d * d.transpose();
+      A += P;
+      b += P * view.center;
+    }
+    const Eigen::Vector3d X = A.ldlt().solve(b);
+    if (!X.allFinite()) continue;
+
+    // cheirality and reprojection error in every view, parallax against the first view
+    const Eigen::Vector3d ray0 = (X - views[tracks.view[first]].center).normalized();
+    double max_error2_point = 0, min_cos = 1;
+    bool in_front = true;
+    for (int k = first; k < last && in_front; ++k) {
+      const View &view = views[tracks.view[k]];
+      const Eigen::Vector3d Xc = view.R_cw * X + view.t_cw;
+      in_front = Xc[2] > 0;
+      const double du = fx_ * Xc[0] / Xc[2] + cx_ - tracks.u[k], dv = fy_ * Xc[1] / Xc[2] + cy_ - tracks.v[k];
+      max_error2_point = max(max_error2_point, du * du + dv * dv);
+      min_cos = min(min_cos, ray0.dot((X - view.center).normalized()));
+    }
+    points.x[i] = X[0], points.y[i] = X[1], points.z[i] = X[2];
+    if (!in_front) continue;
+    points.parallax[i] = acos(max(-1.0, min_cos)) * 180 / M_PI;
+    points.error[i] = sqrt(max_error2_point);
+    points.valid[i] = max_error2_point < max_error2 && min_cos < cos_min_parallax;
+    num_valid += points.valid[i];
+  }
+  return num_valid;
+}
+
+int Triangulator::Triangulate(const vector<Sophus::SE3d> &poses, const TrackObservations &tracks,
+                              TriangulatedPoints &points) const {
+  vector<View> views(poses.size());
+  for (size_t i = 0; i < poses.size(); ++i) {
+    views[i].R_cw = poses[i].rotationMatrix();
+    views[i].t_cw = poses[i].translation();
+    views[i].R_wc = views[i].R_cw.transpose();
+    views[i].center = -views[i].R_wc * views[i].t_cw;
+  }
+
+  const int n = tracks.numTracks();
+  points.resize(n);
+  const int block_size = max(1, options_.block_size);
+  const int num_blocks = (n + block_size - 1) / block_size;
+  vector<int> num_valid(num_blocks, 0);
+  cv::parallel_for_(cv::Range(0, num_blocks), [&](const cv::Range &range) {
+    for (int i = range.start; i < range.end; ++i) {
+      num_valid[i] = TriangulateRange(views, tracks, i * block_size, min(n, (i + 1) * block_size), points);
+    }
+  });
+  int total = 0;
+  for (int count : num_valid) total += count;
+  return total;
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <Eigen/Core>
+#include <sophus/se3.hpp>
+#include <cstdint>
+#include <vector>
+
+/// observations of point tracks over several views, structure of arrays, tracks stored one after another
+struct TrackObservations {
+  std::vector<int> offsets{0};  // observations of track i are [offsets[i], offsets[i + 1])
+  std::vector<int> view;        // index of the observing view in the poses
+  std::vector<double> u, v;     // observed pixels
+
+  int numTracks() const { return int(offsets.size()) - 1; }
+
+  int numObservations() const { return int(view.size()); }
+
+  void clear() {
+    offsets.assign(1, 0);
+    view.clear(), u.clear(), v.clear();
+  }
+
+  void reserve(int num_tracks, int num_observations) {
+    offsets.reserve(num_tracks + 1);
+    view.reserve(num_observations), u.reserve(num_observations), v.reserve(num_observations);
+  }
+
+  /// add an observation to the current track
+  void push_back(int view_index, const Eigen::Vector2d &pixel) {
+    view.push_back(view_index), u.push_back(pixel[0]), v.push_back(pixel[1]);
+  }
+
+  /// close the current track, the next observations start a new one
+  void endTrack() { offsets.push_back(numObservations()); }
+};
+
+/// triangulated tracks, structure of arrays
+struct TriangulatedPoints {
+  Eigen::VectorXd x, y, z;       // world coordinates
+  Eigen::VectorXd parallax;      // largest angle between the first ray and the others in degrees
+  Eigen::VectorXd error;         // largest reprojection error in pixels, -1 if behind a camera or not solved
+  std::vector<uint8_t> valid;    // passed the cheirality, reprojection and parallax checks
+
+  int size() const { return int(x.size()); }
+
+  void resize(int n) {
+    x.resize(n), y.resize(n), z.resize(n), parallax.resize(n), error.resize(n);
+    valid.assign(n, 0);
+  }
+};
+
+/**
+ * Triangulation of tracks seen by any number of views with known poses T_cw
+ * - each point minimizes the sum of its squared distances to the observation rays: a fixed 3x3 linear system per
+ *   point, so N views cost the same as two and no homogeneous 4xN matrix is built
+ * - cheirality (positive depth in every view), reprojection error and parallax are checked in the same pass
+ * - the points are solved over fixed blocks in parallel and written straight into the output arrays
+ */
+class Triangulator {
+public:
+  struct Options {
+    double max_reprojection_error = 2.0;  // in pixels, in every observing view
+    double min_parallax = 1.0;            // in degrees, too small and the depth is not observable
+    int block_size = 256;                 // tracks per parallel block
+  };
+
+  explicit Triangulator(const Eigen::Matrix3d &K) : Triangulator(K, Options()) {}
+
+  Triangulator(const Eigen::Matrix3d &K, const Options &options)
+    : fx_(K(0, 0)), fy_(K(1, 1)), cx_(K(0, 2)), cy_(K(1, 2)), options_(options) {}
+
+  /**
+   * triangulate all tracks
+   * @param poses T_cw of the views
+   * @param tracks observations, tracks with less than two observations are invalid
+   * @param points output, one entry per track
+   * @return number of valid points
+   */
+  int Triangulate(const std::vector<Sophus::SE3d> &poses, const TrackObservations &tracks,
+                  TriangulatedPoints &points) const;
+
+private:
+  /// a pose with its inverse rotation and camera center
+  struct View {
+    Eigen::Matrix3d R_cw, R_wc;
+    Eigen::Vector3d t_cw, center;
+  };
+
+  /// triangulate and check tracks [begin, end), returns the number of valid points
+  int TriangulateRange(const std::vector<View> &views, const TrackObservations &tracks, int begin, int end,
+                       TriangulatedPoints &points) const;
+
+  double fx_, fy_, cx_, cy_;
+  Options options_;
+};
@@ -0,0 +1,644 @@
+#include "two_view_geometry.h"
+
+#include <Eigen/Dense>
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <random>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define TWO_VIEW_SIMD_DISPATCH
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+typedef Eigen::Matrix<double, 9, 9> Matrix9d;
+typedef Eigen::Matrix<double, 9, 1> Vector9d;
+
+// -------------------------------------------------------------------------------------------------- //
+// minimal and least squares solvers, in normalized coordinates
+
+/// right null vector of A^T A as a row major 3x3
+Eigen::Matrix3d NullVector(const Matrix9d &AtA) {
+  Eigen::SelfAdjointEigenSolver<Matrix9d> solver(AtA);
+  Vector9d v = solver.eigenvectors().col(0);  // smallest eigenvalue first
+  return Eigen::Map<Eigen::Matrix<double, 3, 3, Eigen::RowMajor>>(v.data());
+}
+
+/// 8 point (or more) essential matrix, singular values projected to (s, s, 0)
+template <typename Index>
+Eigen::Matrix3d SolveEssential(const float *x1, const float *y1, const float *x2, const float *y2,
+                               const Index &indices, int n) {
+  Matrix9d AtA = Matrix9d::Zero();
+  for (int k = 0; k < n; ++k) {
+    const int i = indices[k];
+    Vector9d a;
+    a << x2[i] * x1[i], x2[i] * y1[i], x2[i], y2[i] * x1[i], y2[i] * y1[i], y2[i], x1[i], y1[i], 1;
+    AtA.selfadjointView<Eigen::Lower>().rankUpdate(a);
+  }
+  AtA.triangularView<Eigen::StrictlyUpper>() = AtA.transpose();
+  Eigen::JacobiSVD<Eigen::Matrix3d> svd(NullVector(AtA), Eigen::ComputeFullU | Eigen::ComputeFullV);
+  const double s = 0.5 * (svd.singularValues()[0] + svd.singularValues()[1]);
+  return svd.matrixU() * Eigen::Vector3d(s, s, 0).asDiagonal() * svd.matrixV().transpose();
+}
+
+/// 4 point (or more) homography by DLT
+template <typename Index>
+Eigen::Matrix3d SolveHomography(const float *x1, const float *y1, const float *x2, const float *y2,
+                                const Index &indices, int n) {
+  Matrix9d AtA = Matrix9d::Zero();
+  for (int k = 0; k < n; ++k) {
+    const int i = indices[k];
+    Vector9d a, b;
+    a << 0, 0, 0, -x1[i], -y1[i], -1, y2[i] * x1[i], y2[i] * y1[i], y2[i];
+    b << x1[i], y1[i], 1, 0, 0, 0, -x2[i] * x1[i], -x2[i] * y1[i], -x2[i];
+    AtA.selfadjointView<Eigen::Lower>().rankUpdate(a);
+    AtA.selfadjointView<Eigen::Lower>().rankUpdate(b);
+  }
+  AtA.triangularView<Eigen::StrictlyUpper>() = AtA.transpose();
+  return NullVector(AtA);
+}
+
+// -------------------------------------------------------------------------------------------------- //
+// scoring kernels: errors are in pixels^2 (normalized errors times fx * fy), score is sum (th_score - e) of inliers.
+// Both models score one error per image (epipolar distances for E, transfer errors for H) so S_E and S_H have the
+// same scale; a correspondence is an inlier when both errors are below the threshold
+
+/// E as 9 floats row major
+typedef double (*EssentialScorer)(const float *x1, const float *y1, const float *x2, const float *y2, int begin,
+                                  int end, const float *E, float f2, float th, float th_score, int *num_inliers);
+
+/// H and H^-1 as 18 floats row major
+typedef double (*HomographyScorer)(const float *x1, const float *y1, const float *x2, const float *y2, int begin,
+                                   int end, const float *H, float f2, float th, int *num_inliers);
+
+double ScoreEssentialScalar(const float *x1, const float *y1, const float *x2, const float *y2, int begin, int end,
+                            const float *E, float f2, float th, float th_score, int *num_inliers) {
+  double score = 0;
+  int count = 0;
+  for (int i = begin; i < end; ++i) {
+    const float a = E[0] * x1[i] + E[1] * y1[i] + E[2];
+    const float b = E[3] * x1[i] + E[4] * y1[i] + E[5];
+    const float c = E[6] * x1[i] + E[7] * y1[i] + E[8];
+    const float p = E[0] * x2[i] + E[3] * y2[i] + E[6];
+    const float q = E[1] * x2[i] + E[4] * y2[i] + E[7];
+    const float num2 = (x2[i] * a + y2[i] * b + c) * (x2[i] * a + y2[i] * b + c) * f2;
+    const float d21 = num2 / (a * a + b * b);  // x2 to the epipolar line E x1
+    const float d12 = num2 / (p * p + q * q);  // x1 to the epipolar line E^T x2
+    if (d21 < th) score += th_score - d21;
+    if (d12 < th) score += th_score - d12;
+    count += d21 < th && d12 < th;
+  }
+  *num_inliers = count;
+  return score;
+}
+
+double ScoreHomographyScalar(const float *x1, const float *y1, const float *x2, const float *y2, int begin, int end,
+                             const float *H, float f2, float th, int *num_inliers) {
+  double score = 0;
+  int count = 0;
+  for (int i = begin; i < end; ++i) {
+    const float w21 = 1.0f / (H[6] * x1[i] + H[7] * y1[i] + H[8]);
+    const float u21 = (H[0] * x1[i] + H[1] * y1[i] + H[2]) * w21 - x2[i];
+    const float v21 = (H[3] * x1[i] + H[4] * y1[i] + H[5]) * w21 - y2[i];
+    const float e21 = (u21 * u21 + v21 * v21) * f2;
+    const float *Hi = H + 9;
+    const float w12 = 1.0f / (Hi[6] * x2[i] + Hi[7] * y2[i] + Hi[8]);
+    const float u12 = (Hi[0] * x2[i] + Hi[1] * y2[i] + Hi[2]) * w12 - x1[i];
+    const float v12 = (Hi[3] * x2[i] + Hi[4] * y2[i] + Hi[5]) * w12 - y1[i];
+    const float e12 = (u12 * u12 + v12 * v12) * f2;
+    if (e21 < th) score += th - e21;
+    if (e12 < th) score += th - e12;
+    count += e21 < th && e12 < th;
+  }
+  *num_inliers = count;
+  return score;
+}
+
+#ifdef __SSE2__
+inline float HorizontalSum(__m128 v) {
+  v = _mm_add_ps(v, _mm_movehl_ps(v, v));
+  v = _mm_add_ss(v, _mm_shuffle_ps(v, v, 1));
+  return _mm_cvtss_f32(v);
+}
+
+// 4 correspondences per step, the SSE2 baseline of x86_64
+double ScoreEssentialSse(const float *x1, const float *y1, const float *x2, const float *y2, int begin, int end,
+                         const float *E, float f2, float th, float th_score, int *num_inliers) {
+  __m128 e[9];
+  for (int k = 0; k < 9; ++k) e[k] = _mm_set1_ps(E[k]);
+  const __m128 vf2 = _mm_set1_ps(f2), vth = _mm_set1_ps(th), vth_score = _mm_set1_ps(th_score);
+  __m128 acc = _mm_setzero_ps();
+  int count = 0, i = begin;
+  for (; i + 4 <= end; i += 4) {
+    const __m128 X1 = _mm_loadu_ps(x1 + i), Y1 = _mm_loadu_ps(y1 + i);
+    const __m128 X2 = _mm_loadu_ps(x2 + i), Y2 = _mm_loadu_ps(y2 + i);
+    const __m128 a = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e[0], X1), _mm_mul_ps(e[1], Y1)), e[2]);
+    const __m128 b = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e[3], X1), _mm_mul_ps(e[4], Y1)), e[5]);
+    const __m128 c = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e[6], X1), _mm_mul_ps(e[7], Y1)), e[8]);
+    const __m128 p = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e[0], X2), _mm_mul_ps(e[3], Y2)), e[6]);
+    const __m128 q = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e[1], X2), _mm_mul_ps(e[4], Y2)), e[7]);
+    const __m128 num = _mm_add_ps(_mm_add_ps(_mm_mul_ps(X2, a), _mm_mul_ps(Y2, b)), c);
+    const __m128 num2 = _mm_mul_ps(_mm_mul_ps(num, num), vf2);
+    const __m128 d21 = _mm_div_ps(num2, _mm_add_ps(_mm_mul_ps(a, a), _mm_mul_ps(b, b)));
+    const __m128 d12 = _mm_div_ps(num2, _mm_add_ps(_mm_mul_ps(p, p), _mm_mul_ps(q, q)));
+    const __m128 in21 = _mm_cmplt_ps(d21, vth), in12 = _mm_cmplt_ps(d12, vth);  // false for NaN
+    acc = _mm_add_ps(acc, _mm_and_ps(in21, _mm_sub_ps(vth_score, d21)));
+    acc = _mm_add_ps(acc, _mm_and_ps(in12, _mm_sub_ps(vth_score, d12)));
+    count += __builtin_popcount(_mm_movemask_ps(_mm_and_ps(in21, in12)));
+  }
+  int tail = 0;
+  double score = HorizontalSum(acc) + ScoreEssentialScalar(x1, y1, x2, y2, i, end, E, f2, th, th_score, &tail);
+  *num_inliers = count + tail;
+  return score;
+}
+
+double ScoreHomographySse(const float *x1, const float *y1, const float *x2, const float *y2, int begin, int end,
+                          const float *H, float f2, float th, int *num_inliers) {
+  __m128 h[18];
+  for (int k = 0; k < 18; ++k) h[k] = _mm_set1_ps(H[k]);
+  const __m128 vf2 = _mm_set1_ps(f2), vth = _mm_set1_ps(th), one = _mm_set1_ps(1.0f);
+  __m128 acc = _mm_setzero_ps();
+  int count = 0, i = begin;
+  for (; i + 4 <= end; i += 4) {
+    const __m128 X1 = _mm_loadu_ps(x1 + i), Y1 = _mm_loadu_ps(y1 + i);
+    const __m128 X2 = _mm_loadu_ps(x2 + i), Y2 = _mm_loadu_ps(y2 + i);
+    __m128 err[2];
+    for (int dir = 0; dir < 2; ++dir) {
+      const __m128 *m = h + 9 * dir;
+      const __m128 sx = dir == 0 ? X1 : X2, sy = dir == 0 ? Y1 : Y2;
+      const __m128 tx = dir == 0 ? X2 : X1, ty = dir == 0 ? Y2 : Y1;
+      const __m128 w = _mm_div_ps(one, _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[6], sx), _mm_mul_ps(m[7], sy)), m[8]));
+      const __m128 u = _mm_sub_ps(
+        _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m[0], sx), _mm_mul_ps(m[1], sy)), m[2]), w), tx);
+      const __m128 v = _mm_sub_ps(
+        _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m[3], sx), _mm_mul_ps(m[4], sy)), m[5]), w), ty);
+      err[dir] = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(u, u), _mm_mul_ps(v, v)), vf2);
+    }
+    const __m128 in21 = _mm_cmplt_ps(err[0], vth), in12 = _mm_cmplt_ps(err[1], vth);
+    acc = _mm_add_ps(acc, _mm_and_ps(in21, _mm_sub_ps(vth, err[0])));
+    acc = _mm_add_ps(acc, _mm_and_ps(in12, _mm_sub_ps(vth, err[1])));
+    count += __builtin_popcount(_mm_movemask_ps(_mm_and_ps(in21, in12)));
+  }
+  int tail = 0;
+  double score = HorizontalSum(acc) + ScoreHomographyScalar(x1, y1, x2, y2, i, end, H, f2, th, &tail);
+  *num_inliers = count + tail;
+  return score;
+}
+#endif
+
+#ifdef TWO_VIEW_SIMD_DISPATCH
+__attribute__((target("avx2,fma")))
+inline float HorizontalSumAvx(__m256 v) {
+  __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+  s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+  s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+  return _mm_cvtss_f32(s);
+}
+
+// 8 correspondences per step
+__attribute__((target("avx2,fma")))
+double ScoreEssentialAvx2(const float *x1, const float *y1, const float *x2, const float *y2, int begin, int end,
+                          const float *E, float f2, float th, float th_score, int *num_inliers) {
+  __m256 e[9];
+  for (int k = 0; k < 9; ++k) e[k] = _mm256_set1_ps(E[k]);
+  const __m256 vf2 = _mm256_set1_ps(f2), vth = _mm256_set1_ps(th), vth_score = _mm256_set1_ps(th_score);
+  __m256 acc = _mm256_setzero_ps();
+  int count = 0, i = begin;
+  for (; i + 8 <= end; i += 8) {
+    const __m256 X1 = _mm256_loadu_ps(x1 + i), Y1 = _mm256_loadu_ps(y1 + i);
+    const __m256 X2 = _mm256_loadu_ps(x2 + i), Y2 = _mm256_loadu_ps(y2 + i);
+    const __m256 a = _mm256_fmadd_ps(e[0], X1, _mm256_fmadd_ps(e[1], Y1, e[2]));
+    const __m256 b = _mm256_fmadd_ps(e[3], X1, _mm256_fmadd_ps(e[4], Y1, e[5]));
+    const __m256 c = _mm256_fmadd_ps(e[6], X1, _mm256_fmadd_ps(e[7], Y1, e[8]));
+    const __m256 p = _mm256_fmadd_ps(e[0], X2, _mm256_fmadd_ps(e[3], Y2, e[6]));
+    const __m256 q = _mm256_fmadd_ps(e[1], X2, _mm256_fmadd_ps(e[4], Y2, e[7]));
+    const __m256 num = _mm256_fmadd_ps(X2, a, _mm256_fmadd_ps(Y2, b, c));
+    const __m256 num2 = _mm256_mul_ps(_mm256_mul_ps(num, num), vf2);
+    const __m256 d21 = _mm256_div_ps(num2, _mm256_fmadd_ps(a, a, _mm256_mul_ps(b, b)));
+    const __m256 d12 = _mm256_div_ps(num2, _mm256_fmadd_ps(p, p, _mm256_mul_ps(q, q)));
+    // false for NaN
+    const __m256 in21 = _mm256_cmp_ps(d21, vth, _CMP_LT_OQ), in12 = _mm256_cmp_ps(d12, vth, _CMP_LT_OQ);
+    acc = _mm256_add_ps(acc, _mm256_and_ps(in21, _mm256_sub_ps(vth_score, d21)));
+    acc = _mm256_add_ps(acc, _mm256_and_ps(in12, _mm256_sub_ps(vth_score, d12)));
+    count += __builtin_popcount(_mm256_movemask_ps(_mm256_and_ps(in21, in12)));
+  }
+  int tail = 0;
+  double score = HorizontalSumAvx(acc) + ScoreEssentialScalar(x1, y1, x2, y2, i, end, E, f2, th, th_score, &tail);
+  *num_inliers = count + tail;
+  return score;
+}
+
+__attribute__((target("avx2,fma")))
+double ScoreHomographyAvx2(const float *x1, const float *y1, const float *x2, const float *y2, int begin, int end,
+                           const float *H, float f2, float th, int *num_inliers) {
+  __m256 h[18];
+  for (int k = 0; k < 18; ++k) h[k] = _mm256_set1_ps(H[k]);
+  const __m256 vf2 = _mm256_set1_ps(f2), vth = _mm256_set1_ps(th), one = _mm256_set1_ps(1.0f);
+  __m256 acc = _mm256_setzero_ps();
+  int count = 0, i = begin;
+  for (; i + 8 <= end; i += 8) {
+    const __m256 X1 = _mm256_loadu_ps(x1 + i), Y1 = _mm256_loadu_ps(y1 + i);
+    const __m256 X2 = _mm256_loadu_ps(x2 + i), Y2 = _mm256_loadu_ps(y2 + i);
+    __m256 err[2];
+    for (int dir = 0; dir < 2; ++dir) {
+      const __m256 *m = h + 9 * dir;
+      const __m256 sx = dir == 0 ? X1 : X2, sy = dir == 0 ? Y1 : Y2;
+      const __m256 tx = dir == 0 ? X2 : X1, ty = dir == 0 ? Y2 : Y1;
+      const __m256 w = _mm256_div_ps(one, _mm256_fmadd_ps(m[6], sx, _mm256_fmadd_ps(m[7], sy, m[8])));
+      const __m256 u = _mm256_fmsub_ps(_mm256_fmadd_ps(m[0], sx, _mm256_fmadd_ps(m[1], sy, m[2])), w, tx);
+      const __m256 v = _mm256_fmsub_ps(_mm256_fmadd_ps(m[3], sx, _mm256_fmadd_ps(m[4], sy, m[5])), w, ty);
+      err[dir] = _mm256_mul_ps(_mm256_fmadd_ps(u, u, _mm256_mul_ps(v, v)), vf2);
+    }
+    const __m256 in21 = _mm256_cmp_ps(err[0], vth, _CMP_LT_OQ), in12 = _mm256_cmp_ps(err[1], vth, _CMP_LT_OQ);
+    acc = _mm256_add_ps(acc, _mm256_and_ps(in21, _mm256_sub_ps(vth, err[0])));
+    acc = _mm256_add_ps(acc, _mm256_and_ps(in12, _mm256_sub_ps(vth, err[1])));
+    count += __builtin_popcount(_mm256_movemask_ps(_mm256_and_ps(in21, in12)));
+  }
+  int tail = 0;
+  double score = HorizontalSumAvx(acc) + ScoreHomographyScalar(x1, y1, x2, y2, i, end, H, f2, th, &tail);
+  *num_inliers = count + tail;
+  return score;
+}
+#endif
+
+struct Scorers {
+  EssentialScorer essential;
+  HomographyScorer homography;
+  const char *name;
+};
+
+Scorers SelectScorers() {
+#ifdef TWO_VIEW_SIMD_DISPATCH
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+    return {ScoreEssentialAvx2, ScoreHomographyAvx2, "avx2"};
+  }
+#endif
+#ifdef __SSE2__
+  return {ScoreEssentialSse, ScoreHomographySse, "sse2"};
+#else
+  return {ScoreEssentialScalar, ScoreHomographyScalar, "scalar"};
+#endif
+}
+
+const Scorers &GetScorers() {
+  static const Scorers scorers = SelectScorers();
+  return scorers;
+}
+
+void ToFloat(const Eigen::Matrix3d &M, float *out) {
+  for (int r = 0; r < 3; ++r)
+    for (int c = 0; c < 3; ++c) out[r * 3 + c] = float(M(r, c));
+}
+
+/**
+ * the 8 motions of a homography in normalized coordinates (Faugeras and Lustman, "Motion and structure from motion
+ * in a piecewise planar environment", 1988), t of unit norm, empty if two singular values are equal
+ */
+void DecomposeHomography(const Eigen::Matrix3d &H, vector<Eigen::Matrix3d> &Rs, vector<Eigen::Vector3d> &ts) {
+  Eigen::JacobiSVD<Eigen::Matrix3d> svd(H, Eigen::ComputeFullU | Eigen::ComputeFullV);
+  const Eigen::Matrix3d U = svd.matrixU(), Vt = svd.matrixV().transpose();
+  const double s = U.determinant() * Vt.determinant();
+  const double d1 = svd.singularValues()[0], d2 = svd.singularValues()[1], d3 = svd.singularValues()[2];
+  if (d1 / d2 < 1.00001 || d2 / d3 < 1.00001) return;
+
+  const double aux1 = sqrt((d1 * d1 - d2 * d2) / (d1 * d1 - d3 * d3));
+  const double aux3 = sqrt((d2 * d2 - d3 * d3) / (d1 * d1 - d3 * d3));
+  const double x1[] = {aux1, aux1, -aux1, -aux1};
+  const double x3[] = {aux3, -aux3, aux3, -aux3};
+  const double root = sqrt((d1 * d1 - d2 * d2) * (d2 * d2 - d3 * d3));
+
+  // d' = d2
+  const double stheta = root / ((d1 + d3) * d2), ctheta = (d2 * d2 + d1 * d3) / ((d1 + d3) * d2);
+  // d' = -d2
+  const double sphi = root / ((d1 - d3) * d2), cphi = (d1 * d3 - d2 * d2) / ((d1 - d3) * d2);
+  const double signs[] = {1, -1, -1, 1};
+  for (int i = 0; i < 4; ++i) {
+    Eigen::Matrix3d Rp;
+    Rp << ctheta, 0, -signs[i] * stheta, 0, 1, 0, signs[i] * stheta, 0, ctheta;
+    Rs.push_back(s * U * Rp * Vt);
+    ts.push_back((U * Eigen::Vector3d(x1[i], 0, -x3[i])).normalized());
+  }
+  for (int i = 0; i < 4; ++i) {
+    Eigen::Matrix3d Rp;
+    Rp << cphi, 0, signs[i] * sphi, 0, -1, 0, signs[i] * sphi, 0, -cphi;
+    Rs.push_back(s * U * Rp * Vt);
+    ts.push_back((U * Eigen::Vector3d(x1[i], 0, x3[i])).normalized());
+  }
+}
+
+// -------------------------------------------------------------------------------------------------- //
+// PROSAC sampling (Chum and Matas, "Matching with PROSAC - progressive sample consensus", CVPR 2005)
+
+class ProsacSampler {
+public:
+  ProsacSampler(int num_points, int sample_size, bool prosac, uint32_t seed)
+    : N_(num_points), m_(sample_size), prosac_(prosac), rng_(seed) {
+    // T_n: expected number of samples drawn from the first n points among T_N = 200000 samples
+    n_ = m_;
+    T_n_ = 200000;
+    for (int i = 0; i < m_; ++i) T_n_ *= double(m_ - i) / (N_ - i);
+    T_n_prime_ = 1;
+  }
+
+  void Sample(int *indices) {
+    ++t_;
+    if (!prosac_ || n_ >= N_) {
+      Draw(N_, m_, indices);
+      return;
+    }
+    // grow the sampling set
+    while (t_ > T_n_prime_ && n_ < N_) {
+      const double T_next = T_n_ * (n_ + 1) / (n_ + 1 - m_);
+      T_n_prime_ += int(ceil(T_next - T_n_));
+      T_n_ = T_next;
+      ++n_;
+    }
+    if (T_n_prime_ < t_) {
+      Draw(n_, m_, indices);
+    } else {
+      // the newest point and m - 1 points before it
+      Draw(n_ - 1, m_ - 1, indices);
+      indices[m_ - 1] = n_ - 1;
+    }
+  }
+
+private:
+  /// m distinct indices in [0, n)
+  void Draw(int n, int m, int *indices) {
+    for (int k = 0; k < m; ++k) {
+      bool repeated = true;
+      while (repeated) {
+        indices[k] = uniform_int_distribution<int>(0, n - 1)(rng_);
+        repeated = find(indices, indices + k, indices[k]) != indices + k;
+      }
+    }
+  }
+
+  int N_, m_;
+  bool prosac_;
+  mt19937 rng_;
+  int n_ = 0, t_ = 0, T_n_prime_ = 1;
+  double T_n_ = 0;
+};
+
+/// iterations needed to draw an all inlier sample of size m with the confidence
+int AdaptiveIterations(int num_inliers, int n, int m, double confidence, int max_iterations) {
+  // the one-sided score terms let a model win with fewer than m full inliers, w = 0 would give -inf
+  if (num_inliers < m) return max_iterations;
+  const double w = double(num_inliers) / n;
+  const double all_inliers = pow(w, m);
+  if (all_inliers > 1 - 1e-12) return 0;
+  // clamped as a double, the bound overflows an int for small inlier ratios
+  const double needed = ceil(log(1 - confidence) / log1p(-all_inliers));
+  return int(min(double(max_iterations), max(0.0, needed)));
+}
+
+}  // namespace
+
+TwoViewGeometry::TwoViewGeometry(const Eigen::Matrix3d &K, const Options &options)
+  : K_(K), options_(options), focal2_(K(0, 0) * K(1, 1)) {}
+
+const char *TwoViewGeometry::KernelName() {
+  return GetScorers().name;
+}
+
+double TwoViewGeometry::FindEssential(Eigen::Matrix3d &E) const {
+  const int n = x1_.size();
+  const float sigma2 = float(options_.sigma * options_.sigma);
+  // 1 dof errors: inlier below chi2(0.95, 1), scored against chi2(0.95, 2) to compare with the homography
+  const float th = 3.841f * sigma2, th_score = 5.991f * sigma2, f2 = float(focal2_);
+  const EssentialScorer score = GetScorers().essential;
+
+  ProsacSampler sampler(n, 8, options_.prosac, 1);
+  double best_score = 0;
+  int best_inliers = 0, max_iterations = options_.max_iterations;
+  E.setZero();
+  float e[9];
+  for (int iter = 0; iter < max_iterations; ++iter) {
+    int sample[8];
+    sampler.Sample(sample);
+    const Eigen::Matrix3d hypothesis = SolveEssential(x1_.data(), y1_.data(), x2_.data(), y2_.data(), sample, 8);
+    ToFloat(hypothesis, e);
+    int num_inliers = 0;
+    const double s = score(x1_.data(), y1_.data(), x2_.data(), y2_.data(), 0, n, e, f2, th, th_score, &num_inliers);
+    if (s > best_score) {
+      best_score = s;
+      best_inliers = num_inliers;
+      E = hypothesis;
+      max_iterations = AdaptiveIterations(num_inliers, n, 8, options_.confidence, options_.max_iterations);
+    }
+  }
+  if (best_inliers < 8) return best_score;
+
+  // least squares on all inliers
+  vector<uint8_t> mask;
+  InlierMask(Model::kEssential, E, mask);
+  vector<int> inliers;
+  for (int i = 0; i < n; ++i)
+    if (mask[i]) inliers.push_back(i);
+  const Eigen::Matrix3d refit = SolveEssential(x1_.data(), y1_.data(), x2_.data(), y2_.data(), inliers,
+                                               int(inliers.size()));
+  ToFloat(refit, e);
+  int num_inliers = 0;
+  const double s = score(x1_.data(), y1_.data(), x2_.data(), y2_.data(), 0, n, e, f2, th, th_score, &num_inliers);
+  if (s > best_score) {
+    best_score = s;
+    E = refit;
+  }
+  return best_score;
+}
+
+double TwoViewGeometry::FindHomography(Eigen::Matrix3d &H) const {
+  const int n = x1_.size();
+  const float sigma2 = float(options_.sigma * options_.sigma);
+  const float th = 5.991f * sigma2, f2 = float(focal2_);
+  const HomographyScorer score = GetScorers().homography;
+
+  ProsacSampler sampler(n, 4, options_.prosac, 2);
+  double best_score = 0;
+  int best_inliers = 0, max_iterations = options_.max_iterations;
+  H.setZero();
+  float h[18];
+  auto evaluate = [&](const Eigen::Matrix3d &hypothesis, int *num_inliers) {
+    if (fabs(hypothesis.determinant()) < 1e-12) return 0.0;
+    ToFloat(hypothesis, h);
+    ToFloat(hypothesis.inverse(), h + 9);
+    return score(x1_.data(), y1_.data(), x2_.data(), y2_.data(), 0, n, h, f2, th, num_inliers);
+  };
+  for (int iter = 0; iter < max_iterations; ++iter) {
+    int sample[4];
+    sampler.Sample(sample);
+    const Eigen::Matrix3d hypothesis = SolveHomography(x1_.data(), y1_.data(), x2_.data(), y2_.data(), sample, 4);
+    int num_inliers = 0;
+    const double s = evaluate(hypothesis, &num_inliers);
+    if (s > best_score) {
+      best_score = s;
+      best_inliers = num_inliers;
+      H = hypothesis;
+      max_iterations = AdaptiveIterations(num_inliers, n, 4, options_.confidence, options_.max_iterations);
+    }
+  }
+  if (best_inliers < 4) return best_score;
+
+  vector<uint8_t> mask;
+  InlierMask(Model::kHomography, H, mask);
+  vector<int> inliers;
+  for (int i = 0; i < n; ++i)
+    if (mask[i]) inliers.push_back(i);
+  const Eigen::Matrix3d refit = SolveHomography(x1_.data(), y1_.data(), x2_.data(), y2_.data(), inliers,
+                                                int(inliers.size()));
+  int num_inliers = 0;
+  const double s = evaluate(refit, &num_inliers);
+  if (s > best_score) {
+    best_score = s;
+    H = refit;
+  }
+  return best_score;
+}
+
+void TwoViewGeometry::InlierMask(Model model, const Eigen::Matrix3d &M, vector<uint8_t> &mask) const {
+  const int n = x1_.size();
+  const float sigma2 = float(options_.sigma * options_.sigma), f2 = float(focal2_);
+  mask.assign(n, 0);
+  float m[18];
+  ToFloat(M, m);
+  if (model == Model::kHomography) {
+    if (fabs(M.determinant()) < 1e-12) return;
+    ToFloat(M.inverse(), m + 9);
+  }
+  // the scalar kernels one point at a time, same arithmetic as the scoring
+  for (int i = 0; i < n; ++i) {
+    int inlier = 0;
+    if (model == Model::kEssential) {
+      ScoreEssentialScalar(x1_.data(), y1_.data(), x2_.data(), y2_.data(), i, i + 1, m, f2, 3.841f * sigma2,
+                           5.991f * sigma2, &inlier);
+    } else {
+      ScoreHomographyScalar(x1_.data(), y1_.data(), x2_.data(), y2_.data(), i, i + 1, m, f2, 5.991f * sigma2,
+                            &inlier);
+    }
+    mask[i] = uint8_t(inlier);
+  }
+}
+
+int TwoViewGeometry::CheckMotion(const Eigen::Matrix3d &R, const Eigen::Vector3d &t, const vector<uint8_t> &mask,
+                                 double &parallax) const {
+  const double th = 4.0 * options_.sigma * options_.sigma;
+  const Eigen::Vector3d center2 = -R.transpose() * t;
+  vector<double> cos_parallax;
+  int good = 0;
+  for (int i = 0; i < int(mask.size()); ++i) {
+    if (!mask[i]) continue;
+    const Eigen::Vector3d f1(x1_[i], y1_[i], 1), f2(x2_[i], y2_[i], 1);
+    // depths d1, d2 minimizing |d2 * f2 - (d1 * R * f1 + t)|
+    const Eigen::Vector3d r1 = R * f1;
+    Eigen::Matrix2d A;
+    A << r1.dot(r1), -r1.dot(f2), -r1.dot(f2), f2.dot(f2);
+    const Eigen::Vector2d b(-r1.dot(t), f2.dot(t));
+    if (fabs(A.determinant()) < 1e-12) continue;
+    const Eigen::Vector2d d = A.inverse() * b;
+    if (d[0] <= 0 || d[1] <= 0) continue;
+
+    const Eigen::Vector3d X1 = d[0] * f1;
+    const Eigen::Vector3d X2 = R * X1 + t;
+    if (X2[2] <= 0) continue;
+    const double eu = X2[0] / X2[2] - x2_[i], ev = X2[1] / X2[2] - y2_[i];
+    if ((eu * eu + ev * ev) * focal2_ > th) continue;
+
+    const Eigen::Vector3d ray1 = X1, ray2 = X1 - center2;
+    cos_parallax.push_back(ray1.dot(ray2) / (ray1.norm() * ray2.norm()));
+    ++good;
+  }
+  parallax = 0;
+  if (!cos_parallax.empty()) {
+    nth_element(cos_parallax.begin(), cos_parallax.begin() + cos_parallax.size() / 2, cos_parallax.end());
+    parallax = acos(min(1.0, cos_parallax[cos_parallax.size() / 2])) * 180 / M_PI;
+  }
+  return good;
+}
+
+bool TwoViewGeometry::Estimate(const vector<cv::Point2f> &points1, const vector<cv::Point2f> &points2,
+                               const vector<float> &quality, Result &result) {
+  result = Result();
+  const int n = points1.size();
+  if (n < 8 || int(points2.size()) != n) return false;
+
+  // PROSAC order: best quality first
+  order_.resize(n);
+  iota(order_.begin(), order_.end(), 0);
+  if (!quality.empty()) {
+    stable_sort(order_.begin(), order_.end(), [&](int a, int b) { return quality[a] < quality[b]; });
+  }
+  const double fx = K_(0, 0), fy = K_(1, 1), cx = K_(0, 2), cy = K_(1, 2);
+  x1_.resize(n), y1_.resize(n), x2_.resize(n), y2_.resize(n);
+  for (int i = 0; i < n; ++i) {
+    const int j = order_[i];
+    x1_[i] = float((points1[j].x - cx) / fx), y1_[i] = float((points1[j].y - cy) / fy);
+    x2_[i] = float((points2[j].x - cx) / fx), y2_[i] = float((points2[j].y - cy) / fy);
+  }
+
+  // the two models in parallel
+  cv::parallel_for_(cv::Range(0, 2), [&](const cv::Range &range) {
+    for (int model = range.start; model < range.end; ++model) {
+      if (model == 0) {
+        result.score_essential = FindEssential(result.E);
+      } else {
+        result.score_homography = FindHomography(result.H);
+      }
+    }
+  });
+  const double total = result.score_essential + result.score_homography;
+  if (total <= 0) return false;
+  result.model = result.score_homography / total > options_.homography_ratio ? Model::kHomography
+                                                                             : Model::kEssential;
+
+  // motion candidates of the selected model
+  vector<uint8_t> mask;
+  vector<Eigen::Matrix3d> Rs;
+  vector<Eigen::Vector3d> ts;
+  if (result.model == Model::kEssential) {
+    InlierMask(Model::kEssential, result.E, mask);
+    Eigen::JacobiSVD<Eigen::Matrix3d> svd(result.E, Eigen::ComputeFullU | Eigen::ComputeFullV);
+    Eigen::Matrix3d U = svd.matrixU(), V = svd.matrixV();
+    if (U.determinant() < 0) U = -U;
+    if (V.determinant() < 0) V = -V;
+    Eigen::Matrix3d W;
+    W << 0, -1, 0, 1, 0, 0, 0, 0, 1;
+    const Eigen::Matrix3d R1 = U * W * V.transpose(), R2 = U * W.transpose() * V.transpose();
+    const Eigen::Vector3d t = U.col(2);
+    Rs = {R1, R1, R2, R2};
+    ts = {t, -t, t, -t};
+  } else {
+    InlierMask(Model::kHomography, result.H, mask);
+    DecomposeHomography(result.H, Rs, ts);
+  }
+
+  // cheirality: the candidate with the most triangulated points, it must be clearly better than the others
+  int best = -1, best_good = 0, second_good = 0;
+  double best_parallax = 0;
+  for (size_t k = 0; k < Rs.size(); ++k) {
+    double parallax = 0;
+    const int good = CheckMotion(Rs[k], ts[k], mask, parallax);
+    if (good > best_good) {
+      second_good = best_good;
+      best_good = good;
+      best = k;
+      best_parallax = parallax;
+    } else if (good > second_good) {
+      second_good = good;
+    }
+  }
+  result.inliers.assign(n, 0);
+  for (int i = 0; i < n; ++i) result.inliers[order_[i]] = mask[i];
+  if (best < 0) return false;
+  result.R = Rs[best];
+  result.t = ts[best];
+  result.num_triangulated = best_good;
+  result.parallax = best_parallax;
+  return best_good >= options_.min_triangulated && second_good < options_.max_ambiguity * best_good &&
+         best_parallax >= options_.min_parallax;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <opencv2/core/core.hpp>
+#include <Eigen/Core>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Two-view geometry for monocular initialization, essential matrix and homography in one pass
+ * (model selection as in ORB-SLAM's initializer):
+ * - essential hypotheses from 8 points, homography hypotheses from 4 points, both in normalized coordinates;
+ *   the two models are estimated in parallel
+ * - samples are drawn by PROSAC: matches are sorted by quality (descriptor distance) and the sampling set grows
+ *   from the best matches to all of them
+ * - every hypothesis scores all correspondences: epipolar distances in both images for E, symmetric transfer error
+ *   for H, truncated (MSAC) scores, with SSE or AVX2+FMA kernels selected at runtime
+ * - the best model of each kind is refit on its inliers, the homography is selected when
+ *   S_H / (S_H + S_E) > homography_ratio, then R, t are recovered by the cheirality check of the inliers among the
+ *   4 (E) or 8 (H) motions
+ */
+class TwoViewGeometry {
+public:
+  enum class Model { kNone, kEssential, kHomography };
+
+  struct Options {
+    int max_iterations = 200;        // hypotheses per model at most
+    double confidence = 0.999;       // stop sampling when an all inlier sample was drawn with this probability
+    double sigma = 1.0;              // standard deviation of the keypoint position, in pixels
+    // S_H / (S_H + S_E) above which the homography is selected; with noise in both images a plane, which both
+    // models explain, scores about 0.41 (the 1 dof E errors keep more of each term than the 2 dof H errors)
+    double homography_ratio = 0.35;
+    bool prosac = true;              // sample the best matches first, otherwise uniformly
+    int min_triangulated = 50;       // points in front of both cameras needed for success
+    double min_parallax = 1.0;       // median parallax needed for success, in degrees
+    double max_ambiguity = 0.75;     // the second best motion must triangulate less than this fraction of the best
+  };
+
+  struct Result {
+    Model model = Model::kNone;
+    Eigen::Matrix3d E = Eigen::Matrix3d::Zero();  // x2^T E x1 = 0 in normalized coordinates
+    Eigen::Matrix3d H = Eigen::Matrix3d::Zero();  // x2 ~ H x1 in normalized coordinates
+    double score_essential = 0, score_homography = 0;
+    Eigen::Matrix3d R = Eigen::Matrix3d::Identity();  // x2 = R x1 + t
+    Eigen::Vector3d t = Eigen::Vector3d::Zero();      // unit norm
+    std::vector<uint8_t> inliers;  // of the selected model, in input order
+    int num_triangulated = 0;      // inliers in front of both cameras with the recovered pose
+    double parallax = 0;           // median parallax of the triangulated points, in degrees
+  };
+
+  explicit TwoViewGeometry(const Eigen::Matrix3d &K) : TwoViewGeometry(K, Options()) {}
+
+  TwoViewGeometry(const Eigen::Matrix3d &K, const Options &options);
+
+  /**
+   * estimate both models, select one and recover the motion
+   * @param points1 pixels in the first image
+   * @param points2 matched pixels in the second image
+   * @param quality per match quality, lower is better (e.g. descriptor distance), empty to keep the input order
+   * @param result models, scores, selected model and motion
+   * @return true if the motion is well determined (enough triangulated points, enough parallax, not ambiguous)
+   */
+  bool Estimate(const std::vector<cv::Point2f> &points1, const std::vector<cv::Point2f> &points2,
+                const std::vector<float> &quality, Result &result);
+
+  /// name of the scoring kernel selected for this cpu
+  static const char *KernelName();
+
+private:
+  /// best essential matrix by PROSAC and its refit on the inliers
+  double FindEssential(Eigen::Matrix3d &E) const;
+
+  /// best homography by PROSAC and its refit on the inliers
+  double FindHomography(Eigen::Matrix3d &H) const;
+
+  /// inlier mask of a model in sorted order
+  void InlierMask(Model model, const Eigen::Matrix3d &M, std::vector<uint8_t> &mask) const;
+
+  /**
+   * triangulate the masked points with a motion
+   * @return number of points in front of both cameras with a small reprojection error
+   */
+  int CheckMotion(const Eigen::Matrix3d &R, const Eigen::Vector3d &t, const std::vector<uint8_t> &mask,
+                  double &parallax) const;
+
+  Eigen::Matrix3d K_;
+  Options options_;
+  double focal2_;  // fx * fy, scales normalized errors to pixels^2
+  // correspondences in normalized coordinates, sorted by quality
+  std::vector<float> x1_, y1_, x2_, y2_;
+  std::vector<int> order_;  // input index of each sorted correspondence
+};
@@ -0,0 +1,78 @@
+#include <iostream>
+#include <random>
+#include <Eigen/Geometry>
+#include "two_view_geometry.h"
+
+using namespace std;
+
+/**
+ * TwoViewGeometry model selection on synthetic scenes: a scene with depth range must select the essential matrix,
+ * a plane must select the homography, and the selected model must recover the motion.
+ * 1 pixel noise, 10% outliers. Returns non zero on failure.
+ */
+
+const double fx = 520.9, fy = 521.0, cx = 325.1, cy = 249.7;
+
+/// project the points seen in front of both cameras into the two views
+void MakeMatches(const vector<Eigen::Vector3d> &points, const Eigen::Matrix3d &R, const Eigen::Vector3d &t,
+                 mt19937 &rng, vector<cv::Point2f> &points1, vector<cv::Point2f> &points2) {
+  normal_distribution<double> noise(0, 1);
+  uniform_real_distribution<double> outlier(-30, 30);
+  points1.clear(), points2.clear();
+  for (const Eigen::Vector3d &p1 : points) {
+    const Eigen::Vector3d p2 = R * p1 + t;
+    if (p1[2] <= 0 || p2[2] <= 0) continue;
+    cv::Point2f px1(float(fx * p1[0] / p1[2] + cx + noise(rng)), float(fy * p1[1] / p1[2] + cy + noise(rng)));
+    cv::Point2f px2(float(fx * p2[0] / p2[2] + cx + noise(rng)), float(fy * p2[1] / p2[2] + cy + noise(rng)));
+    if (points1.size() % 10 == 9) px2 += cv::Point2f(float(outlier(rng)), float(outlier(rng)));
+    points1.push_back(px1);
+    points2.push_back(px2);
+  }
+}
+
+bool Check(const char *name, const vector<Eigen::Vector3d> &points, TwoViewGeometry::Model expected) {
+  mt19937 rng(7);
+  const Eigen::Matrix3d R = Eigen::AngleAxisd(0.08, Eigen::Vector3d(0.2, 1, 0.1).normalized()).toRotationMatrix();
+  const Eigen::Vector3d t(1.0, 0.1, 0.2);
+  vector<cv::Point2f> points1, points2;
+  MakeMatches(points, R, t, rng, points1, points2);
+
+  Eigen::Matrix3d K;
+  K << fx, 0, cx, 0, fy, cy, 0, 0, 1;
+  TwoViewGeometry geometry(K);
+  TwoViewGeometry::Result result;
+  const bool ok = geometry.Estimate(points1, points2, vector<float>(), result);
+  const double ratio = result.score_homography / (result.score_homography + result.score_essential);
+  const double rotation_error = Eigen::AngleAxisd(result.R * R.transpose()).angle() * 180 / M_PI;
+  const double direction_error = acos(min(1.0, result.t.dot(t.normalized()))) * 180 / M_PI;
+  const bool pass = result.model == expected && rotation_error < 2 && direction_error < 10;
+  cout << name << ": " << points1.size() << " matches, S_H / (S_H + S_E) = " << ratio << ", selected "
+       << (result.model == TwoViewGeometry::Model::kEssential ? "E" : "H") << ", rotation error " << rotation_error
+       << " deg, translation direction error " << direction_error << " deg, "
+       << result.num_triangulated << " triangulated, " << (ok ? "well" : "not well") << " determined -> "
+       << (pass ? "ok" : "FAILED") << endl;
+  return pass;
+}
+
+int main(int argc, char **argv) {
+  mt19937 rng(0);
+  uniform_real_distribution<double> uniform(-1, 1);
+
+  // points spread over depths 3 to 9
+  vector<Eigen::Vector3d> scene;
+  for (int i = 0; i < 500; ++i) {
+    const double z = 6 + 3 * uniform(rng);
+    scene.push_back(Eigen::Vector3d(0.5 * z * uniform(rng), 0.4 * z * uniform(rng), z));
+  }
+  // a tilted plane at depth 6
+  vector<Eigen::Vector3d> plane;
+  for (int i = 0; i < 500; ++i) {
+    const double x = 3 * uniform(rng), y = 2.5 * uniform(rng);
+    plane.push_back(Eigen::Vector3d(x, y, 6 + 0.3 * x - 0.2 * y));
+  }
+
+  cout << "scoring kernel: " << TwoViewGeometry::KernelName() << endl;
+  bool pass = Check("non planar scene", scene, TwoViewGeometry::Model::kEssential);
+  pass = Check("planar scene", plane, TwoViewGeometry::Model::kHomography) && pass;
+  return pass ? 0 : 1;
+}
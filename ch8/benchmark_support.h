@@ -0,0 +1,80 @@
+#pragma once
+
+#include <benchmark/benchmark.h>
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+/**
+ * Google Benchmark scaffolding of the ch8 suites: OpenCV thread sweeps, the input image and a main that writes JSON
+ * by default. ch7 keeps its own copy, the chapters build independently.
+ */
+
+/// sets the OpenCV thread count for the lifetime of a benchmark
+class ScopedThreads {
+public:
+    explicit ScopedThreads(int threads) : previous_(cv::getNumThreads()) { cv::setNumThreads(threads); }
+
+    ~ScopedThreads() { cv::setNumThreads(previous_); }
+
+private:
+    int previous_;
+};
+
+/// gray image of a file, or blurred noise (corners everywhere, enough for timing) if it cannot be read
+inline cv::Mat BenchmarkImage(const std::string &file) {
+    cv::Mat img = cv::imread(file, 0);
+    if (img.empty()) {
+        img = cv::Mat(480, 640, CV_8UC1);
+        cv::randu(img, cv::Scalar(0), cv::Scalar(255));
+        cv::GaussianBlur(img, img, cv::Size(7, 7), 2);
+    }
+    return img;
+}
+
+/// one run of args per thread count: powers of two up to the cpu count, then the cpu count itself;
+/// the thread count is the last argument
+inline void AddThreadCounts(benchmark::internal::Benchmark *b, std::vector<int64_t> args) {
+    const int max_threads = std::max(1, cv::getNumberOfCPUs());
+    args.push_back(0);
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+        args.back() = threads;
+        b->Args(args);
+    }
+    if (max_threads & (max_threads - 1)) {
+        args.back() = max_threads;
+        b->Args(args);
+    }
+}
+
+/**
+ * main of a benchmark suite
+ * usage: <suite> [image] [google benchmark flags]
+ * @param image_file    [in|out] input image, replaced by the first argument unless it is a flag
+ * @param default_out   JSON file written unless --benchmark_out is given
+ * @return exit code
+ */
+inline int RunBenchmarks(int argc, char **argv, std::string &image_file, const std::string &default_out) {
+    std::vector<char *> args(argv, argv + argc);
+    if (args.size() > 1 && args[1][0] != '-') {
+        image_file = args[1];
+        args.erase(args.begin() + 1);
+    }
+    bool has_out = false;
+    for (char *arg : args) has_out |= std::string(arg).find("--benchmark_out=") == 0;
+    std::string out = "--benchmark_out=" + default_out;
+    std::string format = "--benchmark_out_format=json";
+    if (!has_out) {
+        args.push_back(&out[0]);
+        args.push_back(&format[0]);
+    }
+
+    int num_args = args.size();
+    benchmark::Initialize(&num_args, args.data());
+    if (benchmark::ReportUnrecognizedArguments(num_args, args.data())) return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    return 0;
+}
@@ -1,11 +1,19 @@
 #include <opencv2/opencv.hpp>
 #include <sophus/se3.hpp>
+#include <chrono>
+#include <fstream>
 #include <boost/format.hpp>
 #include <pangolin/pangolin.h>
+#include "pixel_selector.h"
+#include "myslam/bilinear.h"
+#include "myslam/image_pyramid.h"
+#include "myslam/normal_equations.h"
 
 using namespace std;
+using myslam::ImagePyramid;
 
 typedef vector<Eigen::Vector2d, Eigen::aligned_allocator<Eigen::Vector2d>> VecVector2d;
+typedef vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d>> VecVector3d;
 
 // Camera intrinsics
 double fx = 718.856, fy = 718.856, cx = 607.1928, cy = 185.2157;
@@ -15,188 +23,414 @@ double baseline = 0.573;
 string left_file = "./left.png";
 string disparity_file = "./disparity.png";
 boost::format fmt_others("./%06d.png");    // other files
+// Huber threshold of the photometric error, in intensity
+double huber_delta = 9;
+// print the iterations and show the projections of every layer, off when streaming a file list
+bool show_progress = true;
+
+// patches of the photometric error
+const int half_patch_size = 1;
+const int patch_size = 2 * half_patch_size + 1, patch_area = patch_size * patch_size;
 
 // useful typedefs
 typedef Eigen::Matrix<double, 6, 6> Matrix6d;
 typedef Eigen::Matrix<double, 2, 6> Matrix26d;
 typedef Eigen::Matrix<double, 6, 1> Vector6d;
+typedef Eigen::Matrix<double, 8, 8> Matrix8d;
+typedef Eigen::Matrix<double, 8, 1> Vector8d;
+
+/// affine brightness change from the reference to the current image: I2 = exp(a) * I1 + b
+struct AffineBrightness {
+    double a = 0, b = 0;
+};
+
+/**
+ * reference pixels of one image (pyramid level) with everything that does not depend on the current image,
+ * computed once and shared by every image aligned against the reference
+ */
+struct ReferenceCache {
+    VecVector2d px;             // pixels in the reference image
+    VecVector3d points;         // the pixels back-projected with their depth, in the reference camera
+    vector<float> patches;      // bilinear patches around the pixels, patch_area values each, row major
+};
+
+/**
+ * cache the reference pixels of an image
+ * @param img1 the reference image
+ * @param px_ref pixels in img1
+ * @param depth_ref their depth
+ * @param scale size of img1 relative to the image of the intrinsics fx, fy, cx, cy, e.g. of a pyramid level
+ * @param cache [out]
+ */
+void CacheReference(
+    const cv::Mat &img1,
+    const VecVector2d &px_ref,
+    const vector<double> &depth_ref,
+    double scale,
+    ReferenceCache &cache
+);
 
-/// class for accumulator jacobians in parallel
+/**
+ * class for accumulator jacobians in parallel, deterministic for any number of threads
+ * The parameters are the pose (6) and the affine brightness (a, b), the errors are Huber weighted.
+ */
 class JacobianAccumulator {
 public:
     JacobianAccumulator(
-        const cv::Mat &img1_,
+        const ReferenceCache &ref_,
         const cv::Mat &img2_,
-        const VecVector2d &px_ref_,
-        const vector<double> depth_ref_,
-        Sophus::SE3d &T21_) :
-        img1(img1_), img2(img2_), px_ref(px_ref_), depth_ref(depth_ref_), T21(T21_) {
-        projection = VecVector2d(px_ref.size(), Eigen::Vector2d(0, 0));
+        Sophus::SE3d &T21_,
+        const AffineBrightness &ab_,
+        const cv::Mat &grad_x2_ = cv::Mat(),
+        const cv::Mat &grad_y2_ = cv::Mat()) :
+        ref(ref_), img2(img2_), T21(T21_), ab(ab_), grad_x2(grad_x2_), grad_y2(grad_y2_) {
+        projection = VecVector2d(ref.points.size(), Eigen::Vector2d(0, 0));
     }
 
+    /// accumulate jacobians of all the points in parallel
+    void accumulate();
+
     /// accumulate jacobians in a range
-    void accumulate_jacobian(const cv::Range &range);
+    void accumulate_jacobian(int begin, int end, myslam::NormalEquations<8> &equations);
 
     /// get hessian matrix
-    Matrix6d hessian() const { return H; }
+    Matrix8d hessian() const { return reducer.Result().H; }
 
     /// get bias
-    Vector6d bias() const { return b; }
+    Vector8d bias() const { return reducer.Result().b; }
+
+    /// get mean cost of the good points, the weighted squared error min(e^2, huber_delta * |e|) per pixel
+    double cost_func() const {
+        const auto &result = reducer.Result();
+        return result.num_inliers ? result.cost / result.num_inliers : 0;
+    }
 
-    /// get total cost
-    double cost_func() const { return cost; }
+    /// get number of points projected inside the image
+    int num_good() const { return reducer.Result().num_inliers; }
 
     /// get projected points
     VecVector2d projected_points() const { return projection; }
 
-    /// reset h, b, cost to zero
-    void reset() {
-        H = Matrix6d::Zero();
-        b = Vector6d::Zero();
-        cost = 0;
-    }
-
 private:
-    const cv::Mat &img1;
+    const ReferenceCache &ref;
     const cv::Mat &img2;
-    const VecVector2d &px_ref;
-    const vector<double> depth_ref;
     Sophus::SE3d &T21;
+    const AffineBrightness &ab;
+    const cv::Mat grad_x2, grad_y2; // gradients of img2, central differences if empty
     VecVector2d projection; // projected points
 
-    std::mutex hessian_mutex;
-    Matrix6d H = Matrix6d::Zero();
-    Vector6d b = Vector6d::Zero();
-    double cost = 0;
+    myslam::NormalEquationsReducer<8> reducer{64}; // fixed blocks of 64 points, reduced in a fixed order
+};
+
+/// reference keyframe of the direct odometry, the pixels are selected once and cached for every pyramid level
+struct Keyframe {
+    ImagePyramid::Ptr pyramid;          // with gradients, used by the pixel selection
+    cv::Mat depth;                      // CV_32F depth of level 0, 0 where unknown
+    vector<ReferenceCache> ref;         // selected pixels of every level in the coordinates of the level, cached
+    Sophus::SE3d T_kf_w;                // pose of the keyframe
 };
 
 /**
- * pose estimation using direct method
- * @param img1
- * @param img2
- * @param px_ref
- * @param depth_ref
+ * make a keyframe: build its pyramid, select the pixels with known depth on every level and cache them
+ * @param img
+ * @param depth CV_32F depth of img, 0 where unknown
+ * @param selector
+ * @param T_kf_w
+ * @param kf [out]
+ */
+void MakeKeyframe(
+    const cv::Mat &img,
+    const cv::Mat &depth,
+    const PixelSelector &selector,
+    const Sophus::SE3d &T_kf_w,
+    Keyframe &kf
+);
+
+/**
+ * depth of a new keyframe, the depth of the old keyframe warped into it (nearest pixel, the closest point wins)
+ * @param kf the old keyframe
+ * @param T_new_kf pose of the new keyframe relative to the old one
+ * @param depth [out] CV_32F, 0 where unknown
+ */
+void PropagateDepth(const Keyframe &kf, const Sophus::SE3d &T_new_kf, cv::Mat &depth);
+
+/**
+ * pose estimation using direct method on cached reference pixels of every level, e.g. Keyframe::ref
+ * @param ref reference pixels of every level
+ * @param pyr2 pyramid of the current image, the same levels as ref, with gradients if they should be used
  * @param T21
+ * @param ab [in|out] affine brightness from the reference to the current image
+ * @return number of points of level 0 projected inside the current image
  */
-void DirectPoseEstimationMultiLayer(
-    const cv::Mat &img1,
-    const cv::Mat &img2,
-    const VecVector2d &px_ref,
-    const vector<double> depth_ref,
-    Sophus::SE3d &T21
+int DirectPoseEstimationMultiLayer(
+    const vector<ReferenceCache> &ref,
+    const ImagePyramid &pyr2,
+    Sophus::SE3d &T21,
+    AffineBrightness &ab
 );
 
 /**
- * pose estimation using direct method
- * @param img1
+ * pose estimation using direct method on cached reference pixels, Levenberg-Marquardt on the pose and the affine
+ * brightness
+ * @param ref reference pixels, cached with the intrinsics fx, fy, cx, cy of img2
  * @param img2
- * @param px_ref
- * @param depth_ref
  * @param T21
+ * @param ab [in|out] affine brightness from the reference image to img2
+ * @param grad_x2 gradients of img2, central differences if empty
+ * @param grad_y2
+ * @return number of points projected inside img2
  */
-void DirectPoseEstimationSingleLayer(
-    const cv::Mat &img1,
+int DirectPoseEstimationSingleLayer(
+    const ReferenceCache &ref,
     const cv::Mat &img2,
-    const VecVector2d &px_ref,
-    const vector<double> depth_ref,
-    Sophus::SE3d &T21
+    Sophus::SE3d &T21,
+    AffineBrightness &ab,
+    const cv::Mat &grad_x2 = cv::Mat(),
+    const cv::Mat &grad_y2 = cv::Mat()
 );
 
-// bilinear interpolation
-inline float GetPixelValue(const cv::Mat &img, float x, float y) {
-    // boundary check
-    if (x < 0) x = 0;
-    if (y < 0) y = 0;
-    if (x >= img.cols) x = img.cols - 1;
-    if (y >= img.rows) y = img.rows - 1;
-    uchar *data = &img.data[int(y) * img.step + int(x)];
-    float xx = x - floor(x);
-    float yy = y - floor(y);
-    return float(
-        (1 - xx) * (1 - yy) * data[0] +
-        xx * (1 - yy) * data[1] +
-        (1 - xx) * yy * data[img.step] +
-        xx * yy * data[img.step + 1]
-    );
-}
-
 int main(int argc, char **argv) {
 
+    // images tracked against the keyframes: ./000001.png to ./000005.png with the plots of every layer, or
+    // streaming the images of a file list (one path per line) without plots, e.g. to measure the frame rate
+    vector<string> image_files;
+    if (argc > 1) {
+        ifstream fin(argv[1]);
+        if (!fin) {
+            cerr << "cannot open the file list " << argv[1] << endl;
+            return 1;
+        }
+        string line;
+        while (getline(fin, line)) {
+            line.erase(line.find_last_not_of(" \t\r") + 1);
+            if (!line.empty()) image_files.push_back(line);
+        }
+        show_progress = false;
+    } else {
+        for (int i = 1; i < 6; i++) {  // 1~10
+            image_files.push_back((fmt_others % i).str());
+        }
+    }
+
     cv::Mat left_img = cv::imread(left_file, 0);
     cv::Mat disparity_img = cv::imread(disparity_file, 0);
 
-    // let's randomly pick pixels in the first image and generate some 3d points in the first image's frame
-    cv::RNG rng;
-    int nPoints = 2000;
-    int boarder = 20;
-    VecVector2d pixels_ref;
-    vector<double> depth_ref;
-
-    // generate pixels in ref and load depth data
-    for (int i = 0; i < nPoints; i++) {
-        int x = rng.uniform(boarder, left_img.cols - boarder);  // don't pick pixels close to boarder
-        int y = rng.uniform(boarder, left_img.rows - boarder);  // don't pick pixels close to boarder
-        int disparity = disparity_img.at<uchar>(y, x);
-        double depth = fx * baseline / disparity; // you know this is disparity to depth
-        depth_ref.push_back(depth);
-        pixels_ref.push_back(Eigen::Vector2d(x, y));
+    // depth of the first keyframe from the disparity
+    cv::Mat depth(left_img.rows, left_img.cols, CV_32F);
+    for (int y = 0; y < depth.rows; y++) {
+        for (int x = 0; x < depth.cols; x++) {
+            int disparity = disparity_img.at<uchar>(y, x);
+            // you know this is disparity to depth
+            depth.at<float>(y, x) = disparity > 0 ? fx * baseline / disparity : 0;
+        }
     }
 
-    // estimates 01~05.png's pose using this information
-    Sophus::SE3d T_cur_ref;
+    // semi-dense pixels of high gradient, selected once per keyframe on every pyramid level
+    PixelSelector selector;
+    Keyframe kf;
+    MakeKeyframe(left_img, depth, selector, Sophus::SE3d(), kf);
+
+    // a new keyframe is made when less than this ratio of its pixels is still inside the current image
+    const double min_overlap = 0.7;
+
+    // the current pyramid reuses its buffers for every image
+    ImagePyramid::Options options;
+    options.gradients = true;
+    ImagePyramid pyr_cur(options);
+    Sophus::SE3d T_cur_kf;  // pose relative to the keyframe, the last one is the guess of the next image
+    AffineBrightness ab;    // brightness relative to the keyframe, also the guess of the next image
+
+    // tracking time of every image: its pyramid, the alignment and the new keyframes, not the image reading
+    double time_tracking = 0;
+    int num_frames = 0, num_keyframes = 1;
+    for (size_t i = 0; i < image_files.size(); i++) {
+        cv::Mat img = cv::imread(image_files[i], 0);
+        if (img.empty()) {
+            cerr << "cannot read " << image_files[i] << ", skipped" << endl;
+            continue;
+        }
+        auto t1 = chrono::steady_clock::now();
+        pyr_cur.Build(img);
+        int good = DirectPoseEstimationMultiLayer(kf.ref, pyr_cur, T_cur_kf, ab);
+        Sophus::SE3d T_cur_w = T_cur_kf * kf.T_kf_w;
+        const int num_ref = int(kf.ref[0].px.size());
+
+        const bool new_keyframe = good < min_overlap * num_ref;
+        if (new_keyframe) {
+            PropagateDepth(kf, T_cur_kf, depth);
+            MakeKeyframe(img, depth, selector, T_cur_w, kf);
+            T_cur_kf = Sophus::SE3d();
+            ab = AffineBrightness();
+            num_keyframes++;
+        }
+        auto t2 = chrono::steady_clock::now();
+        time_tracking += chrono::duration_cast<chrono::duration<double>>(t2 - t1).count();
+        num_frames++;
 
-    for (int i = 1; i < 6; i++) {  // 1~10
-        cv::Mat img = cv::imread((fmt_others % i).str(), 0);
-        // try single layer by uncomment this line
-        // DirectPoseEstimationSingleLayer(left_img, img, pixels_ref, depth_ref, T_cur_ref);
-        DirectPoseEstimationMultiLayer(left_img, img, pixels_ref, depth_ref, T_cur_ref);
+        if (show_progress) {
+            cout << "image " << image_files[i] << ", T_cur_world = \n" << T_cur_w.matrix() << endl;
+        } else {
+            cout << image_files[i] << ": " << good << "/" << num_ref << " pixels, t_world_cur = "
+                 << T_cur_w.inverse().translation().transpose() << endl;
+        }
+        if (new_keyframe) {
+            cout << "new keyframe at " << image_files[i] << ", " << kf.ref[0].px.size() << " pixels" << endl;
+        }
+    }
+    if (num_frames > 0) {
+        cout << num_frames << " images, " << num_keyframes << " keyframes, " << time_tracking / num_frames * 1e3
+             << " ms per image, " << num_frames / time_tracking << " fps" << endl;
     }
     return 0;
 }
 
-void DirectPoseEstimationSingleLayer(
+void MakeKeyframe(
+    const cv::Mat &img,
+    const cv::Mat &depth,
+    const PixelSelector &selector,
+    const Sophus::SE3d &T_kf_w,
+    Keyframe &kf) {
+
+    ImagePyramid::Options options;
+    options.gradients = true;
+    kf.pyramid = std::make_shared<ImagePyramid>(options);
+    kf.pyramid->Build(img);
+    depth.copyTo(kf.depth);
+    kf.T_kf_w = T_kf_w;
+
+    const int levels = kf.pyramid->Levels();
+    kf.ref.assign(levels, ReferenceCache());
+    vector<cv::Point> pixels;
+    VecVector2d px;
+    vector<double> px_depth;
+    for (int level = 0; level < levels; level++) {
+        // depth of the pixels of this level, nearest pixel of level 0
+        const cv::Mat &img_level = kf.pyramid->Image(level);
+        const double scale = kf.pyramid->Scale(level);
+        auto level_depth = [&](int x, int y) {
+            int x0 = std::min(int(x / scale + 0.5), depth.cols - 1);
+            int y0 = std::min(int(y / scale + 0.5), depth.rows - 1);
+            return depth.at<float>(y0, x0);
+        };
+        cv::Mat mask(img_level.rows, img_level.cols, CV_8U);
+        for (int y = 0; y < mask.rows; y++) {
+            for (int x = 0; x < mask.cols; x++) {
+                mask.at<uchar>(y, x) = level_depth(x, y) > 0;
+            }
+        }
+
+        selector.Select(kf.pyramid->GradX(level), kf.pyramid->GradY(level), selector.Budget(level), pixels, mask);
+        px.clear();
+        px_depth.clear();
+        for (auto &p: pixels) {
+            px.push_back(Eigen::Vector2d(p.x, p.y));
+            px_depth.push_back(level_depth(p.x, p.y));
+        }
+        CacheReference(img_level, px, px_depth, scale, kf.ref[level]);
+    }
+}
+
+void CacheReference(
     const cv::Mat &img1,
-    const cv::Mat &img2,
     const VecVector2d &px_ref,
-    const vector<double> depth_ref,
-    Sophus::SE3d &T21) {
+    const vector<double> &depth_ref,
+    double scale,
+    ReferenceCache &cache) {
+
+    cache.px = px_ref;
+    cache.points.resize(px_ref.size());
+    cache.patches.resize(px_ref.size() * patch_area);
+    for (size_t i = 0; i < px_ref.size(); i++) {
+        // the intrinsics of a level are scaled, so the point is the one of the pixel in the full image
+        const Eigen::Vector2d px = px_ref[i] / scale;
+        cache.points[i] = depth_ref[i] * Eigen::Vector3d((px[0] - cx) / fx, (px[1] - cy) / fy, 1);
+        myslam::SampleBilinearPatch(img1, px_ref[i][0], px_ref[i][1], half_patch_size, &cache.patches[i * patch_area]);
+    }
+}
 
-    const int iterations = 10;
-    double cost = 0, lastCost = 0;
-    auto t1 = chrono::steady_clock::now();
-    JacobianAccumulator jaco_accu(img1, img2, px_ref, depth_ref, T21);
+void PropagateDepth(const Keyframe &kf, const Sophus::SE3d &T_new_kf, cv::Mat &depth) {
+    cv::Mat new_depth(kf.depth.rows, kf.depth.cols, CV_32F, cv::Scalar(0));
+    for (int y = 0; y < kf.depth.rows; y++) {
+        for (int x = 0; x < kf.depth.cols; x++) {
+            float d = kf.depth.at<float>(y, x);
+            if (d <= 0) continue;
+            Eigen::Vector3d point = T_new_kf * Eigen::Vector3d(d * (x - cx) / fx, d * (y - cy) / fy, d);
+            if (point[2] <= 0) continue;
+            int u = int(fx * point[0] / point[2] + cx + 0.5), v = int(fy * point[1] / point[2] + cy + 0.5);
+            if (u < 0 || v < 0 || u >= new_depth.cols || v >= new_depth.rows) continue;
+            float &z = new_depth.at<float>(v, u);
+            if (z == 0 || point[2] < z) z = float(point[2]);
+        }
+    }
+    depth = new_depth;
+}
 
-    for (int iter = 0; iter < iterations; iter++) {
-        jaco_accu.reset();
-        cv::parallel_for_(cv::Range(0, px_ref.size()),
-                          std::bind(&JacobianAccumulator::accumulate_jacobian, &jaco_accu, std::placeholders::_1));
-        Matrix6d H = jaco_accu.hessian();
-        Vector6d b = jaco_accu.bias();
+int DirectPoseEstimationSingleLayer(
+    const ReferenceCache &ref,
+    const cv::Mat &img2,
+    Sophus::SE3d &T21,
+    AffineBrightness &ab,
+    const cv::Mat &grad_x2,
+    const cv::Mat &grad_y2) {
 
-        // solve update and put it into estimation
-        Vector6d update = H.ldlt().solve(b);;
-        T21 = Sophus::SE3d::exp(update) * T21;
-        cost = jaco_accu.cost_func();
+    const int iterations = 10;
+    const double max_lambda = 1e4;
+    auto t1 = chrono::steady_clock::now();
+    JacobianAccumulator jaco_accu(ref, img2, T21, ab, grad_x2, grad_y2);
+
+    // every iteration evaluates one candidate, its linearization is kept if the cost decreased
+    jaco_accu.accumulate();
+    Matrix8d H = jaco_accu.hessian();
+    Vector8d b = jaco_accu.bias();
+    double cost = jaco_accu.cost_func();
+    int good = jaco_accu.num_good();
+    VecVector2d projection = jaco_accu.projected_points();
+    double lambda = 1e-4;
 
+    for (int iter = 0; iter < iterations && lambda < max_lambda; iter++) {
+        // solve the damped update and put it into estimation
+        Matrix8d H_lm = H;
+        H_lm.diagonal() *= 1 + lambda;
+        Vector8d update = H_lm.ldlt().solve(b);
         if (std::isnan(update[0])) {
             // sometimes occurred when we have a black or white patch and H is irreversible
             cout << "update is nan" << endl;
             break;
         }
-        if (iter > 0 && cost > lastCost) {
-            cout << "cost increased: " << cost << ", " << lastCost << endl;
-            break;
+        const Sophus::SE3d T21_old = T21;
+        const AffineBrightness ab_old = ab;
+        T21 = Sophus::SE3d::exp(update.head<6>()) * T21;
+        ab.a += update[6];
+        ab.b += update[7];
+
+        jaco_accu.accumulate();
+        double new_cost = jaco_accu.cost_func();
+        if (jaco_accu.num_good() == 0 || new_cost >= cost) {
+            // reject, a smaller step from the same linearization
+            T21 = T21_old;
+            ab = ab_old;
+            lambda *= 10;
+            if (show_progress) {
+                cout << "cost increased: " << new_cost << ", " << cost << ", lambda: " << lambda << endl;
+            }
+            continue;
         }
+        H = jaco_accu.hessian();
+        b = jaco_accu.bias();
+        cost = new_cost;
+        good = jaco_accu.num_good();
+        projection = jaco_accu.projected_points();
+        lambda = std::max(lambda / 10, 1e-7);
+        if (show_progress) cout << "iteration: " << iter << ", cost: " << cost << endl;
         if (update.norm() < 1e-3) {
             // converge
             break;
         }
-
-        lastCost = cost;
-        cout << "iteration: " << iter << ", cost: " << cost << endl;
     }
 
+    if (!show_progress) return good;
     cout << "T21 = \n" << T21.matrix() << endl;
+    cout << "brightness a = " << ab.a << ", b = " << ab.b << endl;
     auto t2 = chrono::steady_clock::now();
     auto time_used = chrono::duration_cast<chrono::duration<double>>(t2 - t1);
     cout << "direct method for single layer: " << time_used.count() << endl;
@@ -204,9 +438,8 @@ void DirectPoseEstimationSingleLayer(
     // plot the projected pixels here
     cv::Mat img2_show;
     cv::cvtColor(img2, img2_show, CV_GRAY2BGR);
-    VecVector2d projection = jaco_accu.projected_points();
-    for (size_t i = 0; i < px_ref.size(); ++i) {
-        auto p_ref = px_ref[i];
+    for (size_t i = 0; i < ref.px.size(); ++i) {
+        auto p_ref = ref.px[i];
         auto p_cur = projection[i];
         if (p_cur[0] > 0 && p_cur[1] > 0) {
             cv::circle(img2_show, cv::Point2f(p_cur[0], p_cur[1]), 2, cv::Scalar(0, 250, 0), 2);
@@ -216,23 +449,26 @@ void DirectPoseEstimationSingleLayer(
     }
     cv::imshow("current", img2_show);
     cv::waitKey();
+    return good;
+}
+
+void JacobianAccumulator::accumulate() {
+    reducer.Reduce(0, int(ref.points.size()), [this](int begin, int end, myslam::NormalEquations<8> &equations) {
+        accumulate_jacobian(begin, end, equations);
+    });
 }
 
-void JacobianAccumulator::accumulate_jacobian(const cv::Range &range) {
+void JacobianAccumulator::accumulate_jacobian(int begin, int end, myslam::NormalEquations<8> &equations) {
 
     // parameters
-    const int half_patch_size = 1;
-    int cnt_good = 0;
-    Matrix6d hessian = Matrix6d::Zero();
-    Vector6d bias = Vector6d::Zero();
-    double cost_tmp = 0;
-
-    for (size_t i = range.start; i < range.end; i++) {
-
-        // compute the projection in the second image
-        Eigen::Vector3d point_ref =
-            depth_ref[i] * Eigen::Vector3d((px_ref[i][0] - cx) / fx, (px_ref[i][1] - cy) / fy, 1);
-        Eigen::Vector3d point_cur = T21 * point_ref;
+    const double exp_a = exp(ab.a);
+    // current patch and its gradients, bilinear samples with shared sub-pixel weights
+    float cur[patch_area], grad_x[patch_area], grad_y[patch_area];
+
+    for (int i = begin; i < end; i++) {
+
+        // compute the projection of the cached point in the second image
+        Eigen::Vector3d point_cur = T21 * ref.points[i];
         if (point_cur[2] < 0)   // depth invalid
             continue;
 
@@ -244,96 +480,80 @@ void JacobianAccumulator::accumulate_jacobian(const cv::Range &range) {
         projection[i] = Eigen::Vector2d(u, v);
         double X = point_cur[0], Y = point_cur[1], Z = point_cur[2],
             Z2 = Z * Z, Z_inv = 1.0 / Z, Z2_inv = Z_inv * Z_inv;
-        cnt_good++;
+        equations.num_inliers++;
+
+        Matrix26d J_pixel_xi;
+        J_pixel_xi(0, 0) = fx * Z_inv;
+        J_pixel_xi(0, 1) = 0;
+        J_pixel_xi(0, 2) = -fx * X * Z2_inv;
+        J_pixel_xi(0, 3) = -fx * X * Y * Z2_inv;
+        J_pixel_xi(0, 4) = fx + fx * X * X * Z2_inv;
+        J_pixel_xi(0, 5) = -fx * Y * Z_inv;
+
+        J_pixel_xi(1, 0) = 0;
+        J_pixel_xi(1, 1) = fy * Z_inv;
+        J_pixel_xi(1, 2) = -fy * Y * Z2_inv;
+        J_pixel_xi(1, 3) = -fy - fy * Y * Y * Z2_inv;
+        J_pixel_xi(1, 4) = fy * X * Y * Z2_inv;
+        J_pixel_xi(1, 5) = fy * X * Z_inv;
+
+        // the cached reference patch, and img2 with central difference gradients unless they are precomputed
+        const float *patch_ref = &ref.patches[i * patch_area];
+        if (grad_x2.empty()) {
+            myslam::SampleBilinearPatch(img2, u, v, half_patch_size, cur, grad_x, grad_y);
+        } else {
+            myslam::SampleBilinearPatch(img2, u, v, half_patch_size, cur);
+        }
 
         // and compute error and jacobian
-        for (int x = -half_patch_size; x <= half_patch_size; x++)
-            for (int y = -half_patch_size; y <= half_patch_size; y++) {
+        for (int y = -half_patch_size; y <= half_patch_size; y++)
+            for (int x = -half_patch_size; x <= half_patch_size; x++) {
+                const int k = (y + half_patch_size) * patch_size + x + half_patch_size;
 
-                double error = GetPixelValue(img1, px_ref[i][0] + x, px_ref[i][1] + y) -
-                               GetPixelValue(img2, u + x, v + y);
-                Matrix26d J_pixel_xi;
+                // the reference pixel with the brightness of img2
+                double error = exp_a * patch_ref[k] + ab.b - cur[k];
                 Eigen::Vector2d J_img_pixel;
-
-                J_pixel_xi(0, 0) = fx * Z_inv;
-                J_pixel_xi(0, 1) = 0;
-                J_pixel_xi(0, 2) = -fx * X * Z2_inv;
-                J_pixel_xi(0, 3) = -fx * X * Y * Z2_inv;
-                J_pixel_xi(0, 4) = fx + fx * X * X * Z2_inv;
-                J_pixel_xi(0, 5) = -fx * Y * Z_inv;
-
-                J_pixel_xi(1, 0) = 0;
-                J_pixel_xi(1, 1) = fy * Z_inv;
-                J_pixel_xi(1, 2) = -fy * Y * Z2_inv;
-                J_pixel_xi(1, 3) = -fy - fy * Y * Y * Z2_inv;
-                J_pixel_xi(1, 4) = fy * X * Y * Z2_inv;
-                J_pixel_xi(1, 5) = fy * X * Z_inv;
-
-                J_img_pixel = Eigen::Vector2d(
-                    0.5 * (GetPixelValue(img2, u + 1 + x, v + y) - GetPixelValue(img2, u - 1 + x, v + y)),
-                    0.5 * (GetPixelValue(img2, u + x, v + 1 + y) - GetPixelValue(img2, u + x, v - 1 + y))
-                );
-
-                // total jacobian
-                Vector6d J = -1.0 * (J_img_pixel.transpose() * J_pixel_xi).transpose();
-
-                hessian += J * J.transpose();
-                bias += -error * J;
-                cost_tmp += error * error;
+                if (grad_x2.empty()) {
+                    J_img_pixel = Eigen::Vector2d(grad_x[k], grad_y[k]);
+                } else {
+                    // precomputed Sobel gradients of the pyramid level
+                    J_img_pixel = Eigen::Vector2d(myslam::SampleBilinear<float>(grad_x2, u + x, v + y),
+                                                  myslam::SampleBilinear<float>(grad_y2, u + x, v + y));
+                }
+
+                // total jacobian, pose then a and b
+                Vector8d J;
+                J.head<6>() = -1.0 * (J_img_pixel.transpose() * J_pixel_xi).transpose();
+                J[6] = exp_a * patch_ref[k];
+                J[7] = 1;
+
+                // Huber weight
+                double weight = fabs(error) <= huber_delta ? 1.0 : huber_delta / fabs(error);
+                equations.Add(J, error, weight);
             }
     }
-
-    if (cnt_good) {
-        // set hessian, bias and cost
-        unique_lock<mutex> lck(hessian_mutex);
-        H += hessian;
-        b += bias;
-        cost += cost_tmp / cnt_good;
-    }
 }
 
-void DirectPoseEstimationMultiLayer(
-    const cv::Mat &img1,
-    const cv::Mat &img2,
-    const VecVector2d &px_ref,
-    const vector<double> depth_ref,
-    Sophus::SE3d &T21) {
-
-    // parameters
-    int pyramids = 4;
-    double pyramid_scale = 0.5;
-    double scales[] = {1.0, 0.5, 0.25, 0.125};
-
-    // create pyramids
-    vector<cv::Mat> pyr1, pyr2; // image pyramids
-    for (int i = 0; i < pyramids; i++) {
-        if (i == 0) {
-            pyr1.push_back(img1);
-            pyr2.push_back(img2);
-        } else {
-            cv::Mat img1_pyr, img2_pyr;
-            cv::resize(pyr1[i - 1], img1_pyr,
-                       cv::Size(pyr1[i - 1].cols * pyramid_scale, pyr1[i - 1].rows * pyramid_scale));
-            cv::resize(pyr2[i - 1], img2_pyr,
-                       cv::Size(pyr2[i - 1].cols * pyramid_scale, pyr2[i - 1].rows * pyramid_scale));
-            pyr1.push_back(img1_pyr);
-            pyr2.push_back(img2_pyr);
-        }
-    }
+int DirectPoseEstimationMultiLayer(
+    const vector<ReferenceCache> &ref,
+    const ImagePyramid &pyr2,
+    Sophus::SE3d &T21,
+    AffineBrightness &ab) {
 
+    const int pyramids = int(ref.size());
     double fxG = fx, fyG = fy, cxG = cx, cyG = cy;  // backup the old values
+    int good = 0;
     for (int level = pyramids - 1; level >= 0; level--) {
-        VecVector2d px_ref_pyr; // set the keypoints in this pyramid level
-        for (auto &px: px_ref) {
-            px_ref_pyr.push_back(scales[level] * px);
-        }
+        const double scale = pyr2.Scale(level);
 
         // scale fx, fy, cx, cy in different pyramid levels
-        fx = fxG * scales[level];
-        fy = fyG * scales[level];
-        cx = cxG * scales[level];
-        cy = cyG * scales[level];
-        DirectPoseEstimationSingleLayer(pyr1[level], pyr2[level], px_ref_pyr, depth_ref, T21);
+        fx = fxG * scale;
+        fy = fyG * scale;
+        cx = cxG * scale;
+        cy = cyG * scale;
+        good = DirectPoseEstimationSingleLayer(ref[level], pyr2.Image(level), T21, ab, pyr2.GradX(level),
+                                               pyr2.GradY(level));
     }
-
+    fx = fxG, fy = fyG, cx = cxG, cy = cyG;
+    return good;
 }
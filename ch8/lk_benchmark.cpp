@@ -0,0 +1,199 @@
+#include <opencv2/opencv.hpp>
+#include <benchmark/benchmark.h>
+#include <cmath>
+#include <map>
+#include <string>
+#include "benchmark_support.h"
+#include "lk_patch.h"
+#include "myslam/image_pyramid.h"
+
+using namespace std;
+using myslam::ImagePyramid;
+
+/**
+ * Lucas-Kanade micro benchmarks with ground truth, a regression suite for the LK trackers:
+ * - LKSelf: coarse-to-fine LKPatch on ImagePyramid, the tracker of optical_flow (8x8 patch)
+ * - CvLK: cv::calcOpticalFlowPyrLK
+ * The second image is the first one warped by a known affine transform (rotation, scale and a translation larger
+ * than a patch), so every keypoint has a ground truth position. Both trackers build the pyramids of both images in
+ * every iteration. Besides the time, every benchmark reports the accuracy of its last run:
+ * - epe: mean end point error of the keypoints reported as tracked, in pixels
+ * - inliers: ratio of the keypoints tracked within 1 pixel of the ground truth
+ * The sweeps cover keypoint counts, pyramid levels, forward / inverse (LKSelf), window sizes (CvLK) and OpenCV
+ * thread counts.
+ * usage: lk_benchmark [image] [google benchmark flags]
+ * the results are written to lk_benchmark.json unless --benchmark_out is given
+ */
+
+namespace {
+
+string image_file = "./LK1.png";
+
+/// the first image, or blurred noise if it cannot be read
+const cv::Mat &Image1() {
+    static cv::Mat img;
+    if (img.empty()) img = BenchmarkImage(image_file);
+    return img;
+}
+
+/// the ground truth warp from the first to the second image: 1.5 degrees, 3% zoom and (10, -6) pixels
+const cv::Mat &Warp() {
+    static cv::Mat warp;
+    if (warp.empty()) {
+        const cv::Mat &img1 = Image1();
+        warp = cv::getRotationMatrix2D(cv::Point2f(img1.cols / 2.f, img1.rows / 2.f), 1.5, 1.03);
+        warp.at<double>(0, 2) += 10;
+        warp.at<double>(1, 2) -= 6;
+    }
+    return warp;
+}
+
+cv::Point2f WarpPoint(const cv::Point2f &pt) {
+    const cv::Mat &w = Warp();
+    return cv::Point2f(w.at<double>(0, 0) * pt.x + w.at<double>(0, 1) * pt.y + w.at<double>(0, 2),
+                       w.at<double>(1, 0) * pt.x + w.at<double>(1, 1) * pt.y + w.at<double>(1, 2));
+}
+
+const cv::Mat &Image2() {
+    static cv::Mat img;
+    if (img.empty()) cv::warpAffine(Image1(), img, Warp(), Image1().size(), cv::INTER_LINEAR);
+    return img;
+}
+
+/// GFTT corners of the first image whose ground truth stays inside the second one, cached per count
+const vector<cv::Point2f> &Keypoints(int count) {
+    static map<int, vector<cv::Point2f>> cache;
+    auto it = cache.find(count);
+    if (it != cache.end()) return it->second;
+
+    const cv::Mat &img1 = Image1();
+    const int border = 16;
+    vector<cv::KeyPoint> corners;
+    cv::GFTTDetector::create(count, 0.001, 3)->detect(img1, corners);
+    vector<cv::Point2f> &pts = cache[count];
+    for (auto &kp : corners) {
+        cv::Point2f gt = WarpPoint(kp.pt);
+        if (gt.x >= border && gt.y >= border && gt.x < img1.cols - border && gt.y < img1.rows - border) {
+            pts.push_back(kp.pt);
+        }
+    }
+    return pts;
+}
+
+void ReportCounters(benchmark::State &state, const vector<cv::Point2f> &pt1, const vector<cv::Point2f> &pt2,
+                    const vector<uchar> &status) {
+    double epe = 0;
+    int tracked = 0, inliers = 0;
+    for (size_t i = 0; i < pt1.size(); i++) {
+        if (!status[i]) continue;
+        double error = cv::norm(pt2[i] - WarpPoint(pt1[i]));
+        epe += error;
+        tracked++;
+        inliers += error < 1;
+    }
+    state.SetItemsProcessed(state.iterations() * int64_t(pt1.size()));
+    state.counters["keypoints"] = double(pt1.size());
+    state.counters["epe"] = tracked ? epe / tracked : 0;
+    state.counters["inliers"] = pt1.empty() ? 0 : double(inliers) / pt1.size();
+}
+
+/// coarse-to-fine LKPatch, as OpticalFlowMultiLevel in optical_flow
+void TrackSelf(const ImagePyramid &pyr1, const ImagePyramid &pyr2, const vector<cv::Point2f> &pt1,
+               vector<cv::Point2f> &pt2, vector<uchar> &status, bool inverse) {
+    const int n = int(pt1.size());
+    pt2.assign(n, cv::Point2f());
+    status.assign(n, 1);
+    vector<cv::Point2f> flow(n, cv::Point2f(0, 0));  // displacement at the current level
+    LKPatch::Options options;
+    options.inverse = inverse;
+    const LKPatch lk(options);
+
+    for (int level = pyr1.Levels() - 1; level >= 0; level--) {
+        const double scale = pyr1.Scale(level);
+        cv::parallel_for_(cv::Range(0, n), [&](const cv::Range &range) {
+            for (int i = range.start; i < range.end; i++) {
+                double dx = flow[i].x, dy = flow[i].y;
+                status[i] = lk.Track(pyr1.Image(level), pyr2.Image(level), pt1[i] * scale, dx, dy);
+                flow[i] = cv::Point2f(dx, dy);
+            }
+        });
+        if (level > 0) {
+            const double up = pyr1.Scale(level - 1) / scale;
+            for (auto &f : flow) f *= up;
+        }
+    }
+    for (int i = 0; i < n; i++) pt2[i] = pt1[i] + flow[i];
+}
+
+// arguments: keypoints, pyramid levels, inverse, threads
+
+void BM_LKSelf(benchmark::State &state) {
+    const vector<cv::Point2f> &pt1 = Keypoints(state.range(0));
+    ScopedThreads threads(state.range(3));
+    ImagePyramid::Options options;
+    options.levels = state.range(1);
+    ImagePyramid pyr1(options), pyr2(options);
+    vector<cv::Point2f> pt2;
+    vector<uchar> status;
+    for (auto _ : state) {
+        pyr1.Build(Image1());
+        pyr2.Build(Image2());
+        TrackSelf(pyr1, pyr2, pt1, pt2, status, state.range(2));
+        benchmark::DoNotOptimize(pt2.data());
+    }
+    ReportCounters(state, pt1, pt2, status);
+    state.counters["patch"] = LKPatch::kPatchSize;
+    state.SetLabel(LKPatch::KernelName());
+}
+
+// arguments: keypoints, pyramid levels, window size, threads
+
+void BM_CvLK(benchmark::State &state) {
+    const vector<cv::Point2f> &pt1 = Keypoints(state.range(0));
+    ScopedThreads threads(state.range(3));
+    const cv::Size window(state.range(2), state.range(2));
+    vector<cv::Point2f> pt2;
+    vector<uchar> status;
+    vector<float> error;
+    for (auto _ : state) {
+        cv::calcOpticalFlowPyrLK(Image1(), Image2(), pt1, pt2, status, error, window, state.range(1) - 1);
+        benchmark::DoNotOptimize(pt2.data());
+    }
+    ReportCounters(state, pt1, pt2, status);
+    state.counters["patch"] = state.range(2);
+}
+
+/// keypoints x levels x forward / inverse x thread counts
+void SweepSelf(benchmark::internal::Benchmark *b) {
+    b->ArgNames({"keypoints", "levels", "inverse", "threads"});
+    for (int keypoints : {100, 1000, 10000}) {
+        for (int levels : {1, 2, 3, 4}) {
+            for (int inverse : {0, 1}) {
+                AddThreadCounts(b, {keypoints, levels, inverse});
+            }
+        }
+    }
+    b->Unit(benchmark::kMillisecond)->UseRealTime();
+}
+
+/// keypoints x levels x window sizes x thread counts
+void SweepCv(benchmark::internal::Benchmark *b) {
+    b->ArgNames({"keypoints", "levels", "window", "threads"});
+    for (int keypoints : {100, 1000, 10000}) {
+        for (int levels : {1, 2, 3, 4}) {
+            for (int window : {9, 15, 21, 31}) {
+                AddThreadCounts(b, {keypoints, levels, window});
+            }
+        }
+    }
+    b->Unit(benchmark::kMillisecond)->UseRealTime();
+}
+
+BENCHMARK(BM_LKSelf)->Apply(SweepSelf);
+BENCHMARK(BM_CvLK)->Apply(SweepCv);
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    return RunBenchmarks(argc, argv, image_file, "lk_benchmark.json");
+}
@@ -0,0 +1,261 @@
+#include "lk_patch.h"
+
+#include <Eigen/Core>
+#include <Eigen/Dense>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include "myslam/bilinear.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+using myslam::BilinearWeights;
+
+const float kWeightScale = 1.0f / (1 << myslam::kBilinearWeightBits);
+const int kPatchSize = LKPatch::kPatchSize;
+const int kPatchArea = LKPatch::kPatchArea;
+
+/**
+ * rows x 8 bilinear samples, reads rows + 1 rows of 9 pixels from src
+ * @param out row major, 8 floats per row, 32 byte aligned
+ */
+#if defined(__AVX2__)
+void SampleBlock(const uchar *src, size_t step, int rows, const BilinearWeights &w, float *out) {
+    // pixel pairs (p[x], p[x + 1]) times (w0, w1) summed by madd
+    const __m256i w_top = _mm256_set1_epi32(int(uint16_t(w.w00)) | (int(uint16_t(w.w01)) << 16));
+    const __m256i w_bottom = _mm256_set1_epi32(int(uint16_t(w.w10)) | (int(uint16_t(w.w11)) << 16));
+    const __m256 scale = _mm256_set1_ps(kWeightScale);
+    auto pairs = [](const uchar *p) {
+        const __m128i a = _mm_loadl_epi64((const __m128i *) p), b = _mm_loadl_epi64((const __m128i *) (p + 1));
+        return _mm256_cvtepu8_epi16(_mm_unpacklo_epi8(a, b));
+    };
+    __m256i top = pairs(src);
+    for (int r = 0; r < rows; r++) {
+        const __m256i bottom = pairs(src + (r + 1) * step);
+        const __m256i sum = _mm256_add_epi32(_mm256_madd_epi16(top, w_top), _mm256_madd_epi16(bottom, w_bottom));
+        _mm256_store_ps(out + r * kPatchSize, _mm256_mul_ps(_mm256_cvtepi32_ps(sum), scale));
+        top = bottom;
+    }
+}
+#elif defined(__SSE2__)
+void SampleBlock(const uchar *src, size_t step, int rows, const BilinearWeights &w, float *out) {
+    const __m128i w_top = _mm_set1_epi32(int(uint16_t(w.w00)) | (int(uint16_t(w.w01)) << 16));
+    const __m128i w_bottom = _mm_set1_epi32(int(uint16_t(w.w10)) | (int(uint16_t(w.w11)) << 16));
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 scale = _mm_set1_ps(kWeightScale);
+    auto pairs = [](const uchar *p) {
+        return _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) p), _mm_loadl_epi64((const __m128i *) (p + 1)));
+    };
+    __m128i top = pairs(src);
+    for (int r = 0; r < rows; r++) {
+        const __m128i bottom = pairs(src + (r + 1) * step);
+        const __m128i lo = _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi8(top, zero), w_top),
+                                         _mm_madd_epi16(_mm_unpacklo_epi8(bottom, zero), w_bottom));
+        const __m128i hi = _mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi8(top, zero), w_top),
+                                         _mm_madd_epi16(_mm_unpackhi_epi8(bottom, zero), w_bottom));
+        _mm_store_ps(out + r * kPatchSize, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+        _mm_store_ps(out + r * kPatchSize + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+        top = bottom;
+    }
+}
+#else
+void SampleBlock(const uchar *src, size_t step, int rows, const BilinearWeights &w, float *out) {
+    for (int r = 0; r < rows; r++) {
+        const uchar *p0 = src + r * step, *p1 = p0 + step;
+        for (int c = 0; c < kPatchSize; c++) {
+            const int sum = w.w00 * p0[c] + w.w01 * p0[c + 1] + w.w10 * p1[c] + w.w11 * p1[c + 1];
+            out[r * kPatchSize + c] = float(sum) * kWeightScale;
+        }
+    }
+}
+#endif
+
+/**
+ * sums of the Gauss-Newton step over a patch, e = ref - cur
+ * @param sums e * gx, e * gy, e * e, and if hessian: gx * gx, gx * gy, gy * gy
+ */
+#if defined(__AVX2__)
+inline __m256 Fma(__m256 a, __m256 b, __m256 c) {
+#if defined(__FMA__)
+    return _mm256_fmadd_ps(a, b, c);
+#else
+    return _mm256_add_ps(_mm256_mul_ps(a, b), c);
+#endif
+}
+
+inline float HorizontalSum(__m256 v) {
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+    return _mm_cvtss_f32(s);
+}
+
+void Accumulate(const float *ref, const float *cur, const float *gx, const float *gy, bool hessian, float *sums) {
+    __m256 acc[6];
+    for (auto &a : acc) a = _mm256_setzero_ps();
+    for (int i = 0; i < kPatchArea; i += 8) {
+        const __m256 e = _mm256_sub_ps(_mm256_load_ps(ref + i), _mm256_load_ps(cur + i));
+        const __m256 x = _mm256_load_ps(gx + i), y = _mm256_load_ps(gy + i);
+        acc[0] = Fma(e, x, acc[0]);
+        acc[1] = Fma(e, y, acc[1]);
+        acc[2] = Fma(e, e, acc[2]);
+        if (hessian) {
+            acc[3] = Fma(x, x, acc[3]);
+            acc[4] = Fma(x, y, acc[4]);
+            acc[5] = Fma(y, y, acc[5]);
+        }
+    }
+    for (int k = 0; k < 6; k++) sums[k] = HorizontalSum(acc[k]);
+}
+#elif defined(__SSE2__)
+inline float HorizontalSum(__m128 v) {
+    v = _mm_add_ps(v, _mm_movehl_ps(v, v));
+    v = _mm_add_ss(v, _mm_shuffle_ps(v, v, 1));
+    return _mm_cvtss_f32(v);
+}
+
+void Accumulate(const float *ref, const float *cur, const float *gx, const float *gy, bool hessian, float *sums) {
+    __m128 acc[6];
+    for (auto &a : acc) a = _mm_setzero_ps();
+    for (int i = 0; i < kPatchArea; i += 4) {
+        const __m128 e = _mm_sub_ps(_mm_load_ps(ref + i), _mm_load_ps(cur + i));
+        const __m128 x = _mm_load_ps(gx + i), y = _mm_load_ps(gy + i);
+        acc[0] = _mm_add_ps(acc[0], _mm_mul_ps(e, x));
+        acc[1] = _mm_add_ps(acc[1], _mm_mul_ps(e, y));
+        acc[2] = _mm_add_ps(acc[2], _mm_mul_ps(e, e));
+        if (hessian) {
+            acc[3] = _mm_add_ps(acc[3], _mm_mul_ps(x, x));
+            acc[4] = _mm_add_ps(acc[4], _mm_mul_ps(x, y));
+            acc[5] = _mm_add_ps(acc[5], _mm_mul_ps(y, y));
+        }
+    }
+    for (int k = 0; k < 6; k++) sums[k] = HorizontalSum(acc[k]);
+}
+#else
+void Accumulate(const float *ref, const float *cur, const float *gx, const float *gy, bool hessian, float *sums) {
+    fill(sums, sums + 6, 0.0f);
+    for (int i = 0; i < kPatchArea; i++) {
+        const float e = ref[i] - cur[i];
+        sums[0] += e * gx[i];
+        sums[1] += e * gy[i];
+        sums[2] += e * e;
+        if (hessian) {
+            sums[3] += gx[i] * gx[i];
+            sums[4] += gx[i] * gy[i];
+            sums[5] += gy[i] * gy[i];
+        }
+    }
+}
+#endif
+
+}  // namespace
+
+const char *LKPatch::KernelName() {
+#if defined(__AVX2__)
+    return "avx2";
+#elif defined(__SSE2__)
+    return "sse2";
+#else
+    return "scalar";
+#endif
+}
+
+void LKPatch::SamplePatch(const cv::Mat &img, float x, float y, bool gradients, Patch &patch) {
+    const int margin = gradients ? 1 : 0;
+    const float fx = floor(x), fy = floor(y);
+    const int ix = int(fx), iy = int(fy);
+    if (ix - margin >= 0 && iy - margin >= 0 && ix + kPatchSize + margin < img.cols &&
+        iy + kPatchSize + margin < img.rows) {
+        const BilinearWeights w(x - fx, y - fy);
+        const size_t step = img.step;
+        const uchar *origin = img.ptr<uchar>(iy) + ix;
+        if (!gradients) {
+            SampleBlock(origin, step, kPatchSize, w, patch.value);
+            return;
+        }
+        // rows -1 .. 8 of the patch for the vertical gradient, and the patch shifted left and right
+        alignas(32) float center[(kPatchSize + 2) * kPatchSize];
+        alignas(32) float left[kPatchArea], right[kPatchArea];
+        SampleBlock(origin - step, step, kPatchSize + 2, w, center);
+        SampleBlock(origin - 1, step, kPatchSize, w, left);
+        SampleBlock(origin + 1, step, kPatchSize, w, right);
+        for (int i = 0; i < kPatchArea; i++) {
+            patch.value[i] = center[i + kPatchSize];
+            patch.gx[i] = 0.5f * (right[i] - left[i]);
+            patch.gy[i] = 0.5f * (center[i + 2 * kPatchSize] - center[i]);
+        }
+        return;
+    }
+
+    // at the border, one clamped sample at a time
+    for (int r = 0; r < kPatchSize; r++) {
+        for (int c = 0; c < kPatchSize; c++) {
+            const int i = r * kPatchSize + c;
+            if (gradients) {
+                patch.value[i] = myslam::SampleBilinear(img, x + c, y + r, patch.gx[i], patch.gy[i]);
+            } else {
+                patch.value[i] = myslam::SampleBilinear(img, x + c, y + r);
+            }
+        }
+    }
+}
+
+bool LKPatch::Track(const cv::Mat &img1, const cv::Mat &img2, const cv::Point2f &pt, double &dx,
+                    double &dy) const {
+    const bool inverse = options_.inverse;
+    const float x0 = pt.x - kHalfPatchSize, y0 = pt.y - kHalfPatchSize;
+
+    // the reference patch, and in inverse mode its gradients and H, once per keypoint
+    Patch reference, current;
+    SamplePatch(img1, x0, y0, inverse, reference);
+    Eigen::LDLT<Eigen::Matrix2d> ldlt;
+    if (inverse) {
+        float sums[6];
+        Accumulate(reference.value, reference.value, reference.gx, reference.gy, true, sums);
+        Eigen::Matrix2d H;
+        H << sums[3], sums[4], sums[4], sums[5];
+        ldlt.compute(H);
+    }
+
+    double cost = 0, last_cost = 0;
+    bool succ = true;
+    for (int iter = 0; iter < options_.iterations; iter++) {
+        SamplePatch(img2, float(x0 + dx), float(y0 + dy), !inverse, current);
+        const Patch &gradient = inverse ? reference : current;
+        float sums[6];
+        Accumulate(reference.value, current.value, gradient.gx, gradient.gy, !inverse, sums);
+        if (!inverse) {
+            Eigen::Matrix2d H;
+            H << sums[3], sums[4], sums[4], sums[5];
+            ldlt.compute(H);
+        }
+        cost = sums[2];
+
+        // J = -gradient, b = -J * e
+        const Eigen::Vector2d update = ldlt.solve(Eigen::Vector2d(sums[0], sums[1]));
+        if (std::isnan(update[0])) {
+            // a black or white patch, H is not invertible
+            succ = false;
+            break;
+        }
+        if (iter > 0 && cost > last_cost) {
+            break;
+        }
+        dx += update[0];
+        dy += update[1];
+        last_cost = cost;
+        succ = true;
+        if (update.norm() < options_.min_update) {
+            break;
+        }
+    }
+    return succ;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <opencv2/core/core.hpp>
+
+/**
+ * Lucas-Kanade of a single keypoint on an 8x8 patch, translation only, same iterations as the original
+ * OpticalFlowTracker (Gauss-Newton, stop on cost increase or small update)
+ * - all pixels of a patch share the sub-pixel offset, so the bilinear weights are computed once per sampling and
+ *   quantized to 14 bits; a patch row is 8 pixels, interpolated with integer multiply-adds in SSE2 or AVX2
+ * - inverse compositional: the reference patch, its gradients and H are sampled once per keypoint into aligned
+ *   buffers, every iteration only samples the 8x8 patch of the second image
+ * - forward additive: the gradients of the second image come from the same warped samples
+ * Patches too close to the border are sampled with the clamped floating point interpolation.
+ */
+class LKPatch {
+public:
+    static const int kHalfPatchSize = 4;
+    static const int kPatchSize = 2 * kHalfPatchSize;
+    static const int kPatchArea = kPatchSize * kPatchSize;
+
+    struct Options {
+        int iterations = 10;
+        double min_update = 1e-2;  // converged when the update is smaller, in pixels
+        bool inverse = true;       // inverse compositional, otherwise forward additive
+    };
+
+    LKPatch() : LKPatch(Options()) {}
+
+    explicit LKPatch(const Options &options) : options_(options) {}
+
+    /**
+     * track one keypoint
+     * @param img1 the first image, 8 bit gray
+     * @param img2 the second image, 8 bit gray
+     * @param pt keypoint in img1
+     * @param dx [in|out] displacement from pt to the keypoint in img2
+     * @param dy [in|out]
+     * @return false if an update was not a number
+     */
+    bool Track(const cv::Mat &img1, const cv::Mat &img2, const cv::Point2f &pt, double &dx, double &dy) const;
+
+    /// instruction set of the patch sampling
+    static const char *KernelName();
+
+private:
+    /// a patch and its gradients
+    struct alignas(32) Patch {
+        float value[kPatchArea];
+        float gx[kPatchArea];
+        float gy[kPatchArea];
+    };
+
+    /**
+     * sample the 8x8 patch whose top left pixel is at (x, y)
+     * @param gradients also compute the central difference gradients
+     */
+    static void SamplePatch(const cv::Mat &img, float x, float y, bool gradients, Patch &patch);
+
+    Options options_;
+};
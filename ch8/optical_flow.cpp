@@ -5,11 +5,13 @@
 #include <opencv2/opencv.hpp>
 #include <string>
 #include <chrono>
-#include <Eigen/Core>
-#include <Eigen/Dense>
+#include "lk_patch.h"
+#include "myslam/flow_check.h"
+#include "myslam/image_pyramid.h"
 
 using namespace std;
 using namespace cv;
+using myslam::ImagePyramid;
 
 string file_1 = "./LK1.png";  // first image
 string file_2 = "./LK2.png";  // second image
@@ -23,9 +25,10 @@ public:
         const vector<KeyPoint> &kp1_,
         vector<KeyPoint> &kp2_,
         vector<bool> &success_,
-        bool inverse_ = true, bool has_initial_ = false) :
+        bool inverse_ = true, bool has_initial_ = false,
+        const myslam::FlowCheck &check_ = myslam::FlowCheck()) :
         img1(img1_), img2(img2_), kp1(kp1_), kp2(kp2_), success(success_), inverse(inverse_),
-        has_initial(has_initial_) {}
+        has_initial(has_initial_), check(check_) {}
 
     void calculateOpticalFlow(const Range &range);
 
@@ -37,6 +40,7 @@ private:
     vector<bool> &success;
     bool inverse = true;
     bool has_initial = false;
+    myslam::FlowCheck check;  // forward-backward and NCC checks of every track
 };
 
 /**
@@ -47,6 +51,7 @@ private:
  * @param [in|out] kp2 keypoints in img2, if empty, use initial guess in kp1
  * @param [out] success true if a keypoint is tracked successfully
  * @param [in] inverse use inverse formulation?
+ * @param [in] check checks of every track, the NCC score is set as the response of kp2
  */
 void OpticalFlowSingleLevel(
     const Mat &img1,
@@ -55,7 +60,8 @@ void OpticalFlowSingleLevel(
     vector<KeyPoint> &kp2,
     vector<bool> &success,
     bool inverse = false,
-    bool has_initial_guess = false
+    bool has_initial_guess = false,
+    const myslam::FlowCheck &check = myslam::FlowCheck()
 );
 
 /**
@@ -67,6 +73,7 @@ void OpticalFlowSingleLevel(
  * @param [out] kp2 keypoints in img2
  * @param [out] success true if a keypoint is tracked successfully
  * @param [in] inverse set true to enable inverse formulation
+ * @param [in] check checks of every track on the finest level, the NCC score is set as the response of kp2
  */
 void OpticalFlowMultiLevel(
     const Mat &img1,
@@ -74,32 +81,29 @@ void OpticalFlowMultiLevel(
     const vector<KeyPoint> &kp1,
     vector<KeyPoint> &kp2,
     vector<bool> &success,
-    bool inverse = false
+    bool inverse = false,
+    const myslam::FlowCheck &check = myslam::FlowCheck()
 );
 
 /**
- * get a gray scale value from reference image (bi-linear interpolated)
- * @param img
- * @param x
- * @param y
- * @return the interpolated value of this pixel
+ * multi level optical flow on pyramids built beforehand, e.g. a keyframe pyramid shared by several frames
+ * @param [in] pyr1 pyramid of the first image
+ * @param [in] pyr2 pyramid of the second image, same levels and scale as pyr1
+ * @param [in] kp1 keypoints in img1
+ * @param [out] kp2 keypoints in img2
+ * @param [out] success true if a keypoint is tracked successfully
+ * @param [in] inverse set true to enable inverse formulation
+ * @param [in] check checks of every track on the finest level, the NCC score is set as the response of kp2
  */
-inline float GetPixelValue(const cv::Mat &img, float x, float y) {
-    // boundary check
-    if (x < 0) x = 0;
-    if (y < 0) y = 0;
-    if (x >= img.cols) x = img.cols - 1;
-    if (y >= img.rows) y = img.rows - 1;
-    uchar *data = &img.data[int(y) * img.step + int(x)];
-    float xx = x - floor(x);
-    float yy = y - floor(y);
-    return float(
-        (1 - xx) * (1 - yy) * data[0] +
-        xx * (1 - yy) * data[1] +
-        (1 - xx) * yy * data[img.step] +
-        xx * yy * data[img.step + 1]
-    );
-}
+void OpticalFlowMultiLevel(
+    const ImagePyramid &pyr1,
+    const ImagePyramid &pyr2,
+    const vector<KeyPoint> &kp1,
+    vector<KeyPoint> &kp2,
+    vector<bool> &success,
+    bool inverse = false,
+    const myslam::FlowCheck &check = myslam::FlowCheck()
+);
 
 int main(int argc, char **argv) {
 
@@ -125,7 +129,25 @@ int main(int argc, char **argv) {
     OpticalFlowMultiLevel(img1, img2, kp1, kp2_multi, success_multi, true);
     chrono::steady_clock::time_point t2 = chrono::steady_clock::now();
     auto time_used = chrono::duration_cast<chrono::duration<double>>(t2 - t1);
-    cout << "optical flow by gauss-newton: " << time_used.count() << endl;
+    cout << "optical flow by gauss-newton: " << time_used.count() << " (" << LKPatch::KernelName() << ")" << endl;
+
+    // multi-level LK with forward-backward and NCC checks, in the same parallel pass as the tracking
+    myslam::FlowCheck check;
+    check.forward_backward = true;
+    check.min_ncc = 0.7;
+    vector<KeyPoint> kp2_checked;
+    vector<bool> success_checked;
+    t1 = chrono::steady_clock::now();
+    OpticalFlowMultiLevel(img1, img2, kp1, kp2_checked, success_checked, true, check);
+    t2 = chrono::steady_clock::now();
+    time_used = chrono::duration_cast<chrono::duration<double>>(t2 - t1);
+    int cnt_multi = 0, cnt_checked = 0;
+    for (size_t i = 0; i < kp1.size(); i++) {
+        cnt_multi += success_multi[i];
+        cnt_checked += success_checked[i];
+    }
+    cout << "optical flow with checks: " << time_used.count() << ", " << cnt_checked << " of " << cnt_multi
+         << " tracks kept" << endl;
 
     // use opencv's flow for validation
     vector<Point2f> pt1, pt2;
@@ -180,18 +202,20 @@ void OpticalFlowSingleLevel(
     const vector<KeyPoint> &kp1,
     vector<KeyPoint> &kp2,
     vector<bool> &success,
-    bool inverse, bool has_initial) {
+    bool inverse, bool has_initial,
+    const myslam::FlowCheck &check) {
     kp2.resize(kp1.size());
     success.resize(kp1.size());
-    OpticalFlowTracker tracker(img1, img2, kp1, kp2, success, inverse, has_initial);
+    OpticalFlowTracker tracker(img1, img2, kp1, kp2, success, inverse, has_initial, check);
     parallel_for_(Range(0, kp1.size()),
                   std::bind(&OpticalFlowTracker::calculateOpticalFlow, &tracker, placeholders::_1));
 }
 
 void OpticalFlowTracker::calculateOpticalFlow(const Range &range) {
-    // parameters
-    int half_patch_size = 4;
-    int iterations = 10;
+    // 8x8 patch, 10 Gauss-Newton iterations
+    LKPatch::Options options;
+    options.inverse = inverse;
+    LKPatch lk(options);
     for (size_t i = range.start; i < range.end; i++) {
         auto kp = kp1[i];
         double dx = 0, dy = 0; // dx,dy need to be estimated
@@ -200,85 +224,22 @@ void OpticalFlowTracker::calculateOpticalFlow(const Range &range) {
             dy = kp2[i].pt.y - kp.pt.y;
         }
 
-        double cost = 0, lastCost = 0;
-        bool succ = true; // indicate if this point succeeded
-
-        // Gauss-Newton iterations
-        Eigen::Matrix2d H = Eigen::Matrix2d::Zero();    // hessian
-        Eigen::Vector2d b = Eigen::Vector2d::Zero();    // bias
-        Eigen::Vector2d J;  // jacobian
-        for (int iter = 0; iter < iterations; iter++) {
-            if (inverse == false) {
-                H = Eigen::Matrix2d::Zero();
-                b = Eigen::Vector2d::Zero();
-            } else {
-                // only reset b
-                b = Eigen::Vector2d::Zero();
-            }
-
-            cost = 0;
-
-            // compute cost and jacobian
-            for (int x = -half_patch_size; x < half_patch_size; x++)
-                for (int y = -half_patch_size; y < half_patch_size; y++) {
-                    double error = GetPixelValue(img1, kp.pt.x + x, kp.pt.y + y) -
-                                   GetPixelValue(img2, kp.pt.x + x + dx, kp.pt.y + y + dy);;  // Jacobian
-                    if (inverse == false) {
-                        J = -1.0 * Eigen::Vector2d(
-                            0.5 * (GetPixelValue(img2, kp.pt.x + dx + x + 1, kp.pt.y + dy + y) -
-                                   GetPixelValue(img2, kp.pt.x + dx + x - 1, kp.pt.y + dy + y)),
-                            0.5 * (GetPixelValue(img2, kp.pt.x + dx + x, kp.pt.y + dy + y + 1) -
-                                   GetPixelValue(img2, kp.pt.x + dx + x, kp.pt.y + dy + y - 1))
-                        );
-                    } else if (iter == 0) {
-                        // in inverse mode, J keeps same for all iterations
-                        // NOTE this J does not change when dx, dy is updated, so we can store it and only compute error
-                        J = -1.0 * Eigen::Vector2d(
-                            0.5 * (GetPixelValue(img1, kp.pt.x + x + 1, kp.pt.y + y) -
-                                   GetPixelValue(img1, kp.pt.x + x - 1, kp.pt.y + y)),
-                            0.5 * (GetPixelValue(img1, kp.pt.x + x, kp.pt.y + y + 1) -
-                                   GetPixelValue(img1, kp.pt.x + x, kp.pt.y + y - 1))
-                        );
-                    }
-                    // compute H, b and set cost;
-                    b += -error * J;
-                    cost += error * error;
-                    if (inverse == false || iter == 0) {
-                        // also update H
-                        H += J * J.transpose();
-                    }
-                }
-
-            // compute update
-            Eigen::Vector2d update = H.ldlt().solve(b);
-
-            if (std::isnan(update[0])) {
-                // sometimes occurred when we have a black or white patch and H is irreversible
-                cout << "update is nan" << endl;
-                succ = false;
-                break;
-            }
-
-            if (iter > 0 && cost > lastCost) {
-                break;
-            }
+        success[i] = lk.Track(img1, img2, kp.pt, dx, dy);
 
-            // update dx, dy
-            dx += update[0];
-            dy += update[1];
-            lastCost = cost;
-            succ = true;
+        // set kp2
+        kp2[i].pt = kp.pt + Point2f(dx, dy);
 
-            if (update.norm() < 1e-2) {
-                // converge
-                break;
+        if (check.Enabled() && success[i]) {
+            // track back on this level, starting from the start point
+            double back_dx = -dx, back_dy = -dy;
+            if (check.forward_backward) {
+                success[i] = lk.Track(img2, img1, kp2[i].pt, back_dx, back_dy);
             }
+            float ncc = 1;
+            Point2f pt_back = kp2[i].pt + Point2f(back_dx, back_dy);
+            success[i] = success[i] && check.Check(img1, img2, kp.pt, kp2[i].pt, pt_back, ncc);
+            kp2[i].response = ncc;
         }
-
-        success[i] = succ;
-
-        // set kp2
-        kp2[i].pt = kp.pt + Point2f(dx, dy);
     }
 }
 
@@ -288,39 +249,37 @@ void OpticalFlowMultiLevel(
     const vector<KeyPoint> &kp1,
     vector<KeyPoint> &kp2,
     vector<bool> &success,
-    bool inverse) {
+    bool inverse,
+    const myslam::FlowCheck &check) {
 
-    // parameters
-    int pyramids = 4;
-    double pyramid_scale = 0.5;
-    double scales[] = {1.0, 0.5, 0.25, 0.125};
-
-    // create pyramids
+    // create pyramids, 4 levels with scale 0.5
     chrono::steady_clock::time_point t1 = chrono::steady_clock::now();
-    vector<Mat> pyr1, pyr2; // image pyramids
-    for (int i = 0; i < pyramids; i++) {
-        if (i == 0) {
-            pyr1.push_back(img1);
-            pyr2.push_back(img2);
-        } else {
-            Mat img1_pyr, img2_pyr;
-            cv::resize(pyr1[i - 1], img1_pyr,
-                       cv::Size(pyr1[i - 1].cols * pyramid_scale, pyr1[i - 1].rows * pyramid_scale));
-            cv::resize(pyr2[i - 1], img2_pyr,
-                       cv::Size(pyr2[i - 1].cols * pyramid_scale, pyr2[i - 1].rows * pyramid_scale));
-            pyr1.push_back(img1_pyr);
-            pyr2.push_back(img2_pyr);
-        }
-    }
+    ImagePyramid pyr1, pyr2;
+    pyr1.Build(img1);
+    pyr2.Build(img2);
     chrono::steady_clock::time_point t2 = chrono::steady_clock::now();
     auto time_used = chrono::duration_cast<chrono::duration<double>>(t2 - t1);
     cout << "build pyramid time: " << time_used.count() << endl;
 
+    OpticalFlowMultiLevel(pyr1, pyr2, kp1, kp2, success, inverse, check);
+}
+
+void OpticalFlowMultiLevel(
+    const ImagePyramid &pyr1,
+    const ImagePyramid &pyr2,
+    const vector<KeyPoint> &kp1,
+    vector<KeyPoint> &kp2,
+    vector<bool> &success,
+    bool inverse,
+    const myslam::FlowCheck &check) {
+
+    const int pyramids = pyr1.Levels();
+
     // coarse-to-fine LK tracking in pyramids
     vector<KeyPoint> kp1_pyr, kp2_pyr;
     for (auto &kp:kp1) {
         auto kp_top = kp;
-        kp_top.pt *= scales[pyramids - 1];
+        kp_top.pt *= pyr1.Scale(pyramids - 1);
         kp1_pyr.push_back(kp_top);
         kp2_pyr.push_back(kp_top);
     }
@@ -328,17 +287,19 @@ void OpticalFlowMultiLevel(
     for (int level = pyramids - 1; level >= 0; level--) {
         // from coarse to fine
         success.clear();
-        t1 = chrono::steady_clock::now();
-        OpticalFlowSingleLevel(pyr1[level], pyr2[level], kp1_pyr, kp2_pyr, success, inverse, true);
-        t2 = chrono::steady_clock::now();
+        chrono::steady_clock::time_point t1 = chrono::steady_clock::now();
+        OpticalFlowSingleLevel(pyr1.Image(level), pyr2.Image(level), kp1_pyr, kp2_pyr, success, inverse, true,
+                               level == 0 ? check : myslam::FlowCheck());
+        chrono::steady_clock::time_point t2 = chrono::steady_clock::now();
         auto time_used = chrono::duration_cast<chrono::duration<double>>(t2 - t1);
         cout << "track pyr " << level << " cost time: " << time_used.count() << endl;
 
         if (level > 0) {
+            const double pyramid_scale = pyr1.Scale(level - 1) / pyr1.Scale(level);
             for (auto &kp: kp1_pyr)
-                kp.pt /= pyramid_scale;
+                kp.pt *= pyramid_scale;
             for (auto &kp: kp2_pyr)
-                kp.pt /= pyramid_scale;
+                kp.pt *= pyramid_scale;
         }
     }
 
@@ -0,0 +1,52 @@
+#include "pixel_selector.h"
+
+#include <algorithm>
+#include <cmath>
+
+int PixelSelector::Budget(int level) const {
+    if (options_.budgets.empty()) return 0;
+    return options_.budgets[std::min<size_t>(level, options_.budgets.size() - 1)];
+}
+
+void PixelSelector::Select(const cv::Mat &grad_x, const cv::Mat &grad_y, int budget, std::vector<cv::Point> &pixels,
+                           const cv::Mat &mask) const {
+    pixels.clear();
+    const int border = options_.border;
+    const int width = grad_x.cols - 2 * border, height = grad_x.rows - 2 * border;
+    if (budget <= 0 || width <= 0 || height <= 0) return;
+
+    // one block per pixel of the budget
+    const int block_size = std::max(options_.min_block_size,
+                                    int(std::ceil(std::sqrt(double(width) * height / budget))));
+    const float min_gradient2 = float(options_.min_gradient * options_.min_gradient);
+    pixels.reserve(budget);
+
+    for (int by = border; by < border + height; by += block_size) {
+        const int y_end = std::min(by + block_size, border + height);
+        for (int bx = border; bx < border + width; bx += block_size) {
+            const int x_end = std::min(bx + block_size, border + width);
+            float best = min_gradient2;
+            cv::Point best_px(-1, -1);
+            for (int y = by; y < y_end; y++) {
+                const float *gx = grad_x.ptr<float>(y), *gy = grad_y.ptr<float>(y);
+                const uchar *m = mask.empty() ? nullptr : mask.ptr<uchar>(y);
+                for (int x = bx; x < x_end; x++) {
+                    const float g2 = gx[x] * gx[x] + gy[x] * gy[x];
+                    if (g2 > best && (!m || m[x])) {
+                        best = g2;
+                        best_px = cv::Point(x, y);
+                    }
+                }
+            }
+            if (best_px.x >= 0) pixels.push_back(best_px);
+        }
+    }
+
+    // the partial blocks at the right and bottom border may exceed the budget by a few pixels, drop pixels at an
+    // even stride over all the blocks rather than the last rows
+    const int selected = int(pixels.size());
+    if (selected > budget) {
+        for (int i = 0; i < budget; i++) pixels[i] = pixels[int64_t(i) * selected / budget];
+        pixels.resize(budget);
+    }
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <opencv2/core/core.hpp>
+#include <vector>
+
+/**
+ * Semi-dense pixel selection for the direct method
+ * - the image is divided into square blocks, sized so that the number of blocks matches the budget of the level
+ * - in every block the pixel with the largest gradient is selected, if its gradient is above min_gradient
+ * - every pyramid level has its own budget, coarse levels need fewer pixels
+ * So the selected pixels follow the edges and corners of the image and are spread over the whole image instead of
+ * being concentrated on the most textured region.
+ */
+class PixelSelector {
+public:
+    struct Options {
+        std::vector<int> budgets = {2000, 1000, 500, 250};  // pixels of each pyramid level, the last one repeats
+        double min_gradient = 6;  // gradient magnitude, in intensity per pixel
+        int min_block_size = 2;   // blocks are never smaller, pixels of neighbouring blocks may still touch
+        int border = 4;           // pixels closer to the border are never selected
+    };
+
+    PixelSelector() : PixelSelector(Options()) {}
+
+    explicit PixelSelector(const Options &options) : options_(options) {}
+
+    /// budget of a pyramid level
+    int Budget(int level) const;
+
+    /**
+     * select the pixels of an image
+     * @param grad_x gradients of the image, CV_32F, e.g. ImagePyramid::GradX
+     * @param grad_y
+     * @param budget maximum number of pixels
+     * @param pixels [out] selected pixels, ordered by block
+     * @param mask only pixels with a non zero mask (CV_8U, same size) are selected, all of them if empty
+     */
+    void Select(const cv::Mat &grad_x, const cv::Mat &grad_y, int budget, std::vector<cv::Point> &pixels,
+                const cv::Mat &mask = cv::Mat()) const;
+
+    const Options &GetOptions() const { return options_; }
+
+private:
+    Options options_;
+};